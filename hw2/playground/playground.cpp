@@ -17,13 +17,45 @@ using namespace glm;
 
 #include <vector>
 #include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <string.h>
+#include <stddef.h>
+#include <signal.h>
 
-#include <common/shader.hpp>
-#include <common/objloader.hpp>
 #include <common/texture.hpp>
 #include "utils/figures.hpp"
+#include "utils/meshopt.hpp"
+#include "utils/vertexformat.hpp"
 #include "utils/controls.hpp"
 #include "utils/init.hpp"
+#include "utils/softraster.hpp"
+#include "utils/capture.hpp"
+#include "utils/texarray.hpp"
+#include "utils/input.hpp"
+#include "utils/pacing.hpp"
+#include "utils/dynres.hpp"
+#include "utils/occlusion.hpp"
+#include "utils/drawsort.hpp"
+#include "utils/overdraw.hpp"
+#include "utils/indirect.hpp"
+#include "utils/projectiles.hpp"
+#include "utils/particles.hpp"
+#include "utils/boids.hpp"
+#include "utils/random.hpp"
+#include "utils/snapshot.hpp"
+#include "utils/net.hpp"
+#include "utils/replication.hpp"
+#include "utils/threadpool.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/assetpack.hpp"
+#include "utils/shaders.hpp"
+#include "utils/startup.hpp"
+#include "utils/memtrack.hpp"
+#include "utils/clustered.hpp"
+#include "utils/triplebuffer.hpp"
 
 
 class Object_3d {
@@ -33,179 +65,311 @@ public:
 	vec3 coordinates;
 	vec3 direction;
 	mat4 rotation;
+	int texture_layer; // wrapped to the layers of the texture set the object is drawn with
+	unsigned int id;   // network identity, 0 until the server hands one out
 
-	Object_3d(vec3 coordinates, vec3 direction, mat4 rotation) {
+	Object_3d(vec3 coordinates, vec3 direction, mat4 rotation, int texture_layer = 0) {
 		this->coordinates = coordinates;
 		this->direction = direction;
 		this->rotation = rotation;
+		this->texture_layer = texture_layer;
+		this->id = 0;
 	}
 
 	void move(float deltaTime) {
 		coordinates += direction * deltaTime * speed;
 	}
+
+	mat4 get_model() const {
+		mat4 Translation = translate(coordinates);
+		mat4 Scaling = mat4(1.0f);
+		return Translation * rotation * Scaling;
+	}
 };
 
 const float Object_3d::speed = 5.0f;
 
+// Every list of objects counts in the memory report, see memtrack.hpp
+typedef std::vector<Object_3d, TrackedAllocator<Object_3d, MEMORY_OBJECTS> > ObjectList;
+
 
 template <typename T>
-GLuint load_buffer(int buffer_size, T* buffer_data) {
+GLuint load_buffer(int buffer_size, T* buffer_data, const char* label) {
 	GLuint buffer_id;
 	glGenBuffers(1, &buffer_id);
 	glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
 	glBufferData(GL_ARRAY_BUFFER, buffer_size, buffer_data, GL_STATIC_DRAW);
+	track_gpu_resource(GPU_BUFFER, buffer_id, label, buffer_size, GL_STATIC_DRAW);
 	return buffer_id;
 }
 
 
 void draw_object(
-	GLuint vertexbuffer, GLuint colorbuffer, GLuint MatrixID, int polygon_count,
-	Object_3d& obj, mat4& View, mat4& Projection, int color_size
+	GLuint vertexbuffer, GLuint colorbuffer, GLuint normalbuffer, GLuint indexbuffer, const MeshLayout& layout,
+	GLuint MatrixID, GLuint ModelViewID, int polygon_count, const Object_3d& obj, const mat4& View, const mat4& Projection
 ) {
-	mat4 Translation = translate(obj.coordinates);
-	mat4 Scaling = mat4(1.0f);
-	mat4 Model = Translation * obj.rotation * Scaling;
-	mat4 MVP = Projection * View * Model;
+	mat4 ModelView = View * obj.get_model();
+	mat4 MVP = Projection * ModelView;
 
 	// Send our transformation to the currently bound shader, 
 	// in the "MVP" uniform
 	glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+	glUniformMatrix4fv(ModelViewID, 1, GL_FALSE, &ModelView[0][0]);
 
-	// 1rst attribute buffer : vertices
+	// 1rst attribute buffer : vertices, in whatever format the layout says
 	glEnableVertexAttribArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glVertexAttribPointer(
-		0,                  // attribute. No particular reason for 0, but must match the layout in the shader.
-		3,                  // size
-		GL_FLOAT,           // type
-		GL_FALSE,           // normalized?
-		0,                  // stride
-		(void*)0            // array buffer offset
-	);
+	set_vertex_attribute(0, layout.position, 0);
 
 	// 2nd attribute buffer : colors
 	glEnableVertexAttribArray(1);
 	glBindBuffer(GL_ARRAY_BUFFER, colorbuffer);
-	glVertexAttribPointer(
-		1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-		color_size,                       // size
-		GL_FLOAT,                         // type
-		GL_FALSE,                         // normalized?
-		0,                                // stride
-		(void*)0                          // array buffer offset
-	);
+	set_vertex_attribute(1, layout.color, 0);
+
+	// 3rd attribute buffer : normals
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+	set_vertex_attribute(2, layout.normal, 0);
 
-	// Draw the triangle !
-	glDrawArrays(GL_TRIANGLES, 0, 3 * polygon_count); // 3*n indices starting at 0 -> n triangles
+	// Draw the triangles ! 3*n indices -> n triangles
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+	glDrawElements(GL_TRIANGLES, 3 * polygon_count, GL_UNSIGNED_INT, (void*)0);
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(2);
 }
 
 void draw_all_enemies(
-	GLuint vertexbuffer, GLuint colorbuffer, GLuint MatrixID,
-	std::vector<Object_3d>& enemies, mat4& View, mat4& Projection
+	GLuint vertexbuffer, GLuint colorbuffer, GLuint normalbuffer, GLuint indexbuffer, const MeshLayout& layout,
+	GLuint MatrixID, GLuint ModelViewID, int polygon_count, const ObjectList& enemies, const mat4& View, const mat4& Projection
 ) {
-	static int polygon_count = get_oct_vertex_size() / 3 / 3 / sizeof(GLfloat);
 	int length = enemies.size();
 	for (int i = 0; i < length; i++) {
 		draw_object(
-			vertexbuffer, colorbuffer, MatrixID, polygon_count,
-			enemies[i], View, Projection, 4
+			vertexbuffer, colorbuffer, normalbuffer, indexbuffer, layout, MatrixID, ModelViewID, polygon_count,
+			enemies[i], View, Projection
 		);
 	}
 }
 
-void draw_all_fireballs(
-	GLuint vertexbuffer, GLuint colorbuffer, GLuint MatrixID,
-	std::vector<Object_3d>& fireballs, mat4& View, mat4& Projection,
-	int polygon_c, GLuint Texture, GLuint TextureID
-) {
-	static double lastTime = glfwGetTime();
-	double currentTime = glfwGetTime();
+// Per-instance data of a batched draw, see TransformVertexShader_instanced
+struct InstanceData {
+	mat4 model;
+	float layer;
+};
 
+// instance_count fireballs in a single instanced draw, whatever layer of the texture set they use.
+// Their model matrices and layers are in instancebuffer, stride bytes apart.
+void draw_fireball_instances(
+	GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint indexbuffer, const MeshLayout& layout,
+	GLuint instancebuffer, int stride, int layer_offset, int instance_count,
+	GLuint VPID, GLuint ViewID, const mat4& View, const mat4& Projection,
+	int polygon_count, TextureSet& textures, GLuint TextureID, GLuint AtlasRectsID
+) {
 	// Bind our texture in Texture Unit 0
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, Texture);
+	glBindTexture(textures.target, textures.texture);
 	// Set our "myTextureSampler" sampler to use Texture Unit 0
 	glUniform1i(TextureID, 0);
+	if (textures.target == GL_TEXTURE_2D)
+		glUniform4fv(AtlasRectsID, textures.layer_count, &textures.rects[0].x);
+
+	mat4 VP = Projection * View;
+	glUniformMatrix4fv(VPID, 1, GL_FALSE, &VP[0][0]);
+	glUniformMatrix4fv(ViewID, 1, GL_FALSE, &View[0][0]);
+
+	// 3rd to 6th attributes : columns of the model matrix, advancing once per instance
+	glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+	for (int column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(2 + column);
+		glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec4) * column));
+		glVertexAttribDivisor(2 + column, 1);
+	}
+	// 7th attribute : texture layer
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, stride, (void*)(size_t)layer_offset);
+	glVertexAttribDivisor(6, 1);
+
+	// 1rst attribute buffer : vertices
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+	set_vertex_attribute(0, layout.position, 0);
+
+	// 2nd attribute buffer : UVs
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
+	set_vertex_attribute(1, layout.uv, 0);
+
+	// 8th attribute buffer : normals
+	glEnableVertexAttribArray(7);
+	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+	set_vertex_attribute(7, layout.normal, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer);
+	glDrawElementsInstanced(GL_TRIANGLES, 3 * polygon_count, GL_UNSIGNED_INT, (void*)0, instance_count);
+
+	for (int attribute = 0; attribute < 8; attribute++)
+		glDisableVertexAttribArray(attribute);
+}
+
+typedef std::vector<InstanceData, TrackedAllocator<InstanceData, MEMORY_DRAW> > InstanceList;
 
-	static int polygon_count = polygon_c;
+// Instance data of the fireballs, in the same order
+void get_fireball_instances(const ObjectList& fireballs, int layer_count, InstanceList& instances) {
 	int length = fireballs.size();
+	instances.resize(length);
 	for (int i = 0; i < length; i++) {
-		fireballs[i].move(currentTime - lastTime);
-		draw_object(
-			vertexbuffer, colorbuffer, MatrixID, polygon_count,
-			fireballs[i], View, Projection, 2
-		);
+		instances[i].model = fireballs[i].get_model();
+		instances[i].layer = (float)(fireballs[i].texture_layer % layer_count);
 	}
-	lastTime = currentTime;
 }
 
+// All fireballs in a single instanced draw, from their instance data
+void draw_all_fireballs(
+	GLuint vertexbuffer, GLuint uvbuffer, GLuint normalbuffer, GLuint indexbuffer, const MeshLayout& layout,
+	GLuint instancebuffer, GLuint VPID, GLuint ViewID,
+	const InstanceList& instances, const mat4& View, const mat4& Projection,
+	int polygon_count, TextureSet& textures, GLuint TextureID, GLuint AtlasRectsID
+) {
+	if (instances.empty())
+		return;
+	int length = instances.size();
+
+	// Orphan the storage of the last frame instead of waiting for the GPU to be done with it
+	glBindBuffer(GL_ARRAY_BUFFER, instancebuffer);
+	glBufferData(GL_ARRAY_BUFFER, length * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+	track_gpu_resource(GPU_BUFFER, instancebuffer, "fireball instances", length * sizeof(InstanceData), GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, length * sizeof(InstanceData), &instances[0]);
+
+	draw_fireball_instances(
+		vertexbuffer, uvbuffer, normalbuffer, indexbuffer, layout, instancebuffer, sizeof(InstanceData), sizeof(mat4), length,
+		VPID, ViewID, View, Projection, polygon_count, textures, TextureID, AtlasRectsID
+	);
+}
 
-float get_random_float(float start, float end) {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
+void move_all(ObjectList& objects, float deltaTime) {
+	int length = objects.size();
+	for (int i = 0; i < length; i++) {
+		objects[i].move(deltaTime);
+	}
+}
 
-	std::uniform_real_distribution<> dist(start, end);
-	return dist(gen);
+// Enemies swarm around the target. The swarm works on its own arrays,
+// their velocity is kept in direction as for every Object_3d (times speed).
+static BoidSwarm enemy_swarm;
+
+void update_enemy_swarm(ObjectList& enemies, vec3 target, float deltaTime) {
+	int length = enemies.size();
+	enemy_swarm.resize(length);
+	for (int i = 0; i < length; i++) {
+		vec3 velocity = enemies[i].direction * Object_3d::speed;
+		enemy_swarm.px[i] = enemies[i].coordinates.x;
+		enemy_swarm.py[i] = enemies[i].coordinates.y;
+		enemy_swarm.pz[i] = enemies[i].coordinates.z;
+		enemy_swarm.vx[i] = velocity.x;
+		enemy_swarm.vy[i] = velocity.y;
+		enemy_swarm.vz[i] = velocity.z;
+	}
+
+	enemy_swarm.update(target, deltaTime);
+
+	for (int i = 0; i < length; i++) {
+		enemies[i].coordinates = vec3(enemy_swarm.px[i], enemy_swarm.py[i], enemy_swarm.pz[i]);
+		enemies[i].direction = vec3(enemy_swarm.vx[i], enemy_swarm.vy[i], enemy_swarm.vz[i]) / Object_3d::speed;
+	}
 }
 
-vec3 get_random_direction() {
-	float verticalAngle = get_random_float(0, 2*std::_Pi);
-	float horizontalAngle = get_random_float(0, 2*std::_Pi);
-	return vec3(
-		cos(verticalAngle) * sin(horizontalAngle),
-		sin(verticalAngle),
-		cos(verticalAngle) * cos(horizontalAngle)
-	);
+
+// Gameplay spawns, seeded from the OS at startup
+static RandomGenerator spawn_random(std::random_device{}());
+
+// count enemies between min_radius and max_radius around center, each turned a random way
+void spawn_enemy_wave(
+	ObjectList& enemies, vec3 center, int count, RandomGenerator& random,
+	float min_radius = 2, float max_radius = 20
+) {
+	if (count <= 0)
+		return;
+
+	std::vector<vec3> coords(count);
+	std::vector<quat> rotations(count);
+	random.fill_spawn_points(&coords[0], count, center, min_radius, max_radius);
+	random.fill_rotations(&rotations[0], count);
+
+	enemies.reserve(enemies.size() + count);
+	for (int i = 0; i < count; i++)
+		enemies.push_back(Object_3d(coords[i], vec3(), mat4_cast(rotations[i])));
 }
 
 
-void create_enemy_by_timer(std::vector<Object_3d>& enemies) {
+void create_enemy_by_timer(ObjectList& enemies) {
 	static double lastTime = glfwGetTime();
 	double currentTime = glfwGetTime();
 
 	if (currentTime - lastTime > 3) {
 		//printf("create new enemy\n");
-		vec3 new_coord = getCameraPosition() + get_random_direction()*get_random_float(2, 20);
-		vec3 new_direction = vec3();
-		mat4 new_rot = rotate(get_random_float(0, 2*std::_Pi), get_random_direction());
-
-		enemies.push_back(Object_3d(new_coord, new_direction, new_rot));
+		spawn_enemy_wave(enemies, getCameraPosition(), 1, spawn_random);
 		lastTime = currentTime;
 		//printf("enemy count = %d\n", coords.size());
 	}
 }
 
-void create_fireball_by_click(std::vector<Object_3d>& fireballs) {
-	static int prev_state = GLFW_RELEASE;
+// Fireball flying along new_direction, starting a bit in front of the camera
+Object_3d make_fireball(vec3 camera_position, vec3 new_direction, int texture_layer) {
+	vec3 new_coord = camera_position + new_direction * 3.0f;
 
-	int state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-	if (state != prev_state) {
-		prev_state = state;
+	vec3 yAxis(0, 1, 0);
+	vec3 rotationAxis = cross(yAxis, new_direction);
+	float rotationAngle = acos(dot(yAxis, new_direction));
+	mat4 new_rot = rotate(rotationAngle, rotationAxis);
 
-		if (state == GLFW_PRESS) {
-			//printf("create new fireball\n");
-			vec3 new_direction = getCameraDirection();
-			vec3 new_coord = getCameraPosition() + new_direction * 3.0f;
-
-			vec3 yAxis(0, 1, 0);
-			vec3 rotationAxis = cross(yAxis, new_direction);
-			float rotationAngle = acos(dot(yAxis, new_direction));
-			mat4 new_rot = rotate(rotationAngle, rotationAxis);
+	return Object_3d(new_coord, new_direction, new_rot, texture_layer);
+}
 
-			fireballs.push_back(Object_3d(new_coord, new_direction, new_rot));
-			//printf("fireball count = %d\n", coords.size());
+// Mouse look and clicks since the last tick, in the order they happened : a click
+// sees the camera direction of its moment, and a press released within the same
+// frame still fires
+void read_input_events(std::vector<NetClick>& clicks) {
+	InputEvent event;
+	while (poll_input_event(event)) {
+		if (event.type == INPUT_CURSOR_MOTION) {
+			rotateCamera(event.dx, event.dy);
+		} else if (event.type == INPUT_MOUSE_BUTTON && event.button == GLFW_MOUSE_BUTTON_LEFT && event.action == GLFW_PRESS) {
+			NetClick click;
+			click.number = 0;
+			click.time = event.time;
+			click.direction = getCameraDirection();
+			clicks.push_back(click);
 		}
 	}
 }
 
-void delete_collided(std::vector<Object_3d>& enemies, std::vector<Object_3d>& fireballs) {
+void process_input_events(ObjectList& fireballs, double currentTime) {
+	static int shot_count = 0;
+	static std::vector<NetClick> clicks;
+
+	clicks.clear();
+	read_input_events(clicks);
+	for (size_t i = 0; i < clicks.size(); i++) {
+		//printf("create new fireball\n");
+		// Every shot takes the next fireball texture
+		Object_3d fireball = make_fireball(getCameraPosition(), clicks[i].direction, shot_count++);
+		// It has been flying since the click, not since the start of the tick
+		fireball.move(float(currentTime - clicks[i].time));
+		fireballs.push_back(fireball);
+		//printf("fireball count = %d\n", coords.size());
+	}
+}
+
+// A fireball closer than that to an enemy, center to center, kills it
+static const float hit_distance = 1.5f;
+
+void delete_collided(ObjectList& enemies, ObjectList& fireballs) {
 	for (int i = 0; i < enemies.size();) {
 		bool inner_breaked = false;
 		for (int j = 0; j < fireballs.size();) {
-			if (glm::length(enemies[i].coordinates - fireballs[j].coordinates) < 1.5) {
+			if (glm::length(enemies[i].coordinates - fireballs[j].coordinates) < hit_distance) {
 				enemies.erase(enemies.begin() + i);
 				fireballs.erase(fireballs.begin() + j);
 				inner_breaked = true;
@@ -220,103 +384,1841 @@ void delete_collided(std::vector<Object_3d>& enemies, std::vector<Object_3d>& fi
 	}
 }
 
+// In place of move_all and delete_collided when the GPU has the fireballs, see
+// ProjectileSimulation : the kills it found in the steps it's done with are
+// applied, the new fireballs are handed over, then it moves and collides the
+// rest. Enemies carry their slot + 1 as id.
+void step_gpu_projectiles(
+	ProjectileSimulation& projectiles, ObjectList& enemies, ObjectList& fireballs,
+	int layer_count, float deltaTime
+) {
+	static std::vector<ProjectileEvent> events;
+	static std::vector<unsigned int> killed_ids;
+	events.clear();
+	projectiles.read_events(events);
+
+	killed_ids.clear();
+	for (size_t i = 0; i < events.size(); i++) {
+		if (events[i].enemy >= 0)
+			killed_ids.push_back(events[i].enemy + 1);
+	}
+	if (!killed_ids.empty()) {
+		std::sort(killed_ids.begin(), killed_ids.end());
+		size_t kept = 0;
+		for (size_t i = 0; i < enemies.size(); i++) {
+			if (!std::binary_search(killed_ids.begin(), killed_ids.end(), enemies[i].id))
+				enemies[kept++] = enemies[i];
+		}
+		enemies.erase(enemies.begin() + kept, enemies.end());
+	}
 
-int main() {
-	int init_res = init_all();
-	if (init_res != 0)
-		return init_res;
+	for (size_t i = 0; i < fireballs.size(); i++) {
+		const Object_3d& fireball = fireballs[i];
+		projectiles.add_fireball(fireball.coordinates, fireball.direction * Object_3d::speed, fireball.rotation,
+			(float)(fireball.texture_layer % layer_count));
+	}
+	fireballs.clear();
 
+	static std::vector<GpuEnemy> gpu_enemies;
+	gpu_enemies.resize(enemies.size());
+	for (size_t i = 0; i < enemies.size(); i++) {
+		if (enemies[i].id == 0)
+			enemies[i].id = projectiles.add_enemy() + 1;
+		gpu_enemies[i].position = enemies[i].coordinates;
+		gpu_enemies[i].slot = enemies[i].id - 1;
+	}
+	projectiles.step(gpu_enemies, deltaTime);
+}
 
-	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
-	mat4 Projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+// After the world was replaced : the slots of the old one mean nothing
+void restart_gpu_projectiles(ProjectileSimulation& projectiles, ObjectList& enemies) {
+	projectiles.reset();
+	for (size_t i = 0; i < enemies.size(); i++)
+		enemies[i].id = 0;
+}
+
+
+// Sections of the world snapshots
+enum WorldSection {
+	SECTION_ENEMIES = 1,
+	SECTION_FIREBALLS = 2,
+};
+
+// Objects and camera. The objects are saved as they are in memory, a change
+// of Object_3d makes the old snapshots refuse to load rather than load garbage.
+bool save_world(const char* path, const ObjectList& enemies, const ObjectList& fireballs, bool compress) {
+	SnapshotCamera camera;
+	getCameraState(camera.position, camera.horizontal_angle, camera.vertical_angle);
+
+	std::vector<SnapshotSection> sections(2);
+	sections[0].id = SECTION_ENEMIES;
+	sections[0].record_size = sizeof(Object_3d);
+	sections[0].record_count = enemies.size();
+	sections[0].data = enemies.empty() ? NULL : &enemies[0];
+	sections[1].id = SECTION_FIREBALLS;
+	sections[1].record_size = sizeof(Object_3d);
+	sections[1].record_count = fireballs.size();
+	sections[1].data = fireballs.empty() ? NULL : &fireballs[0];
+
+	return save_snapshot(path, camera, sections, compress);
+}
+
+bool load_world(const char* path, ObjectList& enemies, ObjectList& fireballs) {
+	Snapshot snapshot;
+	if (!snapshot.open(path))
+		return false;
+
+	unsigned int enemy_count, fireball_count;
+	const Object_3d* saved_enemies = (const Object_3d*)snapshot.get_section(SECTION_ENEMIES, sizeof(Object_3d), enemy_count);
+	const Object_3d* saved_fireballs = (const Object_3d*)snapshot.get_section(SECTION_FIREBALLS, sizeof(Object_3d), fireball_count);
+	if (!saved_enemies || !saved_fireballs) {
+		printf("%s has no objects to load\n", path);
+		return false;
+	}
+
+	// One copy out of the mapping per array
+	enemies.assign(saved_enemies, saved_enemies + enemy_count);
+	fireballs.assign(saved_fireballs, saved_fireballs + fireball_count);
+
+	const SnapshotCamera& camera = snapshot.get_camera();
+	setCameraState(camera.position, camera.horizontal_angle, camera.vertical_angle);
+	return true;
+}
+
+// F5 saves a checkpoint, F9 goes back to it. true when the world was replaced.
+bool handle_checkpoint_keys(ObjectList& enemies, ObjectList& fireballs) {
+	static const char* checkpoint_path = "checkpoint.snap";
+	static bool save_was_down = false;
+	static bool load_was_down = false;
+
+	bool save_down = glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS;
+	bool load_down = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+	bool loaded = false;
+	if (save_down && !save_was_down && save_world(checkpoint_path, enemies, fireballs, true))
+		printf("checkpoint saved to %s\n", checkpoint_path);
+	if (load_down && !load_was_down && load_world(checkpoint_path, enemies, fireballs)) {
+		printf("checkpoint loaded from %s\n", checkpoint_path);
+		loaded = true;
+	}
+	save_was_down = save_down;
+	load_was_down = load_down;
+	return loaded;
+}
+
+
+// Occlusion culling : the occluder_count enemies closest to the camera are
+// rasterized into the culler, then everything is tested against them. 0 disables it.
+static int occluder_count = 32;
+static OcclusionCuller occlusion_culler;
+
+// The octahedron has its vertices at distance 1 from the center
+static const float enemy_radius = 1.0f;
+
+float get_bounding_radius(const std::vector<vec3>& vertices) {
+	float radius = 0;
+	for (size_t i = 0; i < vertices.size(); i++)
+		radius = std::max(radius, length(vertices[i]));
+	return radius;
+}
+
+// The enemies and fireballs worth drawing this frame
+void cull_objects(
+	const ObjectList& enemies, const ObjectList& fireballs, float fireball_radius,
+	const mat4& View, const mat4& Projection,
+	ObjectList& visible_enemies, ObjectList& visible_fireballs
+) {
+	static int polygon_count = get_oct_vertex_size() / 3 / 3 / sizeof(GLfloat);
+	occlusion_culler.begin_frame(Projection * View);
+
+	// Occluders : the nearest enemies in the frustum
+	static std::vector<std::pair<float, int> > candidates;
+	candidates.clear();
+	vec3 camera = getCameraPosition();
+	for (size_t i = 0; i < enemies.size(); i++) {
+		vec3 offset = enemies[i].coordinates - camera;
+		if (occlusion_culler.in_frustum(enemies[i].coordinates, enemy_radius))
+			candidates.push_back(std::make_pair(dot(offset, offset), (int)i));
+	}
+	size_t occluders = std::min(candidates.size(), (size_t)occluder_count);
+	std::nth_element(candidates.begin(), candidates.begin() + occluders, candidates.end());
+	for (size_t i = 0; i < occluders; i++)
+		occlusion_culler.add_occluder(get_oct_vertex(), polygon_count, enemies[candidates[i].second].get_model());
+	occlusion_culler.build_pyramid();
+
+	int occluded = 0;
+	visible_enemies.clear();
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const Object_3d& enemy = enemies[candidates[i].second];
+		if (occlusion_culler.classify(enemy.coordinates, enemy_radius) == CULL_VISIBLE)
+			visible_enemies.push_back(enemy);
+		else
+			occluded++;
+	}
+	int outside = enemies.size() - candidates.size();
+
+	visible_fireballs.clear();
+	for (size_t i = 0; i < fireballs.size(); i++) {
+		CullResult result = occlusion_culler.classify(fireballs[i].coordinates, fireball_radius);
+		if (result == CULL_VISIBLE)
+			visible_fireballs.push_back(fireballs[i]);
+		else if (result == CULL_OUTSIDE)
+			outside++;
+		else
+			occluded++;
+	}
+
+	occlusion_culler.count(enemies.size() + fireballs.size(), outside, occluded);
+}
+
+// Opaque objects are drawn front to back, so the depth test rejects hidden
+// fragments before they are shaded. false keeps the spawn order.
+static bool sort_draws = true;
+
+// Debug mode : fragments per pass, see OverdrawCounter
+static bool count_overdraw = false;
+static OverdrawCounter overdraw_counter;
+
+// Opaque objects culled and drawn by the GPU, see IndirectRenderer. Replaces
+// the occlusion culling and the sorting, falls back to them without GL 4.3.
+static bool gpu_driven = false;
+
+// Meshes of the GPU-driven path
+enum IndirectMeshId {
+	INDIRECT_ENEMY = 0,
+	INDIRECT_FIREBALL = 1,
+};
 
+// What the meshes look like in the vertex buffers, see VertexFormat. Compact
+// by default, --vertex-compression 0 keeps the floats.
+static VertexFormat vertex_format = get_compact_vertex_format();
+
+// Same planes as the projection matrices
+static const float view_near = 0.1f;
+static const float view_far = 100.0f;
+
+// Fireballs moved and collided by the GPU, see ProjectileSimulation. The
+// fireballs list only holds the new ones until they are handed over, so
+// checkpoints don't see the fireballs in flight. Needs GL 4.3, falls back to
+// the CPU without it.
+static bool gpu_projectiles = false;
+// Fireballs in flight at most, the shots past that are lost
+static const int gpu_fireball_capacity = 4096;
+
+// Every fireball is a point light, culled per cluster of the view frustum, see
+// ClusteredLights. The lights are built from the fireballs on the CPU : the
+// GPU-driven and GPU projectile paths draw unlit.
+static bool clustered_lighting = true;
+static const float fireball_light_radius = 6.0f;
+static const vec3 fireball_light_color = vec3(2.0f, 1.1f, 0.4f);
+// What the enemies get away from the fireballs
+static const vec3 ambient_light = vec3(0.35f);
+
+// Objects in view depth order, radix sorted on quantized keys
+void sort_by_depth(
+	const ObjectList& objects, const mat4& View, bool back_to_front, ObjectList& sorted
+) {
+	static std::vector<DepthKey> keys;
+	static std::vector<DepthKey> scratch;
+	keys.resize(objects.size());
+	for (size_t i = 0; i < objects.size(); i++) {
+		// The camera looks down -z
+		float view_depth = -(View * vec4(objects[i].coordinates, 1.0f)).z;
+		keys[i].key = quantize_depth(view_depth, view_near, view_far, back_to_front);
+		keys[i].index = i;
+	}
+	radix_sort(keys, scratch);
+
+	sorted.clear();
+	for (size_t i = 0; i < keys.size(); i++)
+		sorted.push_back(objects[keys[i].index]);
+}
+
+// What the opaque pass draws this frame and in which order : culled, then sorted
+void get_opaque_draws(
+	const ObjectList& enemies, const ObjectList& fireballs, float fireball_radius,
+	const mat4& View, const mat4& Projection,
+	ObjectList& draw_enemies, ObjectList& draw_fireballs
+) {
+	static ObjectList visible_enemies;
+	static ObjectList visible_fireballs;
+	const ObjectList* enemy_list = &enemies;
+	const ObjectList* fireball_list = &fireballs;
+	if (occluder_count > 0) {
+		cull_objects(enemies, fireballs, fireball_radius, View, Projection, visible_enemies, visible_fireballs);
+		enemy_list = &visible_enemies;
+		fireball_list = &visible_fireballs;
+	}
+
+	if (sort_draws) {
+		sort_by_depth(*enemy_list, View, false, draw_enemies);
+		sort_by_depth(*fireball_list, View, false, draw_fireballs);
+	} else {
+		draw_enemies = *enemy_list;
+		draw_fireballs = *fireball_list;
+	}
+}
+
+
+// Everything the GL path loads before the first frame
+struct SceneResources {
 	GLuint VertexArrayID;
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
 
+	GLuint programIDhardcoded;
+	GLuint MatrixIDhardcoded;
+	GLuint ModelViewIDhardcoded;
+	LightingUniforms Lightinghardcoded;
+
+	GLuint programIDinstanced;
+	GLuint VPIDinstanced;
+	GLuint ViewIDinstanced;
+	LightingUniforms Lightinginstanced;
+	GLuint TextureID;
+	GLuint AtlasRectsID;
+	TextureSet FireballTextures;
+
+	GLuint enemy_vertex_buffer;
+	GLuint enemy_color_buffer;
+	GLuint enemy_normal_buffer;
+	GLuint enemy_index_buffer;
+	MeshLayout enemy_layout;
+	int enemy_polygon_count;
+	GLuint fireball_vertex_buffer;
+	GLuint fireball_uv_buffer;
+	GLuint fireball_normal_buffer;
+	GLuint fireball_index_buffer;
+	MeshLayout fireball_layout;
+	GLuint fireball_instance_buffer;
+	int fireball_polygon_count;
+	float fireball_radius;
+
+	IndirectRenderer Indirect;
+	bool use_indirect;
+
+	ProjectileSimulation Projectiles;
+	bool use_projectiles;
+
+	ParticleSystem FireballTrails;
+
+	ClusteredLights Lights;
+	bool use_lighting;
+};
+
+// Particles shared by the trails of all fireballs
+static const int fireball_trail_particles = 65536;
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programIDhardcoded = LoadShaders("TransformVertexShader_forHardcoded.vertexshader",
-		"ColorFragmentShader_forHardcoded.fragmentshader");
+// Fireball variants, one texture layer each. Same sized .DDS files stay
+// compressed in a texture array, anything else ends up in an atlas.
+static const char* fireball_texture_paths[] = {
+	"fireball.DDS",
+};
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixIDhardcoded = glGetUniformLocation(programIDhardcoded, "MVP");
+// Asset pack the program loads from when it's in the working directory
+static const char* asset_pack_path = "assets.pak";
+
+// Shaders of every path, the pack has them all
+static const char* packed_shader_paths[] = {
+	"TransformVertexShader_forHardcoded.vertexshader",
+	"ColorFragmentShader_forHardcoded.fragmentshader",
+	"TransformVertexShader_instanced.vertexshader",
+	"TextureFragmentShader_array.fragmentshader",
+	"TextureFragmentShader_atlas.fragmentshader",
+	"TransformVertexShader_indirect.vertexshader",
+	"TextureFragmentShader_indirect.fragmentshader",
+	"CullInstances.computeshader",
+	"ProjectileBin.computeshader",
+	"ProjectileStep.computeshader",
+	"ParticleUpdateVertexShader.vertexshader",
+	"ParticleVertexShader.vertexshader",
+	"ParticleFragmentShader.fragmentshader",
+	"ClusteredLighting.fragmentshader",
+};
+
+// Work of load_resources that needs no GL context, and what it leaves for
+// the GL tasks
+struct SceneStaging {
+	IndexedMesh enemy_mesh;
+	IndexedMesh fireball_mesh;
+	PackedMesh enemy_packed;
+	PackedMesh fireball_packed;
+	float fireball_radius;
+
+	LoadFuture enemy_ready;
+	LoadFuture fireball_ready;
+	LoadFuture textures_ready; // read in, not uploaded
+	LoadFuture shaders_ready; // read in, not compiled
+};
+
+// Starts the CPU side of the loading, which can go on while the window and
+// the context are created
+void start_loading(StartupLoader& loader, SceneStaging& staging) {
+	SceneStaging* s = &staging;
+
+	// Both meshes come as one vertex per triangle corner : indexed, then ordered
+	// for the vertex cache, overdraw and vertex fetches, then converted to the
+	// vertex format
+	staging.enemy_ready = loader.run("octahedron", {}, [s]() {
+		// Flat shaded : every corner takes the normal of its face
+		const vec3* corners = (const vec3*)get_oct_vertex();
+		int corner_count = get_oct_vertex_size() / sizeof(vec3);
+		std::vector<vec3> normals(corner_count);
+		for (int i = 0; i + 2 < corner_count; i += 3) {
+			vec3 normal = normalize(cross(corners[i + 1] - corners[i], corners[i + 2] - corners[i]));
+			if (dot(normal, corners[i] + corners[i + 1] + corners[i + 2]) < 0)
+				normal = -normal;
+			normals[i] = normals[i + 1] = normals[i + 2] = normal;
+		}
+		index_mesh(corners, NULL, &normals[0], (const vec4*)get_oct_color(), corner_count, s->enemy_mesh);
+		optimize_mesh(s->enemy_mesh, "octahedron");
+		pack_mesh(s->enemy_mesh, vertex_format, s->enemy_packed, "octahedron");
+		return true;
+	});
+
+	staging.fireball_ready = loader.run("fireball.obj", {}, [s]() {
+		std::vector<glm::vec3> fireball_vertices;
+		std::vector<glm::vec2> fireball_uvs;
+		std::vector<glm::vec3> fireball_normals;
+		if (!load_mesh_asset("fireball.obj", fireball_vertices, fireball_uvs, fireball_normals))
+			return false;
+		if (fireball_normals.size() != fireball_vertices.size()) {
+			printf("fireball.obj has no normals\n");
+			return false;
+		}
+		index_mesh(&fireball_vertices[0], &fireball_uvs[0], &fireball_normals[0], NULL, fireball_vertices.size(), s->fireball_mesh);
+		optimize_mesh(s->fireball_mesh, "fireball.obj");
+		pack_mesh(s->fireball_mesh, vertex_format, s->fireball_packed, "fireball.obj");
+		s->fireball_radius = get_bounding_radius(fireball_vertices);
+		return true;
+	});
+
+	// The texture and shader loaders run on the GL thread, they'll find the
+	// files in memory. A missing one is theirs to report.
+	staging.textures_ready = loader.run("fireball textures", {}, []() {
+		for (size_t i = 0; i < sizeof(fireball_texture_paths) / sizeof(fireball_texture_paths[0]); i++)
+			prefetch_asset(fireball_texture_paths[i]);
+		return true;
+	});
+
+	staging.shaders_ready = loader.run("shader sources", {}, []() {
+		for (size_t i = 0; i < sizeof(packed_shader_paths) / sizeof(packed_shader_paths[0]); i++)
+			prefetch_asset(packed_shader_paths[i]);
+		return true;
+	});
+}
+
+// Queues the GL side of the loading and runs everything to the end. Main
+// thread, with the context current.
+bool finish_loading(StartupLoader& loader, SceneStaging& staging, SceneResources& res) {
+	SceneStaging* s = &staging;
+	SceneResources* r = &res;
+
+	LoadFuture vertex_array = loader.run_gl("vertex array", {}, [r]() {
+		glGenVertexArrays(1, &r->VertexArrayID);
+		glBindVertexArray(r->VertexArrayID);
+		return true;
+	});
 
 	// Create and compile our GLSL program from the shaders
-	GLuint programIDobj = LoadShaders("TransformVertexShader_obj.vertexshader",
-		"TextureFragmentShader_obj.fragmentshader");
+	LoadFuture hardcoded_program = loader.run_gl("hardcoded program", { staging.shaders_ready }, [r]() {
+		r->programIDhardcoded = load_program("TransformVertexShader_forHardcoded.vertexshader",
+			"ColorFragmentShader_forHardcoded.fragmentshader", "ClusteredLighting.fragmentshader");
+
+		// Get a handle for our "MVP" and "ModelView" uniforms
+		r->MatrixIDhardcoded = glGetUniformLocation(r->programIDhardcoded, "MVP");
+		r->ModelViewIDhardcoded = glGetUniformLocation(r->programIDhardcoded, "ModelView");
+		r->Lightinghardcoded = get_lighting_uniforms(r->programIDhardcoded);
+		return r->programIDhardcoded != 0;
+	});
+
+	// Load the textures
+	LoadFuture textures = loader.run_gl("texture set", { staging.textures_ready }, [r]() {
+		std::vector<const char*> paths(fireball_texture_paths,
+			fireball_texture_paths + sizeof(fireball_texture_paths) / sizeof(fireball_texture_paths[0]));
+		return load_texture_set(paths, r->FireballTextures);
+	});
+
+	// The fragment shader depends on the kind of texture set
+	LoadFuture instanced_program = loader.run_gl("instanced program", { staging.shaders_ready, textures }, [r]() {
+		r->programIDinstanced = load_program("TransformVertexShader_instanced.vertexshader",
+			r->FireballTextures.target == GL_TEXTURE_2D_ARRAY ?
+				"TextureFragmentShader_array.fragmentshader" : "TextureFragmentShader_atlas.fragmentshader",
+			"ClusteredLighting.fragmentshader");
+
+		// Get a handle for our "VP" and "View" uniforms
+		r->VPIDinstanced = glGetUniformLocation(r->programIDinstanced, "VP");
+		r->ViewIDinstanced = glGetUniformLocation(r->programIDinstanced, "View");
+		r->Lightinginstanced = get_lighting_uniforms(r->programIDinstanced);
+
+		// Get a handle for our "myTextureSampler" and "AtlasRects" uniforms
+		r->TextureID = glGetUniformLocation(r->programIDinstanced, "myTextureSampler");
+		r->AtlasRectsID = glGetUniformLocation(r->programIDinstanced, "AtlasRects");
+		return r->programIDinstanced != 0;
+	});
+
+	// The index buffers too go through GL_ARRAY_BUFFER, buffer objects have no
+	// type. Each program draws a single mesh, its dequantization never changes.
+	loader.run_gl("enemy buffers", { vertex_array, staging.enemy_ready, hardcoded_program }, [r, s]() {
+		r->enemy_vertex_buffer = load_buffer(s->enemy_packed.positions.size(), &s->enemy_packed.positions[0], "enemy positions");
+		r->enemy_color_buffer = load_buffer(s->enemy_packed.colors.size(), &s->enemy_packed.colors[0], "enemy colors");
+		r->enemy_normal_buffer = load_buffer(s->enemy_packed.normals.size(), &s->enemy_packed.normals[0], "enemy normals");
+		r->enemy_index_buffer = load_buffer(s->enemy_mesh.indices.size() * sizeof(unsigned int), &s->enemy_mesh.indices[0], "enemy indices");
+		r->enemy_layout = s->enemy_packed.layout;
+		r->enemy_polygon_count = s->enemy_mesh.indices.size() / 3;
+
+		glUseProgram(r->programIDhardcoded);
+		glUniform3fv(glGetUniformLocation(r->programIDhardcoded, "PositionOffset"), 1, &r->enemy_layout.position_offset[0]);
+		glUniform3fv(glGetUniformLocation(r->programIDhardcoded, "PositionScale"), 1, &r->enemy_layout.position_scale[0]);
+		glUniform1i(glGetUniformLocation(r->programIDhardcoded, "NormalsPacked"), vertex_format.pack_normals);
+		glUseProgram(0);
+		return true;
+	});
+
+	loader.run_gl("fireball buffers", { vertex_array, staging.fireball_ready, instanced_program }, [r, s]() {
+		r->fireball_vertex_buffer = load_buffer(s->fireball_packed.positions.size(), &s->fireball_packed.positions[0], "fireball positions");
+		r->fireball_uv_buffer = load_buffer(s->fireball_packed.uvs.size(), &s->fireball_packed.uvs[0], "fireball uvs");
+		r->fireball_normal_buffer = load_buffer(s->fireball_packed.normals.size(), &s->fireball_packed.normals[0], "fireball normals");
+		r->fireball_index_buffer = load_buffer(s->fireball_mesh.indices.size() * sizeof(unsigned int), &s->fireball_mesh.indices[0], "fireball indices");
+		r->fireball_layout = s->fireball_packed.layout;
+		r->fireball_polygon_count = s->fireball_mesh.indices.size() / 3;
+		r->fireball_radius = s->fireball_radius;
+
+		glUseProgram(r->programIDinstanced);
+		glUniform3fv(glGetUniformLocation(r->programIDinstanced, "PositionOffset"), 1, &r->fireball_layout.position_offset[0]);
+		glUniform3fv(glGetUniformLocation(r->programIDinstanced, "PositionScale"), 1, &r->fireball_layout.position_scale[0]);
+		glUniform1i(glGetUniformLocation(r->programIDinstanced, "NormalsPacked"), vertex_format.pack_normals);
+		glUseProgram(0);
+
+		// Filled every frame by draw_all_fireballs
+		glGenBuffers(1, &r->fireball_instance_buffer);
+		return true;
+	});
+
+	// Same meshes again for the GPU-driven path, when asked for and possible
+	res.use_indirect = false;
+	LoadFuture indirect = loader.run_gl("GPU-driven path", { vertex_array, staging.enemy_ready, staging.fireball_ready, staging.shaders_ready, textures }, [r, s]() {
+		if (!gpu_driven)
+			return true;
+		if (!IndirectRenderer::is_supported() || r->FireballTextures.target != GL_TEXTURE_2D_ARRAY) {
+			printf("GPU-driven drawing needs GL 4.3 and a texture array, using the CPU path\n");
+			return true;
+		}
+		std::vector<IndirectMesh> meshes(2);
+		IndirectMesh& enemy = meshes[INDIRECT_ENEMY];
+		enemy.positions = s->enemy_mesh.positions;
+		enemy.colors = s->enemy_mesh.colors;
+		enemy.indices = s->enemy_mesh.indices;
+		IndirectMesh& fireball = meshes[INDIRECT_FIREBALL];
+		fireball.positions = s->fireball_mesh.positions;
+		fireball.uvs = s->fireball_mesh.uvs;
+		fireball.indices = s->fireball_mesh.indices;
+
+		r->use_indirect = r->Indirect.init(meshes, vertex_format);
+		if (!r->use_indirect)
+			printf("GPU-driven drawing failed to initialize, using the CPU path\n");
+		return true;
+	});
+
+	// Fireballs flying past the far plane are gone for good
+	res.use_projectiles = false;
+	LoadFuture projectiles = loader.run_gl("GPU projectiles", { vertex_array, staging.shaders_ready }, [r]() {
+		if (!gpu_projectiles)
+			return true;
+		if (!ProjectileSimulation::is_supported()) {
+			printf("GPU projectiles need GL 4.3, using the CPU path\n");
+			return true;
+		}
+		r->use_projectiles = r->Projectiles.init(gpu_fireball_capacity, view_far / Object_3d::speed, hit_distance);
+		if (!r->use_projectiles) {
+			r->Projectiles.cleanup();
+			printf("GPU projectiles failed to initialize, using the CPU path\n");
+		}
+		return true;
+	});
+
+	loader.run_gl("fireball trails", { vertex_array, staging.shaders_ready }, [r]() {
+		return r->FireballTrails.init(fireball_trail_particles);
+	});
+
+	// 16x12 tiles, 64 pixels square at 1024x768, and 24 depth slices
+	res.use_lighting = false;
+	loader.run_gl("clustered lights", { hardcoded_program, instanced_program, indirect, projectiles }, [r]() {
+		if (clustered_lighting && (r->use_indirect || r->use_projectiles))
+			printf("The fireball lights need the fireballs on the CPU, drawing unlit\n");
+		else if (clustered_lighting)
+			r->use_lighting = r->Lights.init(16, 12, 24, view_near, view_far);
+		if (!r->use_lighting) {
+			glUseProgram(r->programIDhardcoded);
+			set_unlit(r->Lightinghardcoded);
+			glUseProgram(r->programIDinstanced);
+			set_unlit(r->Lightinginstanced);
+			glUseProgram(0);
+		}
+		return true;
+	});
+
+	return loader.finish();
+}
+
+// Everything at once, for callers that have their context already
+bool load_resources(SceneResources& res) {
+	StartupLoader loader;
+	SceneStaging staging;
+	start_loading(loader, staging);
+	return finish_loading(loader, staging, res);
+}
+
+// Opaque pass of the GPU-driven path : every object goes to the GPU, which
+// culls them and draws what's left with a single multi-draw
+void draw_indirect(
+	SceneResources& res, const ObjectList& enemies, const ObjectList& fireballs,
+	const mat4& View, const mat4& Projection
+) {
+	static std::vector<IndirectEntity> entities;
+	entities.resize(enemies.size() + fireballs.size());
+	for (size_t i = 0; i < enemies.size(); i++) {
+		IndirectEntity& entity = entities[i];
+		entity.model = enemies[i].get_model();
+		entity.sphere = vec4(enemies[i].coordinates, enemy_radius);
+		entity.layer = 0;
+		entity.mesh = INDIRECT_ENEMY;
+	}
+	for (size_t i = 0; i < fireballs.size(); i++) {
+		IndirectEntity& entity = entities[enemies.size() + i];
+		entity.model = fireballs[i].get_model();
+		entity.sphere = vec4(fireballs[i].coordinates, res.fireball_radius);
+		entity.layer = (float)(fireballs[i].texture_layer % res.FireballTextures.layer_count);
+		entity.mesh = INDIRECT_FIREBALL;
+	}
+	res.Indirect.draw(entities, View, Projection, res.FireballTextures.texture);
+}
+
+// What the renderer needs of one simulation step. The lists are copies : the
+// simulation goes on with its own while the packet is drawn, on another
+// thread in the windowed mode.
+struct FramePacket {
+	mat4 View;
+	mat4 Projection;
+	double time;      // glfwGetTime() of the step, right after it read the input
+	float delta_time; // since the step before
+
+	ObjectList enemies;   // all of them, for the GPU-driven path only
+	ObjectList fireballs; // all of them : lights, trails and the GPU-driven path
+	ObjectList opaque_enemies;     // culled and sorted, for the CPU path
+	InstanceList opaque_fireballs; // same, ready for the instance buffer
+};
+
+// The CPU side of a frame : culling, sorting and instance data. No GL, the
+// resources are only read.
+void build_frame_packet(
+	const SceneResources& res, const ObjectList& enemies, const ObjectList& fireballs,
+	const mat4& View, const mat4& Projection, FramePacket& packet
+) {
+	packet.View = View;
+	packet.Projection = Projection;
+	packet.fireballs = fireballs;
+	if (res.use_indirect) {
+		packet.enemies = enemies;
+		packet.opaque_enemies.clear();
+		packet.opaque_fireballs.clear();
+	} else {
+		static ObjectList opaque_fireballs;
+		packet.enemies.clear();
+		get_opaque_draws(enemies, fireballs, res.fireball_radius, View, Projection, packet.opaque_enemies, opaque_fireballs);
+		get_fireball_instances(opaque_fireballs, res.FireballTextures.layer_count, packet.opaque_fireballs);
+	}
+}
+
+// The GL side of a frame
+void draw_frame_packet(SceneResources& res, const FramePacket& packet) {
+	const mat4& View = packet.View;
+	const mat4& Projection = packet.Projection;
+
+	// Opaque pass : blending off, depth written
+	glDisable(GL_BLEND);
+	if (count_overdraw)
+		overdraw_counter.begin_pass(PASS_OPAQUE);
+
+	if (res.use_indirect) {
+		draw_indirect(res, packet.enemies, packet.fireballs, View, Projection);
+	} else {
+		// The particle system and the GPU-driven path use their own vertex arrays
+		glBindVertexArray(res.VertexArrayID);
+
+		// All the fireballs light, the culled ones too
+		if (res.use_lighting) {
+			static std::vector<PointLight> lights;
+			const ObjectList& fireballs = packet.fireballs;
+			lights.resize(fireballs.size());
+			for (size_t i = 0; i < fireballs.size(); i++) {
+				lights[i].position = fireballs[i].coordinates;
+				lights[i].radius = fireball_light_radius;
+				lights[i].color = fireball_light_color;
+			}
+			res.Lights.update(lights, View, Projection);
+		}
+
+		glUseProgram(res.programIDhardcoded);
+		if (res.use_lighting)
+			res.Lights.bind(res.Lightinghardcoded, ambient_light);
+		draw_all_enemies(
+			res.enemy_vertex_buffer, res.enemy_color_buffer, res.enemy_normal_buffer, res.enemy_index_buffer, res.enemy_layout,
+			res.MatrixIDhardcoded, res.ModelViewIDhardcoded, res.enemy_polygon_count, packet.opaque_enemies, View, Projection
+		);
+
+		glUseProgram(res.programIDinstanced);
+		if (res.use_lighting)
+			res.Lights.bind(res.Lightinginstanced, ambient_light);
+		draw_all_fireballs(
+			res.fireball_vertex_buffer, res.fireball_uv_buffer, res.fireball_normal_buffer, res.fireball_index_buffer, res.fireball_layout,
+			res.fireball_instance_buffer, res.VPIDinstanced, res.ViewIDinstanced,
+			packet.opaque_fireballs, View, Projection, res.fireball_polygon_count,
+			res.FireballTextures, res.TextureID, res.AtlasRectsID
+		);
+	}
+
+	// Straight from the simulation buffer, unculled : free slots have a zero matrix
+	// and collapse to a point
+	if (res.use_projectiles && res.Projectiles.get_fireball_count() > 0) {
+		glBindVertexArray(res.VertexArrayID);
+		glUseProgram(res.programIDinstanced);
+		draw_fireball_instances(
+			res.fireball_vertex_buffer, res.fireball_uv_buffer, res.fireball_normal_buffer, res.fireball_index_buffer, res.fireball_layout,
+			res.Projectiles.get_fireball_buffer(),
+			sizeof(GpuFireball), offsetof(GpuFireball, velocity) + 3 * sizeof(float),
+			res.Projectiles.get_fireball_count(), res.VPIDinstanced, res.ViewIDinstanced, View, Projection, res.fireball_polygon_count,
+			res.FireballTextures, res.TextureID, res.AtlasRectsID
+		);
+	}
+
+	if (count_overdraw)
+		overdraw_counter.end_pass();
+
+	// Transparent pass, last : blended, depth tested but not written. The trails
+	// are additive, which needs no order; alpha blended draws would be sorted
+	// back to front with sort_by_depth first.
+	glEnable(GL_BLEND);
+	if (count_overdraw)
+		overdraw_counter.begin_pass(PASS_TRANSPARENT);
+
+	res.FireballTrails.draw(View, Projection);
+
+	if (count_overdraw) {
+		overdraw_counter.end_pass();
+		overdraw_counter.end_frame();
+	}
+	glDisable(GL_BLEND);
+}
+
+// Both sides of a frame at once, on the GL thread
+void draw_scene(
+	SceneResources& res, const ObjectList& enemies, const ObjectList& fireballs,
+	const mat4& View, const mat4& Projection
+) {
+	static FramePacket packet;
+	build_frame_packet(res, enemies, fireballs, View, Projection, packet);
+	draw_frame_packet(res, packet);
+}
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixIDobj = glGetUniformLocation(programIDobj, "MVP");
+// Every fireball emits trail particles along the way it went during this step
+void update_fireball_trails(ParticleSystem& trails, const ObjectList& fireballs, float deltaTime) {
+	static std::vector<vec3> positions;
+	static std::vector<vec3> previous_positions;
+	positions.clear();
+	previous_positions.clear();
+	for (size_t i = 0; i < fireballs.size(); i++) {
+		positions.push_back(fireballs[i].coordinates);
+		previous_positions.push_back(fireballs[i].coordinates - fireballs[i].direction * deltaTime * Object_3d::speed);
+	}
+	trails.update(positions, previous_positions, deltaTime);
+}
 
-	// Get a handle for our "myTextureSampler" uniform
-	GLuint TextureID = glGetUniformLocation(programIDobj, "myTextureSampler");
+// The trails follow the fireballs wherever they are simulated
+void update_scene_trails(SceneResources& res, const ObjectList& fireballs, float deltaTime) {
+	if (res.use_projectiles)
+		res.FireballTrails.update(res.Projectiles.get_emitter_buffer(), res.Projectiles.get_fireball_count(), deltaTime);
+	else
+		update_fireball_trails(res.FireballTrails, fireballs, deltaTime);
+}
 
+void free_resources(SceneResources& res) {
+	// Cleanup VBO and shader
+	delete_tracked_buffers(1, &res.enemy_vertex_buffer);
+	delete_tracked_buffers(1, &res.enemy_color_buffer);
+	delete_tracked_buffers(1, &res.enemy_normal_buffer);
+	delete_tracked_buffers(1, &res.enemy_index_buffer);
+	glDeleteProgram(res.programIDhardcoded);
+	glDeleteVertexArrays(1, &res.VertexArrayID);
 
-	// Load the texture
-	GLuint FireballTexture = loadDDS("fireball.DDS");
+	// Cleanup VBO and shader
+	delete_tracked_buffers(1, &res.fireball_vertex_buffer);
+	delete_tracked_buffers(1, &res.fireball_uv_buffer);
+	delete_tracked_buffers(1, &res.fireball_normal_buffer);
+	delete_tracked_buffers(1, &res.fireball_index_buffer);
+	delete_tracked_buffers(1, &res.fireball_instance_buffer);
+	glDeleteProgram(res.programIDinstanced);
+	free_texture_set(res.FireballTextures);
+
+	if (res.use_indirect)
+		res.Indirect.cleanup();
+	if (res.use_projectiles)
+		res.Projectiles.cleanup();
+
+	res.FireballTrails.cleanup();
+	if (res.use_lighting)
+		res.Lights.cleanup();
+}
+
+
+// Windowed mode : the simulation steps on the main thread, which has the
+// window events, and hands every step over to the renderer as a FramePacket.
+// With a render thread, that one owns the GL context and draws the latest
+// packet at its own rate, set by the frame pacing; the simulation steps
+// tick_rate times a second whatever the renderer does. GPU projectiles are
+// simulated with GL : they keep both on the main thread, one frame per step.
+static bool render_thread = true;
+static double tick_rate = 120;
+
+// One step of the windowed mode, from the input to the packet
+void simulate_step(
+	SceneResources& res, ObjectList& enemies, ObjectList& fireballs, double& lastTime,
+	const mat4& Projection, FramePacket& packet
+) {
+	// Read the input as late as possible, right before the step uses it
+	glfwPollEvents();
+
+	double currentTime = glfwGetTime();
+	float deltaTime = float(currentTime - lastTime);
+	if (!res.use_projectiles)
+		move_all(fireballs, deltaTime);
+	lastTime = currentTime;
+
+	process_input_events(fireballs, currentTime);
+	if (handle_checkpoint_keys(enemies, fireballs) && res.use_projectiles)
+		restart_gpu_projectiles(res.Projectiles, enemies);
+
+	//  MVP-        
+	computeMatricesFromInputs();
+	mat4 View = getViewMatrix();
+
+	create_enemy_by_timer(enemies);
+	update_enemy_swarm(enemies, getCameraPosition(), deltaTime);
+	if (res.use_projectiles)
+		step_gpu_projectiles(res.Projectiles, enemies, fireballs, res.FireballTextures.layer_count, deltaTime);
+	else
+		delete_collided(enemies, fireballs);
+
+	build_frame_packet(res, enemies, fireballs, View, Projection, packet);
+	packet.time = currentTime;
+	packet.delta_time = deltaTime;
+}
+
+// The GL side of the windowed mode, on the thread that has the context
+struct WindowRenderer {
+	SceneResources* res;
+	FramePacer pacer;
+	DynamicResolution resolution;
+	bool dynamic_resolution;
+	double memory_report_period; // 0 : only at exit
+	double memory_report_time;
+	double trails_time; // of the last packet the trails moved with, 0 before the first
+	int frame_count;
+	int packet_count;   // packets drawn, once or more each
+};
+
+// Draws a packet and presents it. Only a fresh one moves the trails, a
+// packet drawn again leaves them where they were.
+void render_frame(WindowRenderer& renderer, const FramePacket& packet, bool fresh) {
+	SceneResources& res = *renderer.res;
+	if (renderer.dynamic_resolution) {
+		int window_width, window_height;
+		get_window_size(window_width, window_height);
+		renderer.resolution.begin_frame(window_width, window_height);
+	}
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// Clear the screen
+
+	if (fresh) {
+		// The whole way since the last packet drawn, skipped ones included
+		float deltaTime = renderer.trails_time > 0 ? float(packet.time - renderer.trails_time) : packet.delta_time;
+		update_scene_trails(res, packet.fireballs, deltaTime);
+		renderer.trails_time = packet.time;
+		renderer.packet_count++;
+	}
+	draw_frame_packet(res, packet);
+	if (renderer.dynamic_resolution)
+		renderer.resolution.end_frame();
+	renderer.pacer.input_sampled(packet.time);
+	renderer.pacer.submitted();
+
+	// Swap buffers
+	glfwSwapBuffers(window);
+	renderer.frame_count++;
+
+	// The GL objects are tracked on this thread, the reports go with them
+	double now = glfwGetTime();
+	if (renderer.memory_report_period > 0 && now >= renderer.memory_report_time) {
+		print_memory_summary();
+		renderer.memory_report_time = now + renderer.memory_report_period;
+	}
+	if (memory_dump_requested())
+		print_memory_dump();
+}
+
+
+// Deterministic content for the headless modes : the same frame index always
+// gives the same picture, so captures can be compared between runs and backends.
+// projectiles : the GPU simulation to collide the fireballs with, NULL for the CPU.
+void step_scripted_scene(
+	int frame, float deltaTime, ObjectList& enemies, ObjectList& fireballs,
+	ProjectileSimulation* projectiles = NULL, int layer_count = 1
+) {
+	static RandomGenerator random;
+	if (frame == 0) {
+		random.seed(2022);
+		enemies.clear();
+		fireballs.clear();
+		if (projectiles)
+			projectiles->reset();
+	}
+
+	// The camera slowly turns around and nods
+	setCameraAngles(frame * 0.01f, 0.2f * sin(frame * 0.02f));
+
+	// A wave of enemies at the start, then one more every 10 frames
+	int spawn_count = frame == 0 ? 200 : (frame % 10 == 0 ? 1 : 0);
+	spawn_enemy_wave(enemies, getCameraPosition(), spawn_count, random);
+
+	// Fire where the camera looks every 15 frames
+	if (frame % 15 == 0)
+		fireballs.push_back(make_fireball(getCameraPosition(), getCameraDirection(), frame / 15));
+
+	if (projectiles) {
+		update_enemy_swarm(enemies, getCameraPosition(), deltaTime);
+		step_gpu_projectiles(*projectiles, enemies, fireballs, layer_count, deltaTime);
+	} else {
+		move_all(fireballs, deltaTime);
+		update_enemy_swarm(enemies, getCameraPosition(), deltaTime);
+		delete_collided(enemies, fireballs);
+	}
+}
+
+
+// Headless rendering of the scripted scene through SoftRenderer :
+// no window and no GL context, the last frame is written to a .bmp
+int run_software(int frame_count, const char* output_path) {
+	SoftRenderer renderer(1024, 768);
+
+	mat4 Projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+
+	SoftTexture FireballTexture;
+	if (!soft_load_dds("fireball.DDS", FireballTexture))
+		return 1;
 
-	// Read our .obj file
 	std::vector<glm::vec3> fireball_vertices;
 	std::vector<glm::vec2> fireball_uvs;
-	std::vector<glm::vec3> fireball_normals; // Won't be used at the moment.
-	bool load_res = loadOBJ("fireball.obj", fireball_vertices, fireball_uvs, fireball_normals);
+	std::vector<glm::vec3> fireball_normals;
+	bool load_res = load_mesh_asset("fireball.obj", fireball_vertices, fireball_uvs, fireball_normals);
 	if (!load_res)
 		return 1;
 
-	GLuint enemy_vertex_buffer = load_buffer(get_oct_vertex_size(), get_oct_vertex());
-	GLuint enemy_color_buffer = load_buffer(get_oct_color_size(), get_oct_color());
+	ObjectList enemies;
+	ObjectList fireballs;
+
+	int enemy_polygon_count = get_oct_vertex_size() / 3 / 3 / sizeof(GLfloat);
+	int fireball_polygon_count = fireball_vertices.size() / 3;
+	float fireball_radius = get_bounding_radius(fireball_vertices);
+	ObjectList draw_enemies;
+	ObjectList draw_fireballs;
+	double total_ms = 0;
+	double fragments_per_pixel = 0;
+
+	for (int frame = 0; frame < frame_count; frame++) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		step_scripted_scene(frame, 1.0f / 60.0f, enemies, fireballs);
+		mat4 View = getViewMatrix();
+
+		get_opaque_draws(enemies, fireballs, fireball_radius, View, Projection, draw_enemies, draw_fireballs);
+
+		renderer.clear(vec4(0.7f, 0.7f, 0.7f, 0.0f));
+		for (size_t i = 0; i < draw_enemies.size(); i++) {
+			renderer.draw_arrays(
+				get_oct_vertex(), get_oct_color(), 4, enemy_polygon_count,
+				Projection * View * draw_enemies[i].get_model(), NULL
+			);
+		}
+		for (size_t i = 0; i < draw_fireballs.size(); i++) {
+			renderer.draw_arrays(
+				&fireball_vertices[0].x, &fireball_uvs[0].x, 2, fireball_polygon_count,
+				Projection * View * draw_fireballs[i].get_model(), &FireballTexture
+			);
+		}
+		renderer.finish();
+		fragments_per_pixel += (double)renderer.get_fragment_count() / (renderer.get_width() * renderer.get_height());
+
+		auto end = std::chrono::high_resolution_clock::now();
+		total_ms += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	printf("software renderer : %d frames, %.3f ms per frame, %d triangles in the last frame\n",
+		frame_count, total_ms / frame_count, renderer.get_triangle_count());
+	printf("  %.3f fragments shaded per pixel\n", fragments_per_pixel / frame_count);
+	if (occluder_count > 0)
+		occlusion_culler.print_report();
+
+	if (!renderer.write_bmp(output_path))
+		return 1;
+	return 0;
+}
+
+// Headless GL rendering of the scripted scene into an offscreen framebuffer.
+// Writes <prefix>frame_NNNNN.bmp every capture_every frames and <prefix>timings.csv.
+int run_offscreen(int frame_count, const char* output_prefix, int capture_every) {
+	StartupLoader loader;
+	SceneStaging staging;
+	start_loading(loader, staging);
+
+	int init_res;
+	loader.run_here("offscreen context", [&init_res]() {
+		init_res = init_offscreen();
+		return init_res == 0;
+	});
+	if (init_res != 0)
+		return init_res;
+
+	mat4 Projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+
+	SceneResources res;
+	bool loaded = finish_loading(loader, staging, res);
+	loader.print_timeline();
+	if (!loaded) {
+		terminate_offscreen();
+		return 1;
+	}
+
+	FrameCapture capture;
+	if (!capture.init(1024, 768, 4, output_prefix)) {
+		capture.cleanup();
+		free_resources(res);
+		terminate_offscreen();
+		return 1;
+	}
+
+	ObjectList enemies;
+	ObjectList fireballs;
+	double total_ms = 0;
+
+	for (int frame = 0; frame < frame_count; frame++) {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		step_scripted_scene(frame, 1.0f / 60.0f, enemies, fireballs,
+			res.use_projectiles ? &res.Projectiles : NULL, res.FireballTextures.layer_count);
+		mat4 View = getViewMatrix();
+
+		capture.begin_frame();
+		update_scene_trails(res, fireballs, 1.0f / 60.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		draw_scene(res, enemies, fireballs, View, Projection);
+
+		auto end = std::chrono::high_resolution_clock::now();
+		double cpu_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		total_ms += cpu_ms;
+
+		capture.end_frame(frame, cpu_ms, frame % capture_every == 0);
+		if (memory_dump_requested())
+			print_memory_dump();
+	}
+	capture.finish();
+
+	printf("offscreen renderer : %d frames, %.3f ms of CPU time per frame\n", frame_count, total_ms / frame_count);
+	if (res.use_projectiles)
+		res.Projectiles.print_report();
+	if (res.use_lighting)
+		res.Lights.print_report();
+	print_memory_summary();
+
+	capture.cleanup();
+	free_resources(res);
+	print_gpu_leaks();
+	terminate_offscreen();
+	return 0;
+}
+
+
+// agent_count enemies at about one per unit^3 in a ball around the origin
+void spawn_swarm_world(ObjectList& enemies, int agent_count) {
+	RandomGenerator random(2022);
+	float radius = cbrt(3.0f * agent_count / (4.0f * std::_Pi));
+	spawn_enemy_wave(enemies, vec3(0, 0, 0), agent_count, random, 0, radius);
+}
+
+// Saves a swarm world for the benchmarks to start from
+int run_make_snapshot(const char* path, int agent_count, bool compress) {
+	ObjectList enemies;
+	ObjectList fireballs;
+	spawn_swarm_world(enemies, agent_count);
+	setCameraState(vec3(0, 0, 0), 0, 0);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool ok = save_world(path, enemies, fireballs, compress);
+	auto end = std::chrono::high_resolution_clock::now();
+	if (ok)
+		printf("snapshot : %d enemies saved to %s in %.3f ms\n",
+			agent_count, path, std::chrono::duration<double, std::milli>(end - start).count());
+	return ok ? 0 : 1;
+}
+
+static bool add_raw_asset(const char* path, std::vector<AssetSource>& assets) {
+	MappedFile file;
+	if (!file.open(path))
+		return false;
+	assets.push_back(AssetSource());
+	assets.back().name = path;
+	assets.back().kind = ASSET_RAW;
+	assets.back().data.assign(file.data(), file.data() + file.size());
+	return true;
+}
+
+// Everything load_resources reads, from the loose files : the shaders, the
+// fireball textures as they are and fireball.obj converted
+int run_make_pack(const char* path) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<AssetSource> assets;
+	for (size_t i = 0; i < sizeof(packed_shader_paths) / sizeof(packed_shader_paths[0]); i++) {
+		if (!add_raw_asset(packed_shader_paths[i], assets))
+			return 1;
+	}
+	for (size_t i = 0; i < sizeof(fireball_texture_paths) / sizeof(fireball_texture_paths[0]); i++) {
+		if (!add_raw_asset(fireball_texture_paths[i], assets))
+			return 1;
+	}
+	assets.push_back(AssetSource());
+	assets.back().name = "fireball.obj";
+	assets.back().kind = ASSET_MESH;
+	if (!convert_obj("fireball.obj", assets.back().data))
+		return 1;
+
+	if (!save_asset_pack(path, assets))
+		return 1;
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("asset pack : %d assets saved to %s in %.3f ms\n",
+		(int)assets.size(), path, std::chrono::duration<double, std::milli>(end - start).count());
+	return 0;
+}
+
+// Headless timing of update_enemy_swarm, stepped at 60 Hz while the enemies
+// swarm in : a fresh world of agent_count enemies, or the one of a snapshot
+int run_boids_benchmark(int agent_count, int frame_count, const char* snapshot_path) {
+	ObjectList enemies;
+	ObjectList fireballs;
+	auto spawn_start = std::chrono::high_resolution_clock::now();
+	if (snapshot_path) {
+		if (!load_world(snapshot_path, enemies, fireballs))
+			return 1;
+	} else {
+		spawn_swarm_world(enemies, agent_count);
+	}
+	auto spawn_end = std::chrono::high_resolution_clock::now();
+	agent_count = enemies.size();
+	printf("boids : %d agents %s in %.3f ms\n", agent_count, snapshot_path ? "loaded" : "spawned",
+		std::chrono::duration<double, std::milli>(spawn_end - spawn_start).count());
+
+	const float deltaTime = 1.0f / 60.0f;
+	double total_ms = 0;
+	double worst_ms = 0;
+	for (int frame = 0; frame < frame_count; frame++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		update_enemy_swarm(enemies, vec3(0, 0, 0), deltaTime);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		total_ms += ms;
+		if (ms > worst_ms)
+			worst_ms = ms;
+	}
+
+	double average_ms = total_ms / frame_count;
+	printf("boids : %d agents, %d threads, %d steps, %.3f ms per step (worst %.3f ms), %s the 16.7 ms budget\n",
+		agent_count, get_thread_pool().size(), frame_count, average_ms, worst_ms,
+		average_ms <= 1000.0 / 60.0 ? "within" : "over");
+	return 0;
+}
+
 
-	GLuint fireball_vertex_buffer = load_buffer(fireball_vertices.size() * sizeof(glm::vec3), &fireball_vertices[0]);
-	GLuint fireball_uv_buffer = load_buffer(fireball_uvs.size() * sizeof(glm::vec2), &fireball_uvs[0]);
+// Networked game : the simulation runs on a server, the clients only send their
+// camera and clicks and draw what the snapshots say
 
+// Fixed simulation step of the server
+static const int server_tick_rate = 30;
+// A client not heard from for that long is gone
+static const double client_timeout = 5.0;
+// Clients draw that far in the past, so there are snapshots on both sides of
+// the render time even when one gets lost
+static const double interpolation_delay = 0.1;
 
-	std::vector<Object_3d> enemies;
-	std::vector<Object_3d> fireballs;
+// The server has no window and no GLFW
+static double server_clock() {
+	static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct RemoteClient {
+	NetAddress address;
+	SnapshotEncoder encoder;
+	vec3 camera_position;
+	unsigned int last_click;
+	int shot_count;
+	double last_heard;
+	double clock_offset; // server clock - client clock, latency included
+};
+
+struct GameServer {
+	UdpSocket socket;
+	std::vector<RemoteClient> clients;
+
+	ObjectList enemies;
+	ObjectList fireballs;
+	unsigned int next_id;
+	double last_spawn_time;
+
+	std::vector<NetEntity> entities;
+	std::vector<std::vector<unsigned char> > packets;
+	size_t bytes_sent;
+
+	GameServer() : next_id(1), last_spawn_time(0), bytes_sent(0) {}
+};
+
+// Inputs of the clients : camera, acks, and fireballs for the clicks not handled yet
+void server_receive(GameServer& server, double now) {
+	unsigned char packet[net_max_packet];
+	NetAddress from;
+	NetInput input;
+	int size;
+	while ((size = server.socket.receive(from, packet, sizeof(packet))) >= 0) {
+		if (get_packet_type(packet, size) != PACKET_INPUT || !read_input_packet(packet, size, input))
+			continue;
+
+		RemoteClient* client = NULL;
+		for (size_t i = 0; i < server.clients.size() && !client; i++) {
+			if (server.clients[i].address == from)
+				client = &server.clients[i];
+		}
+		if (!client) {
+			server.clients.push_back(RemoteClient());
+			client = &server.clients.back();
+			client->address = from;
+			client->last_click = 0;
+			client->shot_count = 0;
+			client->clock_offset = now - input.time;
+			printf("client %u.%u.%u.%u:%u connected\n", from.ip >> 24, (from.ip >> 16) & 255, (from.ip >> 8) & 255, from.ip & 255, from.port);
+		}
+		client->last_heard = now;
+		client->camera_position = input.camera_position;
+		client->encoder.acknowledge(input.acknowledged);
+		// The smallest offset is the one with the least latency in it
+		if (now - input.time < client->clock_offset)
+			client->clock_offset = now - input.time;
+
+		for (size_t i = 0; i < input.clicks.size(); i++) {
+			const NetClick& click = input.clicks[i];
+			if (click.number <= client->last_click)
+				continue;
+			client->last_click = click.number;
+
+			Object_3d fireball = make_fireball(input.camera_position, normalize(click.direction), client->shot_count++);
+			// Flying since the click, as far as the server can tell
+			float age = float(now - (click.time + client->clock_offset));
+			fireball.move(age < 0 ? 0 : (age > 0.25f ? 0.25f : age));
+			server.fireballs.push_back(fireball);
+		}
+	}
+
+	for (size_t i = 0; i < server.clients.size();) {
+		if (now - server.clients[i].last_heard > client_timeout) {
+			printf("client timed out\n");
+			server.clients.erase(server.clients.begin() + i);
+		} else {
+			i++;
+		}
+	}
+}
+
+// One step of the game, what the windowed loop does without the input and drawing.
+// The swarm is a single flock with a single target : it spawns around and chases
+// the longest connected client, the others share its world without being hunted.
+void server_tick(GameServer& server, float deltaTime, double now) {
+	vec3 target = server.clients.empty() ? vec3(0, 0, 0) : server.clients[0].camera_position;
+
+	move_all(server.fireballs, deltaTime);
+	if (now - server.last_spawn_time > 3) {
+		spawn_enemy_wave(server.enemies, target, 1, spawn_random);
+		server.last_spawn_time = now;
+	}
+	update_enemy_swarm(server.enemies, target, deltaTime);
+	delete_collided(server.enemies, server.fireballs);
+
+	// Objects only get appended and erased, so ids handed out in order keep both lists sorted
+	for (size_t i = 0; i < server.enemies.size(); i++) {
+		if (server.enemies[i].id == 0)
+			server.enemies[i].id = server.next_id++;
+	}
+	for (size_t i = 0; i < server.fireballs.size(); i++) {
+		if (server.fireballs[i].id == 0)
+			server.fireballs[i].id = server.next_id++;
+	}
+}
+
+NetEntity make_net_entity(const Object_3d& object, int type) {
+	NetEntity e;
+	e.id = object.id;
+	e.type = type;
+	e.layer = object.texture_layer;
+	e.position = object.coordinates;
+	e.rotation = quat_cast(object.rotation);
+	return e;
+}
+
+bool net_entity_id_less(const NetEntity& a, const NetEntity& b) {
+	return a.id < b.id;
+}
+
+// A snapshot for every client, delta compressed against what it has acknowledged
+void server_send(GameServer& server, double now) {
+	std::vector<NetEntity> enemy_entities(server.enemies.size());
+	std::vector<NetEntity> fireball_entities(server.fireballs.size());
+	for (size_t i = 0; i < server.enemies.size(); i++)
+		enemy_entities[i] = make_net_entity(server.enemies[i], NET_ENEMY);
+	for (size_t i = 0; i < server.fireballs.size(); i++)
+		fireball_entities[i] = make_net_entity(server.fireballs[i], NET_FIREBALL);
+	server.entities.resize(enemy_entities.size() + fireball_entities.size());
+	std::merge(enemy_entities.begin(), enemy_entities.end(), fireball_entities.begin(), fireball_entities.end(),
+		server.entities.begin(), net_entity_id_less);
+
+	for (size_t i = 0; i < server.clients.size(); i++) {
+		RemoteClient& client = server.clients[i];
+		client.encoder.encode(server.entities, now, client.last_click, server.packets);
+		for (size_t k = 0; k < server.packets.size(); k++) {
+			server.socket.send(client.address, &server.packets[k][0], server.packets[k].size());
+			server.bytes_sent += server.packets[k].size();
+		}
+	}
+}
+
+// Ctrl+C ends the server loop, which then closes the socket
+static volatile sig_atomic_t server_stop_requested = 0;
+
+static void request_server_stop(int) {
+	server_stop_requested = 1;
+}
+
+// playground --server [port]
+int run_server(unsigned short port) {
+	GameServer server;
+	if (!server.socket.open(port))
+		return 1;
+	printf("server : listening on port %u, %d ticks per second\n", server.socket.get_port(), server_tick_rate);
+	signal(SIGINT, request_server_stop);
+
+	const double tick_duration = 1.0 / server_tick_rate;
+	double next_tick = server_clock();
+	double report_time = next_tick + 5;
+	double tick_ms = 0;
+	int tick_count = 0;
+	while (!server_stop_requested) {
+		double now = server_clock();
+		server_receive(server, now);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		server_tick(server, float(tick_duration), now);
+		server_send(server, now);
+		tick_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		tick_count++;
+
+		if (now >= report_time) {
+			printf("server : %d clients, %d enemies, %d fireballs, %.3f ms per tick, %.1f KB/s sent\n",
+				(int)server.clients.size(), (int)server.enemies.size(), (int)server.fireballs.size(),
+				tick_ms / tick_count, server.bytes_sent / 1024.0 / (now - report_time + 5));
+			report_time = now + 5;
+			tick_ms = 0;
+			tick_count = 0;
+			server.bytes_sent = 0;
+			print_memory_summary();
+		}
+		if (memory_dump_requested())
+			print_memory_dump();
+
+		// Late by more than a tick : carry on from now instead of catching up
+		next_tick += tick_duration;
+		if (server_clock() - next_tick > tick_duration)
+			next_tick = server_clock();
+		std::this_thread::sleep_for(std::chrono::duration<double>(next_tick - server_clock()));
+	}
+
+	signal(SIGINT, SIG_DFL);
+	server.socket.close();
+	printf("server : stopped, %d clients connected\n", (int)server.clients.size());
+	print_memory_summary();
+	return 0;
+}
+
+
+struct GameClient {
+	UdpSocket socket;
+	NetAddress server;
+	SnapshotDecoder decoder;
+	SnapshotInterpolator interpolator;
+
+	std::vector<NetClick> pending_clicks; // sent until the server says it has them
+	unsigned int next_click;
+
+	double clock_offset; // server clock - client clock
+	bool synchronized;
+
+	GameClient() : next_click(1), clock_offset(0), synchronized(false) {}
+};
+
+// Camera, acknowledgement and the clicks still pending, every frame
+void client_send_input(GameClient& client, const std::vector<NetClick>& new_clicks, double now) {
+	for (size_t i = 0; i < new_clicks.size(); i++) {
+		client.pending_clicks.push_back(new_clicks[i]);
+		client.pending_clicks.back().number = client.next_click++;
+	}
+
+	NetInput input;
+	input.acknowledged = client.decoder.get_acknowledged();
+	input.time = now;
+	getCameraState(input.camera_position, input.horizontal_angle, input.vertical_angle);
+	input.clicks = client.pending_clicks;
+
+	unsigned char packet[net_max_packet];
+	size_t size = write_input_packet(input, packet);
+	client.socket.send(client.server, packet, size);
+}
+
+// Snapshots received since the last frame, how many were completed
+int client_receive(GameClient& client, double now) {
+	unsigned char packet[net_max_packet];
+	NetAddress from;
+	NetSnapshot snapshot;
+	int completed = 0;
+	int size;
+	while ((size = client.socket.receive(from, packet, sizeof(packet))) >= 0) {
+		if (!(from == client.server) || !client.decoder.receive(packet, size, snapshot))
+			continue;
+		completed++;
+		client.interpolator.add(snapshot);
+
+		size_t handled = 0;
+		while (handled < client.pending_clicks.size() && client.pending_clicks[handled].number <= snapshot.last_click)
+			handled++;
+		client.pending_clicks.erase(client.pending_clicks.begin(), client.pending_clicks.begin() + handled);
+
+		// Follows the server clock smoothly, jumps only when way off
+		double offset = snapshot.server_time - now;
+		if (!client.synchronized || fabs(offset - client.clock_offset) > 0.25)
+			client.clock_offset = offset;
+		else
+			client.clock_offset += (offset - client.clock_offset) * 0.05;
+		client.synchronized = true;
+	}
+	return completed;
+}
+
+// The world as the server had it interpolation_delay ago
+void client_world(GameClient& client, double now, ObjectList& enemies, ObjectList& fireballs) {
+	static std::vector<NetEntity> entities;
+	client.interpolator.sample(now + client.clock_offset - interpolation_delay, entities);
+
+	enemies.clear();
+	fireballs.clear();
+	for (size_t i = 0; i < entities.size(); i++) {
+		const NetEntity& e = entities[i];
+		mat4 rotation = mat4_cast(e.rotation);
+		if (e.type == NET_FIREBALL) {
+			// make_fireball turns +Y to the flight direction
+			fireballs.push_back(Object_3d(e.position, vec3(rotation * vec4(0, 1, 0, 0)), rotation, e.layer));
+			fireballs.back().id = e.id;
+		} else {
+			enemies.push_back(Object_3d(e.position, vec3(), rotation, e.layer));
+			enemies.back().id = e.id;
+		}
+	}
+}
+
+// playground --client [host] [port]
+int run_client(const char* host, unsigned short port) {
+	GameClient client;
+	if (!resolve_address(host, port, client.server) || !client.socket.open(0))
+		return 1;
+
+	int init_res = init_all();
+	if (init_res != 0)
+		return init_res;
+
+	mat4 Projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+
+	SceneResources res;
+	if (!load_resources(res))
+		return 1;
+
+	ObjectList enemies;
+	ObjectList fireballs;
+	std::vector<NetClick> clicks;
+	double lastTime = glfwGetTime();
 
 	do {
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// Clear the screen
+		glfwPollEvents();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		//  MVP-        
-		computeMatricesFromInputs();
-		glm::mat4 View = getViewMatrix();
+		double currentTime = glfwGetTime();
+		float deltaTime = float(currentTime - lastTime);
+		lastTime = currentTime;
 
-		create_enemy_by_timer(enemies);
-		create_fireball_by_click(fireballs);
-		delete_collided(enemies, fireballs);
+		// The camera is the client's own, everything else comes from the server
+		clicks.clear();
+		read_input_events(clicks);
+		computeMatricesFromInputs();
+		mat4 View = getViewMatrix();
+		client_send_input(client, clicks, currentTime);
 
-		glUseProgram(programIDhardcoded);
-		draw_all_enemies(
-			enemy_vertex_buffer, enemy_color_buffer, MatrixIDhardcoded,
-			enemies, View, Projection
-		);
+		client_receive(client, currentTime);
+		client_world(client, currentTime, enemies, fireballs);
 
-		glUseProgram(programIDobj);
-		draw_all_fireballs(
-			fireball_vertex_buffer, fireball_uv_buffer, MatrixIDobj,
-			fireballs, View, Projection, fireball_vertices.size() / 3,
-			FireballTexture, TextureID
-		);
+		update_fireball_trails(res.FireballTrails, fireballs, deltaTime);
+		draw_scene(res, enemies, fireballs, View, Projection);
 
-		// Swap buffers
 		glfwSwapBuffers(window);
-		glfwPollEvents();
-	} // Check if the ESC key was pressed or the window was closed
-	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+	} while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 		glfwWindowShouldClose(window) == 0);
 
+	free_resources(res);
+	glfwTerminate();
+	return 0;
+}
 
-	// Cleanup VBO and shader
-	glDeleteBuffers(1, &enemy_vertex_buffer);
-	glDeleteBuffers(1, &enemy_color_buffer);
-	glDeleteProgram(programIDhardcoded);
-	glDeleteVertexArrays(1, &VertexArrayID);
 
-	// Cleanup VBO and shader
-	glDeleteBuffers(1, &fireball_vertex_buffer);
-	glDeleteBuffers(1, &fireball_uv_buffer);
-	glDeleteProgram(programIDobj);
-	glDeleteTextures(1, &FireballTexture);
+// Server and client in one process over loopback : tick time, and bytes per
+// entity for the first full snapshot and for the deltas after it
+int run_net_benchmark(int entity_count, int tick_count) {
+	GameServer server;
+	GameClient client;
+	if (!server.socket.open(0) || !client.socket.open(0))
+		return 1;
+	client.server.ip = 0x7F000001;
+	client.server.port = server.socket.get_port();
+
+	spawn_swarm_world(server.enemies, entity_count);
+	setCameraState(vec3(0, 0, 0), 0, 0);
+
+	const float deltaTime = 1.0f / server_tick_rate;
+	double tick_ms = 0, send_ms = 0, receive_ms = 0;
+	size_t full_bytes = 0, delta_bytes = 0;
+	int delta_count = 0, completed = 0;
+	double now = 0;
+	std::vector<NetClick> no_clicks;
+	for (int tick = 0; tick < tick_count; tick++, now += deltaTime) {
+		client_send_input(client, no_clicks, now);
+		server_receive(server, now);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		server_tick(server, deltaTime, now);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		server.bytes_sent = 0;
+		server_send(server, now);
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+		completed += client_receive(client, now);
+		std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+		tick_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		send_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+		receive_ms += std::chrono::duration<double, std::milli>(t3 - t2).count();
+		if (tick == 0) {
+			full_bytes = server.bytes_sent;
+		} else {
+			delta_bytes += server.bytes_sent;
+			delta_count++;
+		}
+	}
+
+	int entities = server.enemies.size() + server.fireballs.size();
+	double delta_per_tick = delta_count ? (double)delta_bytes / delta_count : 0;
+	printf("net : %d entities, %d ticks at %d Hz, %d snapshots completed by the client\n",
+		entities, tick_count, server_tick_rate, completed);
+	printf("  simulation %.3f ms, encode + send %.3f ms, receive + decode %.3f ms per tick\n",
+		tick_ms / tick_count, send_ms / tick_count, receive_ms / tick_count);
+	printf("  full snapshot %.2f bytes per entity, deltas %.2f bytes per entity (%.1f KB/s)\n",
+		(double)full_bytes / entity_count, delta_per_tick / (entities ? entities : 1),
+		delta_per_tick * server_tick_rate / 1024);
+	return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+	// playground --make-pack [assets.pak]
+	if (argc > 1 && strcmp(argv[1], "--make-pack") == 0)
+		return run_make_pack(argc > 2 ? argv[2] : asset_pack_path);
+
+	// The loaders look into the pack first, then into the working directory.
+	// A missing pack is fine, a broken one too : the files are still there.
+	FILE* pack = fopen(asset_pack_path, "rb");
+	if (pack) {
+		fclose(pack);
+		mount_asset_pack(asset_pack_path);
+	}
+
+	// kill -USR1 <pid> prints every tracked allocation and GL object
+	install_memory_dump_signal();
+
+	// playground --soft [frames] [output.bmp] [occluders] [sort draws 0/1]
+	if (argc > 1 && strcmp(argv[1], "--soft") == 0) {
+		int frame_count = argc > 2 ? atoi(argv[2]) : 100;
+		const char* output_path = argc > 3 ? argv[3] : "soft_frame.bmp";
+		if (argc > 4)
+			occluder_count = atoi(argv[4]);
+		if (argc > 5)
+			sort_draws = atoi(argv[5]) != 0;
+		return run_software(frame_count > 0 ? frame_count : 1, output_path);
+	}
+
+	// playground --bench-boids [agents] [steps] [world.snap]
+	// The agent count is ignored when starting from a snapshot
+	if (argc > 1 && strcmp(argv[1], "--bench-boids") == 0) {
+		int agent_count = argc > 2 ? atoi(argv[2]) : 100000;
+		int frame_count = argc > 3 ? atoi(argv[3]) : 300;
+		const char* snapshot_path = argc > 4 ? argv[4] : NULL;
+		return run_boids_benchmark(agent_count > 0 ? agent_count : 1, frame_count > 0 ? frame_count : 1, snapshot_path);
+	}
+
+	// playground --server [port]
+	if (argc > 1 && strcmp(argv[1], "--server") == 0)
+		return run_server(argc > 2 ? (unsigned short)atoi(argv[2]) : net_default_port);
+
+	// playground --client [host] [port]
+	if (argc > 1 && strcmp(argv[1], "--client") == 0)
+		return run_client(argc > 2 ? argv[2] : "127.0.0.1", argc > 3 ? (unsigned short)atoi(argv[3]) : net_default_port);
+
+	// playground --bench-net [entities] [ticks]
+	if (argc > 1 && strcmp(argv[1], "--bench-net") == 0) {
+		int entity_count = argc > 2 ? atoi(argv[2]) : 10000;
+		int tick_count = argc > 3 ? atoi(argv[3]) : 300;
+		return run_net_benchmark(entity_count > 0 ? entity_count : 1, tick_count > 0 ? tick_count : 1);
+	}
+
+	// playground --make-snapshot world.snap [enemies] [compress 0/1]
+	if (argc > 2 && strcmp(argv[1], "--make-snapshot") == 0) {
+		int agent_count = argc > 3 ? atoi(argv[3]) : 1000000;
+		bool compress = argc > 4 && atoi(argv[4]) != 0;
+		return run_make_snapshot(argv[2], agent_count > 0 ? agent_count : 1, compress);
+	}
+
+	// playground --offscreen [frames] [output prefix] [capture every N frames]
+	if (argc > 1 && strcmp(argv[1], "--offscreen") == 0) {
+		int frame_count = argc > 2 ? atoi(argv[2]) : 100;
+		const char* output_prefix = argc > 3 ? argv[3] : "";
+		int capture_every = argc > 4 ? atoi(argv[4]) : 1;
+		return run_offscreen(frame_count > 0 ? frame_count : 1, output_prefix, capture_every > 0 ? capture_every : 1);
+	}
+
+	// playground [--swap-interval N] [--frames-in-flight N] [--fps-cap F] [--snapshot world.snap]
+	//            [--gpu-budget ms] [--max-msaa N] [--occluders N] [--sort-draws 0/1] [--overdraw 0/1]
+	//            [--gpu-driven 0/1] [--gpu-projectiles 0/1] [--vertex-compression 0/1]
+	//            [--uv-format float/half/unorm16] [--memory-report seconds] [--lighting 0/1]
+	//            [--render-thread 0/1] [--tick-rate hz]
+	int swap_interval = 1;
+	int frames_in_flight = 2;
+	double fps_cap = 0;
+	const char* snapshot_path = NULL;
+	double gpu_budget_ms = 0; // 0 : fixed resolution, MSAA on the window
+	int max_msaa = 4;
+	bool vertex_compression = true;
+	const char* uv_format = NULL; // the default of the vertex format
+	double memory_report_period = 0; // 0 : only at exit
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--swap-interval") == 0)
+			swap_interval = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--frames-in-flight") == 0)
+			frames_in_flight = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--fps-cap") == 0)
+			fps_cap = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--snapshot") == 0)
+			snapshot_path = argv[i + 1];
+		else if (strcmp(argv[i], "--gpu-budget") == 0)
+			gpu_budget_ms = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--max-msaa") == 0)
+			max_msaa = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--occluders") == 0)
+			occluder_count = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--sort-draws") == 0)
+			sort_draws = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--overdraw") == 0)
+			count_overdraw = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--gpu-driven") == 0)
+			gpu_driven = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--gpu-projectiles") == 0)
+			gpu_projectiles = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--vertex-compression") == 0)
+			vertex_compression = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--uv-format") == 0)
+			uv_format = argv[i + 1];
+		else if (strcmp(argv[i], "--memory-report") == 0)
+			memory_report_period = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "--lighting") == 0)
+			clustered_lighting = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--render-thread") == 0)
+			render_thread = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "--tick-rate") == 0)
+			tick_rate = atof(argv[i + 1]);
+	}
+	if (!(tick_rate > 0)) {
+		printf("--tick-rate needs a rate above 0 Hz\n");
+		return 1;
+	}
+	vertex_format = vertex_compression ? get_compact_vertex_format() : get_full_vertex_format();
+	if (uv_format && strcmp(uv_format, "float") == 0)
+		vertex_format.uv_type = GL_FLOAT;
+	else if (uv_format && strcmp(uv_format, "half") == 0)
+		vertex_format.uv_type = GL_HALF_FLOAT;
+	else if (uv_format && strcmp(uv_format, "unorm16") == 0)
+		vertex_format.uv_type = GL_UNSIGNED_SHORT;
+	bool dynamic_resolution = gpu_budget_ms > 0;
+
+	// The meshes and files load while the window opens
+	StartupLoader loader;
+	SceneStaging staging;
+	start_loading(loader, staging);
+
+	int init_res;
+	loader.run_here("window and GL context", [&]() {
+		init_res = init_all(dynamic_resolution ? 0 : max_msaa);
+		return init_res == 0;
+	});
+	if (init_res != 0)
+		return init_res;
+
+	WindowRenderer renderer;
+	renderer.dynamic_resolution = dynamic_resolution;
+	if (dynamic_resolution) {
+		int window_width, window_height;
+		get_window_size(window_width, window_height);
+		if (!renderer.resolution.init(window_width, window_height, gpu_budget_ms, max_msaa))
+			return 1;
+	}
+
+
+	// Projection matrix : 45 Field of View, 4:3 ratio, display range : 0.1 unit <-> 100 units
+	mat4 Projection = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+
+	SceneResources res;
+	bool loaded = finish_loading(loader, staging, res);
+	loader.print_timeline();
+	if (!loaded)
+		return 1;
+	if (count_overdraw)
+		overdraw_counter.init();
+
+
+	ObjectList enemies;
+	ObjectList fireballs;
+	if (snapshot_path && !load_world(snapshot_path, enemies, fireballs))
+		printf("starting from an empty world\n");
+	if (res.use_projectiles)
+		restart_gpu_projectiles(res.Projectiles, enemies);
+
+	if (render_thread && res.use_projectiles) {
+		printf("GPU projectiles are simulated with GL, no render thread\n");
+		render_thread = false;
+	}
+
+	double lastTime = glfwGetTime();
+	renderer.res = &res;
+	renderer.memory_report_period = memory_report_period;
+	renderer.memory_report_time = lastTime + memory_report_period;
+	renderer.trails_time = 0;
+	renderer.frame_count = 0;
+	renderer.packet_count = 0;
+
+	TripleBuffer<FramePacket> packets;
+	int step_count = 0;
+
+	if (!render_thread) {
+		// Same hand-over, within a frame
+		renderer.pacer.init(swap_interval, frames_in_flight, fps_cap);
+		do {
+			renderer.pacer.wait_for_frame();
+			simulate_step(res, enemies, fireballs, lastTime, Projection, packets.write_slot());
+			packets.publish();
+			step_count++;
+			packets.acquire();
+			render_frame(renderer, packets.read_slot(), true);
+		} // Check if the ESC key was pressed or the window was closed
+		while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+			glfwWindowShouldClose(window) == 0);
+	} else {
+		// A first packet, so the renderer always has one to draw
+		simulate_step(res, enemies, fireballs, lastTime, Projection, packets.write_slot());
+		packets.publish();
+		step_count++;
+		double start_time = lastTime;
+
+		std::atomic<bool> quit(false);
+		glfwMakeContextCurrent(NULL);
+		std::thread renderer_thread([&]() {
+			glfwMakeContextCurrent(window);
+			renderer.pacer.init(swap_interval, frames_in_flight, fps_cap);
+			while (!quit) {
+				renderer.pacer.wait_for_frame();
+				bool fresh = packets.acquire();
+				render_frame(renderer, packets.read_slot(), fresh);
+			}
+			glfwMakeContextCurrent(NULL);
+		});
+
+		// A late step starts again from now rather than catching up with a burst
+		double step_duration = 1.0 / tick_rate;
+		double next_step_time = lastTime;
+		while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+			glfwWindowShouldClose(window) == 0) {
+			next_step_time += step_duration;
+			double now = glfwGetTime();
+			if (now - next_step_time > step_duration)
+				next_step_time = now;
+			else if (next_step_time > now)
+				std::this_thread::sleep_for(std::chrono::duration<double>(next_step_time - now));
+
+			simulate_step(res, enemies, fireballs, lastTime, Projection, packets.write_slot());
+			packets.publish();
+			step_count++;
+		}
+
+		quit = true;
+		renderer_thread.join();
+		glfwMakeContextCurrent(window);
+
+		double seconds = glfwGetTime() - start_time;
+		printf("render thread : %d steps at %.1f Hz, %d frames at %.1f fps, %d steps never drawn\n",
+			step_count, step_count / seconds, renderer.frame_count, renderer.frame_count / seconds,
+			step_count - renderer.packet_count);
+	}
+
+	renderer.pacer.print_report();
+	renderer.pacer.cleanup();
+	if (occluder_count > 0)
+		occlusion_culler.print_report();
+	if (count_overdraw) {
+		overdraw_counter.print_report();
+		overdraw_counter.cleanup();
+	}
+	if (dynamic_resolution) {
+		renderer.resolution.print_report();
+		renderer.resolution.cleanup();
+	}
+	if (res.use_projectiles)
+		res.Projectiles.print_report();
+	if (res.use_lighting)
+		res.Lights.print_report();
+	print_memory_summary();
+
+	free_resources(res);
+	print_gpu_leaks();
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+#include "objloader.hpp"
+#include "assetpack.hpp"
+
+
+static const char asset_pack_magic[4] = { 'P', 'G', 'A', 'K' };
+static const size_t header_size = 32;
+static const size_t slot_size = 32;
+static const size_t asset_alignment = 64;
+static const size_t max_name_length = 0xffff;
+static const size_t mesh_header_size = 16;
+
+// Same conventions as the snapshots : fields as they are in memory
+template <typename T>
+static void put(unsigned char * p, T value) {
+	memcpy(p, &value, sizeof(T));
+}
+
+template <typename T>
+static T get(const unsigned char * p) {
+	T value;
+	memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+static size_t align_up(size_t offset) {
+	return (offset + asset_alignment - 1) & ~(asset_alignment - 1);
+}
+
+// FNV-1a, never 0 : 0 marks the empty slots
+static unsigned long long hash_name(const char * name, size_t length) {
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++)
+		hash = (hash ^ (unsigned char)name[i]) * 1099511628211ull;
+	return hash ? hash : 1;
+}
+
+
+bool save_asset_pack(const char * path, const std::vector<AssetSource>& assets) {
+	size_t count = assets.size();
+	unsigned int slot_count = 1;
+	while (slot_count < 2 * count)
+		slot_count *= 2;
+
+	std::vector<unsigned char> table(header_size + slot_count * slot_size, 0);
+	std::string names;
+	size_t names_offset = table.size();
+	for (size_t i = 0; i < count; i++)
+		names += assets[i].name;
+
+	// Data after the names, every asset aligned
+	std::vector<size_t> offsets(count);
+	size_t offset = align_up(names_offset + names.size());
+	for (size_t i = 0; i < count; i++) {
+		offsets[i] = offset;
+		offset = align_up(offset + assets[i].data.size());
+	}
+	size_t total_size = offset;
+
+	unsigned char * h = &table[0];
+	memcpy(h, asset_pack_magic, 4);
+	put<unsigned int>(h + 4, asset_pack_version);
+	put<unsigned int>(h + 8, (unsigned int)count);
+	put<unsigned int>(h + 12, slot_count);
+	size_t name_offset = names_offset;
+	for (size_t i = 0; i < count; i++) {
+		const AssetSource& asset = assets[i];
+		if (asset.name.size() > max_name_length) {
+			printf("%s : asset name too long\n", asset.name.c_str());
+			return false;
+		}
+		unsigned long long hash = hash_name(asset.name.c_str(), asset.name.size());
+		unsigned int slot = (unsigned int)hash & (slot_count - 1);
+		while (get<unsigned long long>(h + header_size + slot * slot_size) != 0) {
+			const unsigned char * s = h + header_size + slot * slot_size;
+			if (get<unsigned long long>(s) == hash && get<unsigned short>(s + 28) == asset.name.size() &&
+				memcmp(names.c_str() + get<unsigned int>(s + 24) - names_offset, asset.name.c_str(), asset.name.size()) == 0) {
+				printf("%s is in the pack twice\n", asset.name.c_str());
+				return false;
+			}
+			slot = (slot + 1) & (slot_count - 1);
+		}
+		unsigned char * s = h + header_size + slot * slot_size;
+		put<unsigned long long>(s, hash);
+		put<unsigned long long>(s + 8, offsets[i]);
+		put<unsigned long long>(s + 16, asset.data.size());
+		put<unsigned int>(s + 24, (unsigned int)name_offset);
+		put<unsigned short>(s + 28, (unsigned short)asset.name.size());
+		put<unsigned short>(s + 30, (unsigned short)asset.kind);
+		name_offset += asset.name.size();
+	}
+
+	FILE * file = fopen(path, "wb");
+	if (!file) {
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+	static const unsigned char padding[asset_alignment] = { 0 };
+	bool ok = fwrite(&table[0], 1, table.size(), file) == table.size();
+	ok = ok && fwrite(names.data(), 1, names.size(), file) == names.size();
+	size_t written = table.size() + names.size();
+	for (size_t i = 0; i < count && ok; i++) {
+		ok = fwrite(padding, 1, offsets[i] - written, file) == offsets[i] - written;
+		const std::vector<unsigned char>& data = assets[i].data;
+		if (!data.empty())
+			ok = ok && fwrite(&data[0], 1, data.size(), file) == data.size();
+		written = offsets[i] + data.size();
+	}
+	ok = ok && fwrite(padding, 1, total_size - written, file) == total_size - written;
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok) {
+		printf("%s could not be written\n", path);
+		remove(path);
+	}
+	return ok;
+}
+
+bool convert_obj(const char * path, std::vector<unsigned char>& data) {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (!loadOBJ(path, positions, uvs, normals))
+		return false;
+
+	// loadOBJ gives every corner all three attributes
+	size_t count = positions.size();
+	data.assign(mesh_header_size + count * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2)), 0);
+	put<unsigned int>(&data[0], (unsigned int)count);
+	unsigned char * p = &data[mesh_header_size];
+	if (count > 0) {
+		memcpy(p, &positions[0], count * sizeof(glm::vec3));
+		memcpy(p + count * sizeof(glm::vec3), &uvs[0], count * sizeof(glm::vec2));
+		memcpy(p + count * (sizeof(glm::vec3) + sizeof(glm::vec2)), &normals[0], count * sizeof(glm::vec3));
+	}
+	return true;
+}
+
+
+AssetPack::AssetPack() {
+	slots = NULL;
+	slot_count = 0;
+	asset_count = 0;
+}
+
+bool AssetPack::open(const char * path) {
+	close();
+	if (!file.open(path))
+		return false;
+
+	const unsigned char * data = file.data();
+	size_t size = file.size();
+	if (size < header_size || memcmp(data, asset_pack_magic, 4) != 0) {
+		printf("%s is not an asset pack\n", path);
+		close();
+		return false;
+	}
+	unsigned int version = get<unsigned int>(data + 4);
+	if (version != asset_pack_version) {
+		printf("%s is a version %u asset pack, version %u expected\n", path, version, asset_pack_version);
+		close();
+		return false;
+	}
+	unsigned int count = get<unsigned int>(data + 8);
+	unsigned int slots_in_file = get<unsigned int>(data + 12);
+	if (slots_in_file == 0 || (slots_in_file & (slots_in_file - 1)) != 0 || count > slots_in_file ||
+		slots_in_file > (size - header_size) / slot_size) {
+		printf("%s is truncated\n", path);
+		close();
+		return false;
+	}
+
+	// Every slot is checked once here, find() trusts them
+	unsigned int used = 0;
+	for (unsigned int i = 0; i < slots_in_file; i++) {
+		const unsigned char * s = data + header_size + i * slot_size;
+		if (get<unsigned long long>(s) == 0)
+			continue;
+		unsigned long long offset = get<unsigned long long>(s + 8);
+		unsigned long long asset_size = get<unsigned long long>(s + 16);
+		unsigned int name_offset = get<unsigned int>(s + 24);
+		unsigned int name_length = get<unsigned short>(s + 28);
+		bool ok = offset <= size && asset_size <= size - offset && offset % asset_alignment == 0 &&
+			name_offset <= size && name_length <= size - name_offset;
+		if (!ok) {
+			printf("%s : table of contents entry %u is corrupt\n", path, i);
+			close();
+			return false;
+		}
+		used++;
+	}
+	if (used != count) {
+		printf("%s : %u assets in the table of contents, %u in the header\n", path, used, count);
+		close();
+		return false;
+	}
+
+	slots = data + header_size;
+	slot_count = slots_in_file;
+	asset_count = count;
+	return true;
+}
+
+void AssetPack::close() {
+	file.close();
+	slots = NULL;
+	slot_count = 0;
+	asset_count = 0;
+}
+
+const unsigned char * AssetPack::find(const char * name, unsigned int kind, size_t& size) const {
+	size = 0;
+	if (!slots)
+		return NULL;
+	size_t length = strlen(name);
+	unsigned long long hash = hash_name(name, length);
+	// Packs from save_asset_pack() always have an empty slot to stop on, the
+	// probe count only guards against the others
+	unsigned int slot = (unsigned int)hash & (slot_count - 1);
+	for (unsigned int probe = 0; probe < slot_count; probe++, slot = (slot + 1) & (slot_count - 1)) {
+		const unsigned char * s = slots + slot * slot_size;
+		unsigned long long slot_hash = get<unsigned long long>(s);
+		if (slot_hash == 0)
+			return NULL;
+		if (slot_hash != hash || get<unsigned short>(s + 28) != length ||
+			memcmp(file.data() + get<unsigned int>(s + 24), name, length) != 0)
+			continue;
+		if (get<unsigned short>(s + 30) != kind)
+			return NULL;
+		size = (size_t)get<unsigned long long>(s + 16);
+		return file.data() + get<unsigned long long>(s + 8);
+	}
+	return NULL;
+}
+
+
+static AssetPack mounted_pack;
+
+bool mount_asset_pack(const char * path) {
+	if (!mounted_pack.open(path))
+		return false;
+	printf("%s : %d assets\n", path, mounted_pack.get_asset_count());
+	return true;
+}
+
+void unmount_asset_pack() {
+	mounted_pack.close();
+}
+
+
+Asset::Asset() {
+	bytes = NULL;
+	length = 0;
+}
+
+bool Asset::open(const char * name) {
+	close();
+	bytes = mounted_pack.find(name, ASSET_RAW, length);
+	if (bytes)
+		return true;
+	if (!file.open(name))
+		return false;
+	bytes = file.data();
+	length = file.size();
+	return true;
+}
+
+void Asset::close() {
+	file.close();
+	bytes = NULL;
+	length = 0;
+}
+
+bool prefetch_asset(const char * name) {
+	Asset asset;
+	if (!asset.open(name)) {
+		printf("Impossible to open %s. Are you in the right directory ?\n", name);
+		return false;
+	}
+	// One byte per page is enough to fault them all in
+	volatile unsigned char sum = 0;
+	const unsigned char * data = asset.data();
+	for (size_t i = 0; i < asset.size(); i += 4096)
+		sum += data[i];
+	(void)sum;
+	return true;
+}
+
+bool load_mesh_asset(
+	const char * name, std::vector<glm::vec3>& positions, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals
+) {
+	size_t size;
+	const unsigned char * data = mounted_pack.find(name, ASSET_MESH, size);
+	if (!data)
+		return loadOBJ(name, positions, uvs, normals);
+
+	size_t count = size >= mesh_header_size ? get<unsigned int>(data) : 0;
+	if (size < mesh_header_size || (size - mesh_header_size) / (sizeof(glm::vec3) * 2 + sizeof(glm::vec2)) != count) {
+		printf("%s : corrupt mesh in the asset pack\n", name);
+		return false;
+	}
+	const glm::vec3 * p = (const glm::vec3 *)(data + mesh_header_size);
+	const glm::vec2 * t = (const glm::vec2 *)(p + count);
+	const glm::vec3 * n = (const glm::vec3 *)(t + count);
+	positions.assign(p, p + count);
+	uvs.assign(t, t + count);
+	normals.assign(n, n + count);
+	return true;
+}
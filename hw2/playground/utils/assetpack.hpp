@@ -0,0 +1,93 @@
+#ifndef ASSETPACK_HPP
+#define ASSETPACK_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+
+const unsigned int asset_pack_version = 1;
+
+enum AssetKind {
+	ASSET_RAW = 0,  // the bytes of the file : shaders, .DDS textures
+	ASSET_MESH = 1, // .obj converted by convert_obj()
+};
+
+// One asset to pack, under the path the loaders ask for
+struct AssetSource {
+	std::string name;
+	unsigned int kind;
+	std::vector<unsigned char> data;
+};
+
+// Header, table of contents, names, then the assets one after the other, each
+// 64-byte aligned. The table is open addressed on a hash of the names, with a
+// power of two of slots at most half full, so a lookup reads one or two slots.
+// Little-endian like the snapshots.
+bool save_asset_pack(const char * path, const std::vector<AssetSource>& assets);
+
+// Arrays loadOBJ returns for an .obj file, laid out so that reading them back
+// takes no parsing : vertex count, then positions, uvs and normals
+bool convert_obj(const char * path, std::vector<unsigned char>& data);
+
+// Asset pack read through a memory mapping : the assets are handed out in place
+class AssetPack {
+public:
+	AssetPack();
+
+	bool open(const char * path);
+	void close();
+
+	bool is_open() const { return slots != NULL; }
+	int get_asset_count() const { return asset_count; }
+
+	// Bytes of asset name if it's in the pack with that kind, else NULL.
+	// Valid until close().
+	const unsigned char * find(const char * name, unsigned int kind, size_t& size) const;
+
+private:
+	MappedFile file;
+	const unsigned char * slots;
+	unsigned int slot_count;
+	int asset_count;
+};
+
+// Pack the assets are looked for first. Without one, or for the assets it
+// doesn't have, the loaders read the files in the working directory.
+bool mount_asset_pack(const char * path);
+void unmount_asset_pack();
+
+// Bytes of one raw asset, from the mounted pack or else from a mapping of the
+// file of that name. Nothing is copied either way ; valid while the Asset lives.
+class Asset {
+public:
+	Asset();
+
+	bool open(const char * name);
+	void close();
+
+	const unsigned char * data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	Asset(const Asset&);
+	Asset& operator=(const Asset&);
+
+	MappedFile file; // loose files only
+	const unsigned char * bytes;
+	size_t length;
+};
+
+// Reads the pages of one raw asset in, so that opening it later costs no
+// disk access. Safe from any thread.
+bool prefetch_asset(const char * name);
+
+// Converted mesh from the mounted pack, or else loadOBJ on the file
+bool load_mesh_asset(
+	const char * name, std::vector<glm::vec3>& positions, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals
+);
+
+#endif
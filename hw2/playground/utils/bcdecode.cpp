@@ -0,0 +1,200 @@
+#include <string.h>
+#include <vector>
+
+#include "simd.hpp"
+#include "threadpool.hpp"
+#include "bcdecode.hpp"
+
+
+int bc_block_size(BCFormat format) {
+	return format == BC_FORMAT_BC1 ? 8 : 16;
+}
+
+// 5:6:5 endpoint -> 8 bits per channel by bit replication, the way the hardware does it
+static void expand_565(unsigned int c, unsigned int* rgb) {
+	unsigned int r = (c >> 11) & 31;
+	unsigned int g = (c >> 5) & 63;
+	unsigned int b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Color part of a block : 2 endpoints and 16 2-bit indices.
+// Writes the RGBA texels with alpha 255 (or 0 for the transparent BC1 entry).
+static void decode_color_block(const unsigned char* block, bool allow_transparent, unsigned char* rgba) {
+	unsigned int c0 = block[0] | (block[1] << 8);
+	unsigned int c1 = block[2] | (block[3] << 8);
+	bool four_colors = c0 > c1 || !allow_transparent;
+
+	unsigned int e0[3], e1[3];
+	expand_565(c0, e0);
+	expand_565(c1, e1);
+
+#ifdef SIMD_SSE2
+	// Palette in 16-bit lanes : A = [c0 | c1], B = [c1 | c0]
+	__m128i A = _mm_setr_epi16(e0[0], e0[1], e0[2], 255, e1[0], e1[1], e1[2], 255);
+	__m128i B = _mm_setr_epi16(e1[0], e1[1], e1[2], 255, e0[0], e0[1], e0[2], 255);
+	__m128i mixed;
+	if (four_colors) {
+		// (2*c0 + c1) / 3 and (c0 + 2*c1) / 3, x/3 == (x * 0x5556) >> 16 for x <= 765
+		__m128i sum = _mm_add_epi16(_mm_add_epi16(A, A), B);
+		mixed = _mm_mulhi_epu16(sum, _mm_set1_epi16(0x5556));
+	} else {
+		// (c0 + c1) / 2 and transparent black
+		mixed = _mm_srli_epi16(_mm_add_epi16(A, B), 1);
+		mixed = _mm_and_si128(mixed, _mm_setr_epi16(-1, -1, -1, -1, 0, 0, 0, 0));
+	}
+	__m128i palette = _mm_packus_epi16(A, mixed);
+
+	__m128i entries[4];
+	entries[0] = _mm_shuffle_epi32(palette, 0x00);
+	entries[1] = _mm_shuffle_epi32(palette, 0x55);
+	entries[2] = _mm_shuffle_epi32(palette, 0xAA);
+	entries[3] = _mm_shuffle_epi32(palette, 0xFF);
+
+	// One row of 4 texels at a time : select the palette entry by comparing the indices
+	for (int row = 0; row < 4; row++) {
+		unsigned int bits = block[4 + row];
+		__m128i index = _mm_setr_epi32(bits & 3, (bits >> 2) & 3, (bits >> 4) & 3, (bits >> 6) & 3);
+		__m128i texels = _mm_setzero_si128();
+		for (int k = 0; k < 4; k++) {
+			__m128i select = _mm_cmpeq_epi32(index, _mm_set1_epi32(k));
+			texels = _mm_or_si128(texels, _mm_and_si128(select, entries[k]));
+		}
+		_mm_storeu_si128((__m128i*)(rgba + row * 16), texels);
+	}
+#else
+	unsigned char palette[4][4];
+	for (int c = 0; c < 3; c++) {
+		palette[0][c] = (unsigned char)e0[c];
+		palette[1][c] = (unsigned char)e1[c];
+		if (four_colors) {
+			palette[2][c] = (unsigned char)((2 * e0[c] + e1[c]) / 3);
+			palette[3][c] = (unsigned char)((e0[c] + 2 * e1[c]) / 3);
+		} else {
+			palette[2][c] = (unsigned char)((e0[c] + e1[c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = four_colors ? 255 : 0;
+
+	unsigned int indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+	for (int i = 0; i < 16; i++) {
+		memcpy(rgba + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+	}
+#endif
+}
+
+// BC3 alpha : 2 endpoints and 16 3-bit indices
+static void decode_interpolated_alpha(const unsigned char* block, unsigned char* alpha) {
+	unsigned int palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (palette[0] > palette[1]) {
+		for (int k = 1; k < 7; k++) {
+			palette[k + 1] = ((7 - k) * palette[0] + k * palette[1]) / 7;
+		}
+	} else {
+		for (int k = 1; k < 5; k++) {
+			palette[k + 1] = ((5 - k) * palette[0] + k * palette[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	unsigned long long bits = 0;
+	for (int k = 0; k < 6; k++) {
+		bits |= (unsigned long long)block[2 + k] << (8 * k);
+	}
+	for (int i = 0; i < 16; i++) {
+		alpha[i] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+	}
+}
+
+void decode_bc_block(const unsigned char* block, BCFormat format, unsigned char* rgba) {
+	if (format == BC_FORMAT_BC1) {
+		decode_color_block(block, true, rgba);
+		return;
+	}
+
+	decode_color_block(block + 8, false, rgba);
+
+	unsigned char alpha[16];
+	if (format == BC_FORMAT_BC2) {
+		// Explicit 4-bit alpha
+		for (int i = 0; i < 16; i++) {
+			unsigned int a = (block[i / 2] >> ((i % 2) * 4)) & 15;
+			alpha[i] = (unsigned char)(a * 17);
+		}
+	} else {
+		decode_interpolated_alpha(block, alpha);
+	}
+
+	for (int i = 0; i < 16; i++) {
+		rgba[i * 4 + 3] = alpha[i];
+	}
+}
+
+
+void decode_bc_levels(
+	const unsigned char* data, int width, int height, int level_count,
+	BCFormat format, DecodedImage& image
+) {
+	// Block rows handed to a single task
+	const int rows_per_task = 8;
+
+	struct Task {
+		const unsigned char* blocks;
+		unsigned char* rgba;
+		int width, height;
+		int first_row, row_count;
+	};
+
+	image.width = width;
+	image.height = height;
+	image.levels.resize(level_count);
+
+	std::vector<Task> tasks;
+	int block_size = bc_block_size(format);
+	size_t offset = 0;
+	for (int level = 0; level < level_count; level++) {
+		int w = width >> level;
+		int h = height >> level;
+		if (w < 1) w = 1;
+		if (h < 1) h = 1;
+		int blocks_x = (w + 3) / 4;
+		int blocks_y = (h + 3) / 4;
+
+		image.levels[level].resize(w * h * 4);
+		for (int row = 0; row < blocks_y; row += rows_per_task) {
+			Task task;
+			task.blocks = data + offset;
+			task.rgba = &image.levels[level][0];
+			task.width = w;
+			task.height = h;
+			task.first_row = row;
+			task.row_count = row + rows_per_task < blocks_y ? rows_per_task : blocks_y - row;
+			tasks.push_back(task);
+		}
+		offset += blocks_x * blocks_y * block_size;
+	}
+
+	get_thread_pool().parallel_for((int)tasks.size(), [&](int t) {
+		const Task& task = tasks[t];
+		int blocks_x = (task.width + 3) / 4;
+		for (int by = task.first_row; by < task.first_row + task.row_count; by++) {
+			for (int bx = 0; bx < blocks_x; bx++) {
+				unsigned char texels[16 * 4];
+				decode_bc_block(task.blocks + (by * blocks_x + bx) * block_size, format, texels);
+
+				// Blocks on the right and bottom edges of odd sized levels are cropped
+				int copy_w = task.width - bx * 4 < 4 ? task.width - bx * 4 : 4;
+				for (int y = 0; y < 4 && by * 4 + y < task.height; y++) {
+					memcpy(task.rgba + ((by * 4 + y) * task.width + bx * 4) * 4, texels + y * 16, copy_w * 4);
+				}
+			}
+		}
+	});
+}
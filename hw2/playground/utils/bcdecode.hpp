@@ -0,0 +1,35 @@
+#ifndef BCDECODE_HPP
+#define BCDECODE_HPP
+
+#include <vector>
+
+// Block compressed formats loadDDS understands
+enum BCFormat {
+	BC_FORMAT_BC1, // DXT1
+	BC_FORMAT_BC2, // DXT3
+	BC_FORMAT_BC3  // DXT5
+};
+
+// Bytes per 4x4 block
+int bc_block_size(BCFormat format);
+
+// RGBA8 mip chain, level i is max(1, width >> i) x max(1, height >> i)
+struct DecodedImage {
+	int width;
+	int height;
+	std::vector< std::vector<unsigned char> > levels;
+
+	DecodedImage() : width(0), height(0) {}
+};
+
+// Decode one 4x4 block into 16 RGBA8 texels (64 bytes, row by row)
+void decode_bc_block(const unsigned char* block, BCFormat format, unsigned char* rgba);
+
+// Decode a whole mip chain stored back to back like in a .DDS file.
+// Block rows of every level are spread over the thread pool.
+void decode_bc_levels(
+	const unsigned char* data, int width, int height, int level_count,
+	BCFormat format, DecodedImage& image
+);
+
+#endif
@@ -0,0 +1,285 @@
+#include <string.h>
+#include <vector>
+
+#include "simd.hpp"
+#include "threadpool.hpp"
+#include "bcencode.hpp"
+
+
+void generate_mipmaps(DecodedImage& image) {
+	image.levels.resize(1);
+	int w = image.width;
+	int h = image.height;
+	while (w > 1 || h > 1) {
+		int next_w = w > 1 ? w / 2 : 1;
+		int next_h = h > 1 ? h / 2 : 1;
+		image.levels.push_back(std::vector<unsigned char>(next_w * next_h * 4));
+		const unsigned char* src = &image.levels[image.levels.size() - 2][0];
+		unsigned char* dst = &image.levels.back()[0];
+
+		// 2x2 average, the second row / column is clamped on 1 texel wide levels
+		int src_w = w;
+		int src_h = h;
+		get_thread_pool().parallel_for(next_h, [&](int y) {
+			int y0 = y * 2;
+			int y1 = y0 + 1 < src_h ? y0 + 1 : y0;
+			for (int x = 0; x < next_w; x++) {
+				int x0 = x * 2;
+				int x1 = x0 + 1 < src_w ? x0 + 1 : x0;
+				for (int c = 0; c < 4; c++) {
+					unsigned int sum = src[(y0 * src_w + x0) * 4 + c] + src[(y0 * src_w + x1) * 4 + c] +
+						src[(y1 * src_w + x0) * 4 + c] + src[(y1 * src_w + x1) * 4 + c];
+					dst[(y * next_w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		});
+
+		w = next_w;
+		h = next_h;
+	}
+}
+
+static unsigned int pack_565(const unsigned char* rgb) {
+	return ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+}
+
+// Same bit replication as the decoder
+static void expand_565(unsigned int c, int* rgb) {
+	int r = (c >> 11) & 31;
+	int g = (c >> 5) & 63;
+	int b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Color part of a block, always in 4 color mode (c0 > c1)
+static void encode_color_block(const unsigned char* rgba, unsigned char* block) {
+	unsigned char min_color[4], max_color[4];
+
+#ifdef SIMD_SSE2
+	__m128i t0 = _mm_loadu_si128((const __m128i*)(rgba + 0));
+	__m128i t1 = _mm_loadu_si128((const __m128i*)(rgba + 16));
+	__m128i t2 = _mm_loadu_si128((const __m128i*)(rgba + 32));
+	__m128i t3 = _mm_loadu_si128((const __m128i*)(rgba + 48));
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(t0, t1), _mm_min_epu8(t2, t3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(t0, t1), _mm_max_epu8(t2, t3));
+	// Fold the 4 texels of the register
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, 0x4E));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, 0xB1));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, 0x4E));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, 0xB1));
+	int packed_min = _mm_cvtsi128_si32(lo);
+	int packed_max = _mm_cvtsi128_si32(hi);
+	memcpy(min_color, &packed_min, 4);
+	memcpy(max_color, &packed_max, 4);
+#else
+	memcpy(min_color, rgba, 4);
+	memcpy(max_color, rgba, 4);
+	for (int i = 1; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			unsigned char v = rgba[i * 4 + c];
+			if (v < min_color[c]) min_color[c] = v;
+			if (v > max_color[c]) max_color[c] = v;
+		}
+	}
+#endif
+
+	// Pull the endpoints in by 1/16 of the range, the extremes are rarely worth a palette entry
+	for (int c = 0; c < 3; c++) {
+		int inset = (max_color[c] - min_color[c]) >> 4;
+		min_color[c] += inset;
+		max_color[c] -= inset;
+	}
+
+	// max >= min on every channel, so c0 >= c1
+	unsigned int c0 = pack_565(max_color);
+	unsigned int c1 = pack_565(min_color);
+	block[0] = c0 & 0xff;
+	block[1] = c0 >> 8;
+	block[2] = c1 & 0xff;
+	block[3] = c1 >> 8;
+	if (c0 == c1) {
+		// Flat block, every texel takes c0
+		memset(block + 4, 0, 4);
+		return;
+	}
+
+	// Project the texels on the line between the endpoints the decoder will see
+	int e0[3], e1[3], axis[3];
+	expand_565(c0, e0);
+	expand_565(c1, e1);
+	for (int c = 0; c < 3; c++)
+		axis[c] = e0[c] - e1[c];
+	int dot_min = e1[0] * axis[0] + e1[1] * axis[1] + e1[2] * axis[2];
+	int dot_max = e0[0] * axis[0] + e0[1] * axis[1] + e0[2] * axis[2];
+	float scale = 3.0f / (dot_max - dot_min);
+
+	// Steps from c1 to c0 -> palette index
+	static const unsigned int step_to_index[4] = { 1, 3, 2, 0 };
+
+	int steps[16];
+#ifdef SIMD_SSE2
+	__m128i zero = _mm_setzero_si128();
+	__m128i axis16 = _mm_setr_epi16(axis[0], axis[1], axis[2], 0, axis[0], axis[1], axis[2], 0);
+	__m128 offset = _mm_set1_ps((float)dot_min);
+	for (int i = 0; i < 4; i++) {
+		__m128i texels = _mm_loadu_si128((const __m128i*)(rgba + i * 16));
+		// r*ar + g*ag and b*ab for two texels in each register
+		__m128 a = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(texels, zero), axis16));
+		__m128 b = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(texels, zero), axis16));
+		__m128i dots = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)))
+		);
+		// Same float operations as the scalar path, so both give the same blocks
+		__m128 t = _mm_sub_ps(_mm_cvtepi32_ps(dots), offset);
+		t = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(scale)), _mm_set1_ps(0.5f));
+		__m128i step = _mm_cvttps_epi32(t);
+		step = _mm_packs_epi32(step, step);
+		step = _mm_min_epi16(_mm_max_epi16(step, zero), _mm_set1_epi16(3));
+		step = _mm_unpacklo_epi16(step, zero);
+		_mm_storeu_si128((__m128i*)(steps + i * 4), step);
+	}
+#else
+	for (int i = 0; i < 16; i++) {
+		const unsigned char* texel = rgba + i * 4;
+		int dot = texel[0] * axis[0] + texel[1] * axis[1] + texel[2] * axis[2];
+		int step = (int)(((float)dot - (float)dot_min) * scale + 0.5f);
+		steps[i] = step < 0 ? 0 : (step > 3 ? 3 : step);
+	}
+#endif
+
+	unsigned int indices = 0;
+	for (int i = 0; i < 16; i++)
+		indices |= step_to_index[steps[i]] << (i * 2);
+	block[4] = indices & 0xff;
+	block[5] = (indices >> 8) & 0xff;
+	block[6] = (indices >> 16) & 0xff;
+	block[7] = indices >> 24;
+}
+
+// BC3 alpha, always in 8 value mode (a0 > a1)
+static void encode_interpolated_alpha(const unsigned char* rgba, unsigned char* block) {
+	int min_alpha = 255, max_alpha = 0;
+	for (int i = 0; i < 16; i++) {
+		int a = rgba[i * 4 + 3];
+		if (a < min_alpha) min_alpha = a;
+		if (a > max_alpha) max_alpha = a;
+	}
+
+	block[0] = (unsigned char)max_alpha;
+	block[1] = (unsigned char)min_alpha;
+	if (max_alpha == min_alpha) {
+		memset(block + 2, 0, 6);
+		return;
+	}
+
+	// Steps from a1 to a0 -> palette index
+	static const unsigned int step_to_index[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+	float scale = 7.0f / (max_alpha - min_alpha);
+
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++) {
+		int step = (int)((rgba[i * 4 + 3] - min_alpha) * scale + 0.5f);
+		if (step > 7) step = 7;
+		bits |= (unsigned long long)step_to_index[step] << (i * 3);
+	}
+	for (int k = 0; k < 6; k++)
+		block[2 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+void encode_bc_block(const unsigned char* rgba, BCFormat format, unsigned char* block) {
+	if (format == BC_FORMAT_BC1) {
+		encode_color_block(rgba, block);
+		return;
+	}
+
+	if (format == BC_FORMAT_BC2) {
+		// Explicit 4-bit alpha
+		memset(block, 0, 8);
+		for (int i = 0; i < 16; i++) {
+			unsigned int a = (rgba[i * 4 + 3] * 15 + 127) / 255;
+			block[i / 2] |= a << ((i % 2) * 4);
+		}
+	} else {
+		encode_interpolated_alpha(rgba, block);
+	}
+
+	encode_color_block(rgba, block + 8);
+}
+
+
+void encode_bc_levels(const DecodedImage& image, BCFormat format, std::vector<unsigned char>& data) {
+	// Block rows handed to a single task
+	const int rows_per_task = 8;
+
+	struct Task {
+		const unsigned char* rgba;
+		unsigned char* blocks;
+		int width, height;
+		int first_row, row_count;
+	};
+
+	int block_size = bc_block_size(format);
+	size_t total_size = 0;
+	for (size_t level = 0; level < image.levels.size(); level++) {
+		int w = image.width >> level;
+		int h = image.height >> level;
+		if (w < 1) w = 1;
+		if (h < 1) h = 1;
+		total_size += ((w + 3) / 4) * ((h + 3) / 4) * block_size;
+	}
+	data.resize(total_size);
+
+	std::vector<Task> tasks;
+	size_t offset = 0;
+	for (size_t level = 0; level < image.levels.size(); level++) {
+		int w = image.width >> level;
+		int h = image.height >> level;
+		if (w < 1) w = 1;
+		if (h < 1) h = 1;
+		int blocks_x = (w + 3) / 4;
+		int blocks_y = (h + 3) / 4;
+
+		for (int row = 0; row < blocks_y; row += rows_per_task) {
+			Task task;
+			task.rgba = &image.levels[level][0];
+			task.blocks = &data[offset];
+			task.width = w;
+			task.height = h;
+			task.first_row = row;
+			task.row_count = row + rows_per_task < blocks_y ? rows_per_task : blocks_y - row;
+			tasks.push_back(task);
+		}
+		offset += blocks_x * blocks_y * block_size;
+	}
+
+	get_thread_pool().parallel_for((int)tasks.size(), [&](int t) {
+		const Task& task = tasks[t];
+		int blocks_x = (task.width + 3) / 4;
+		for (int by = task.first_row; by < task.first_row + task.row_count; by++) {
+			for (int bx = 0; bx < blocks_x; bx++) {
+				// Blocks on the right and bottom edges of odd sized levels repeat the last texels
+				unsigned char texels[16 * 4];
+				for (int y = 0; y < 4; y++) {
+					int sy = by * 4 + y < task.height ? by * 4 + y : task.height - 1;
+					for (int x = 0; x < 4; x++) {
+						int sx = bx * 4 + x < task.width ? bx * 4 + x : task.width - 1;
+						memcpy(texels + (y * 4 + x) * 4, task.rgba + (sy * task.width + sx) * 4, 4);
+					}
+				}
+				encode_bc_block(texels, format, task.blocks + (by * blocks_x + bx) * block_size);
+			}
+		}
+	});
+}
+
+BCFormat choose_bc_format(const DecodedImage& image) {
+	const std::vector<unsigned char>& texels = image.levels[0];
+	for (size_t i = 3; i < texels.size(); i += 4) {
+		if (texels[i] != 255)
+			return BC_FORMAT_BC3;
+	}
+	return BC_FORMAT_BC1;
+}
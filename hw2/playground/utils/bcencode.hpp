@@ -0,0 +1,23 @@
+#ifndef BCENCODE_HPP
+#define BCENCODE_HPP
+
+#include <vector>
+
+#include "bcdecode.hpp"
+
+// Box filtered mip chain down to 1x1, built from level 0
+void generate_mipmaps(DecodedImage& image);
+
+// Encode 16 RGBA8 texels (64 bytes, row by row) into one BC1 or BC3 block.
+// Real-time quality : the endpoints are the inset bounding box of the colors,
+// texels are assigned by projecting them on the line between the endpoints.
+void encode_bc_block(const unsigned char* rgba, BCFormat format, unsigned char* block);
+
+// Encode every level of the image back to back, the layout of a .DDS file.
+// Block rows of every level are spread over the thread pool.
+void encode_bc_levels(const DecodedImage& image, BCFormat format, std::vector<unsigned char>& data);
+
+// BC3 when some texel is not opaque, BC1 otherwise
+BCFormat choose_bc_format(const DecodedImage& image);
+
+#endif
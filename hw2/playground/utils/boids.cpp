@@ -0,0 +1,275 @@
+#include <math.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "simd.hpp"
+#include "threadpool.hpp"
+#include "boids.hpp"
+
+
+// Agents handed to a single task
+static const int agents_per_task = 256;
+
+BoidSettings::BoidSettings() {
+	neighbour_radius = 2.0f;
+	separation_radius = 0.8f;
+	max_speed = 3.0f;
+	max_force = 6.0f;
+	keep_distance = 4.0f;
+
+	separation_weight = 1.5f;
+	alignment_weight = 1.0f;
+	cohesion_weight = 0.6f;
+	seek_weight = 1.0f;
+}
+
+static unsigned int hash_cell(int cx, int cy, int cz) {
+	return (unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u ^ (unsigned int)cz * 83492791u;
+}
+
+static void limit_length(glm::vec3& v, float max_length) {
+	float length2 = glm::dot(v, v);
+	if (length2 > max_length * max_length)
+		v *= max_length / sqrtf(length2);
+}
+
+void BoidSwarm::resize(int count) {
+	px.resize(count);
+	py.resize(count);
+	pz.resize(count);
+	vx.resize(count);
+	vy.resize(count);
+	vz.resize(count);
+}
+
+void BoidSwarm::build_grid() {
+	int count = size();
+	float inv_cell = 1.0f / settings.neighbour_radius;
+
+	unsigned int table_size = 1024;
+	while (table_size < (unsigned int)count * 2)
+		table_size *= 2;
+	table_mask = table_size - 1;
+
+	cell_of.resize(count);
+	get_thread_pool().parallel_for((count + agents_per_task - 1) / agents_per_task, [&](int task) {
+		int end = (task + 1) * agents_per_task < count ? (task + 1) * agents_per_task : count;
+		for (int i = task * agents_per_task; i < end; i++) {
+			int cx = (int)floorf(px[i] * inv_cell);
+			int cy = (int)floorf(py[i] * inv_cell);
+			int cz = (int)floorf(pz[i] * inv_cell);
+			cell_of[i] = hash_cell(cx, cy, cz) & table_mask;
+		}
+	});
+
+	// Counting sort by cell, stable so the order only depends on the input
+	cell_start.assign(table_size + 1, 0);
+	for (int i = 0; i < count; i++)
+		cell_start[cell_of[i] + 1]++;
+	for (unsigned int c = 0; c < table_size; c++)
+		cell_start[c + 1] += cell_start[c];
+
+	order.resize(count);
+	std::vector<int> cursor(cell_start.begin(), cell_start.end() - 1);
+	for (int i = 0; i < count; i++)
+		order[cursor[cell_of[i]]++] = i;
+
+	// 3 more for the reads past the last run
+	sx.resize(count + 3);
+	sy.resize(count + 3);
+	sz.resize(count + 3);
+	svx.resize(count + 3);
+	svy.resize(count + 3);
+	svz.resize(count + 3);
+	get_thread_pool().parallel_for((count + agents_per_task - 1) / agents_per_task, [&](int task) {
+		int end = (task + 1) * agents_per_task < count ? (task + 1) * agents_per_task : count;
+		for (int k = task * agents_per_task; k < end; k++) {
+			int i = order[k];
+			sx[k] = px[i];
+			sy[k] = py[i];
+			sz[k] = pz[i];
+			svx[k] = vx[i];
+			svy[k] = vy[i];
+			svz[k] = vz[i];
+		}
+	});
+}
+
+// Sums over the neighbours of one agent, 4 lanes wide with SSE2
+struct Neighbourhood {
+#ifdef SIMD_SSE2
+	__m128 count;
+	__m128 px, py, pz;
+	__m128 vx, vy, vz;
+	__m128 sx, sy, sz;
+
+	void clear() {
+		count = px = py = pz = vx = vy = vz = sx = sy = sz = _mm_setzero_ps();
+	}
+#else
+	float count;
+	float px, py, pz;
+	float vx, vy, vz;
+	float sx, sy, sz;
+
+	void clear() {
+		count = px = py = pz = vx = vy = vz = sx = sy = sz = 0;
+	}
+#endif
+};
+
+#ifdef SIMD_SSE2
+static float horizontal_sum(__m128 v) {
+	float lanes[4];
+	_mm_storeu_ps(lanes, v);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+// Neighbours among the agents [begin, end) of one cell run.
+// The SSE2 path reads up to 3 agents past the run, the arrays are padded for it.
+static inline void scan_run(
+	const float* sx, const float* sy, const float* sz,
+	const float* svx, const float* svy, const float* svz,
+	int begin, int end, glm::vec3 p, float radius2, float separation2, Neighbourhood& n
+) {
+#ifdef SIMD_SSE2
+	__m128 x = _mm_set1_ps(p.x), y = _mm_set1_ps(p.y), z = _mm_set1_ps(p.z);
+	__m128 zero = _mm_setzero_ps();
+	__m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+	for (int j = begin; j < end; j += 4) {
+		__m128 ox = _mm_loadu_ps(sx + j), oy = _mm_loadu_ps(sy + j), oz = _mm_loadu_ps(sz + j);
+		__m128 dx = _mm_sub_ps(ox, x), dy = _mm_sub_ps(oy, y), dz = _mm_sub_ps(oz, z);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		// Lanes past the end of the run, the agent itself and exact duplicates (distance 0) don't count
+		__m128 valid = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(end - j), lane));
+		valid = _mm_and_ps(valid, _mm_cmpgt_ps(d2, zero));
+		__m128 in_range = _mm_and_ps(_mm_cmplt_ps(d2, _mm_set1_ps(radius2)), valid);
+		__m128 too_close = _mm_and_ps(_mm_cmplt_ps(d2, _mm_set1_ps(separation2)), valid);
+
+		n.count = _mm_add_ps(n.count, _mm_and_ps(in_range, _mm_set1_ps(1.0f)));
+		n.px = _mm_add_ps(n.px, _mm_and_ps(in_range, ox));
+		n.py = _mm_add_ps(n.py, _mm_and_ps(in_range, oy));
+		n.pz = _mm_add_ps(n.pz, _mm_and_ps(in_range, oz));
+		n.vx = _mm_add_ps(n.vx, _mm_and_ps(in_range, _mm_loadu_ps(svx + j)));
+		n.vy = _mm_add_ps(n.vy, _mm_and_ps(in_range, _mm_loadu_ps(svy + j)));
+		n.vz = _mm_add_ps(n.vz, _mm_and_ps(in_range, _mm_loadu_ps(svz + j)));
+
+		// Pushed away by d / |d|^2 : stronger the closer they are
+		__m128 inv = _mm_and_ps(too_close, _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(d2, _mm_set1_ps(1e-6f))));
+		n.sx = _mm_sub_ps(n.sx, _mm_mul_ps(dx, inv));
+		n.sy = _mm_sub_ps(n.sy, _mm_mul_ps(dy, inv));
+		n.sz = _mm_sub_ps(n.sz, _mm_mul_ps(dz, inv));
+	}
+#else
+	for (int j = begin; j < end; j++) {
+		float dx = sx[j] - p.x, dy = sy[j] - p.y, dz = sz[j] - p.z;
+		float d2 = dx * dx + dy * dy + dz * dz;
+		if (d2 <= 0 || d2 >= radius2)
+			continue;
+		n.count += 1;
+		n.px += sx[j];
+		n.py += sy[j];
+		n.pz += sz[j];
+		n.vx += svx[j];
+		n.vy += svy[j];
+		n.vz += svz[j];
+		if (d2 < separation2) {
+			n.sx -= dx / d2;
+			n.sy -= dy / d2;
+			n.sz -= dz / d2;
+		}
+	}
+#endif
+}
+
+void BoidSwarm::update(glm::vec3 target, float deltaTime) {
+	int count = size();
+	if (count == 0)
+		return;
+
+	build_grid();
+
+	const BoidSettings& s = settings;
+	float inv_cell = 1.0f / s.neighbour_radius;
+	float radius2 = s.neighbour_radius * s.neighbour_radius;
+	float separation2 = s.separation_radius * s.separation_radius;
+
+	get_thread_pool().parallel_for((count + agents_per_task - 1) / agents_per_task, [&](int task) {
+		int end = (task + 1) * agents_per_task < count ? (task + 1) * agents_per_task : count;
+		for (int k = task * agents_per_task; k < end; k++) {
+			glm::vec3 p(sx[k], sy[k], sz[k]);
+			glm::vec3 v(svx[k], svy[k], svz[k]);
+
+			Neighbourhood n;
+			n.clear();
+
+			// 27 surrounding cells; two of them may hash to the same run, scan it once
+			int cx = (int)floorf(p.x * inv_cell);
+			int cy = (int)floorf(p.y * inv_cell);
+			int cz = (int)floorf(p.z * inv_cell);
+			unsigned int visited[27];
+			int visited_count = 0;
+			for (int dz = -1; dz <= 1; dz++) {
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						unsigned int cell = hash_cell(cx + dx, cy + dy, cz + dz) & table_mask;
+						bool seen = false;
+						for (int i = 0; i < visited_count && !seen; i++)
+							seen = visited[i] == cell;
+						if (seen)
+							continue;
+						visited[visited_count++] = cell;
+
+						scan_run(&sx[0], &sy[0], &sz[0], &svx[0], &svy[0], &svz[0],
+							cell_start[cell], cell_start[cell + 1], p, radius2, separation2, n);
+					}
+				}
+			}
+
+#ifdef SIMD_SSE2
+			float neighbour_count = horizontal_sum(n.count);
+			glm::vec3 position_sum(horizontal_sum(n.px), horizontal_sum(n.py), horizontal_sum(n.pz));
+			glm::vec3 velocity_sum(horizontal_sum(n.vx), horizontal_sum(n.vy), horizontal_sum(n.vz));
+			glm::vec3 separation(horizontal_sum(n.sx), horizontal_sum(n.sy), horizontal_sum(n.sz));
+#else
+			float neighbour_count = n.count;
+			glm::vec3 position_sum(n.px, n.py, n.pz);
+			glm::vec3 velocity_sum(n.vx, n.vy, n.vz);
+			glm::vec3 separation(n.sx, n.sy, n.sz);
+#endif
+
+			glm::vec3 steer = separation * s.separation_weight;
+			if (neighbour_count > 0) {
+				glm::vec3 alignment = velocity_sum / neighbour_count - v;
+				glm::vec3 cohesion = position_sum / neighbour_count - p;
+				steer += alignment * s.alignment_weight + cohesion * s.cohesion_weight;
+			}
+
+			// Seek the target, and back off when closer than keep_distance
+			glm::vec3 to_target = target - p;
+			float distance = glm::length(to_target);
+			if (distance > 1e-4f) {
+				float approach = (distance - s.keep_distance) / s.keep_distance;
+				approach = approach < -1 ? -1 : (approach > 1 ? 1 : approach);
+				glm::vec3 desired = to_target * (s.max_speed * approach / distance);
+				steer += (desired - v) * s.seek_weight;
+			}
+
+			limit_length(steer, s.max_force);
+			v += steer * deltaTime;
+			limit_length(v, s.max_speed);
+			p += v * deltaTime;
+
+			int i = order[k];
+			px[i] = p.x;
+			py[i] = p.y;
+			pz[i] = p.z;
+			vx[i] = v.x;
+			vy[i] = v.y;
+			vz[i] = v.z;
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#ifndef BOIDS_HPP
+#define BOIDS_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "memtrack.hpp"
+
+struct BoidSettings {
+	float neighbour_radius;   // alignment and cohesion range, also the grid cell size
+	float separation_radius;  // closer neighbours push each other away
+	float max_speed;
+	float max_force;          // steering acceleration limit
+	float keep_distance;      // the swarm circles the target at about this distance
+
+	float separation_weight;
+	float alignment_weight;
+	float cohesion_weight;
+	float seek_weight;
+
+	BoidSettings();
+};
+
+// Flocking agents seeking a target, with separation, alignment and cohesion.
+//
+// The agent data is a structure of arrays the caller fills and reads back.
+// Every update sorts the agents by grid cell (uniform grid of neighbour_radius
+// cells, hashed into a table twice the agent count), so a neighbour query only
+// scans the contiguous runs of the 27 surrounding cells. The steering of all
+// agents is then computed in parallel on the thread pool, 4 neighbours at a
+// time with SSE2. The result does not depend on the number of threads.
+class BoidSwarm {
+public:
+	// Counted under MEMORY_SWARM
+	typedef std::vector<float, TrackedAllocator<float, MEMORY_SWARM> > Floats;
+	typedef std::vector<int, TrackedAllocator<int, MEMORY_SWARM> > Ints;
+	typedef std::vector<unsigned int, TrackedAllocator<unsigned int, MEMORY_SWARM> > UInts;
+
+	BoidSettings settings;
+
+	Floats px, py, pz;
+	Floats vx, vy, vz;
+
+	void resize(int count);
+	int size() const { return px.size(); }
+
+	void update(glm::vec3 target, float deltaTime);
+
+private:
+	void build_grid();
+
+	// Agents in cell order
+	Ints order;
+	Floats sx, sy, sz;
+	Floats svx, svy, svz;
+
+	UInts cell_of;
+	Ints cell_start; // table_size + 1 entries, runs of agents per hashed cell
+	unsigned int table_mask;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string>
+
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "memtrack.hpp"
+#include "capture.hpp"
+
+
+FrameCapture::FrameCapture() {
+	width = height = samples = 0;
+	timings = NULL;
+	msaa_fbo = msaa_color = msaa_depth = 0;
+	resolve_fbo = resolve_color = resolve_depth = 0;
+	for (int i = 0; i < ring_size; i++) {
+		pbos[i] = 0;
+		queries[i] = 0;
+	}
+	head = count = 0;
+}
+
+bool FrameCapture::init(int width, int height, int samples, const char * output_prefix) {
+	this->width = width;
+	this->height = height;
+	this->samples = samples;
+	prefix = output_prefix;
+
+	std::string timings_path = prefix + "timings.csv";
+	timings = fopen(timings_path.c_str(), "w");
+	if (!timings) {
+		printf("%s could not be opened for writing\n", timings_path.c_str());
+		return false;
+	}
+	fprintf(timings, "frame,cpu_ms,gpu_ms\n");
+
+	// Single-sampled target, read back from
+	glGenFramebuffers(1, &resolve_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+	glGenRenderbuffers(1, &resolve_color);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolve_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	track_gpu_resource(GPU_RENDERBUFFER, resolve_color, "capture color", texture_bytes(GL_RGBA8, width, height, 1, 1),
+		GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_color);
+	glGenRenderbuffers(1, &resolve_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolve_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	track_gpu_resource(GPU_RENDERBUFFER, resolve_depth, "capture depth",
+		texture_bytes(GL_DEPTH_COMPONENT24, width, height, 1, 1), GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, resolve_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Offscreen framebuffer is incomplete\n");
+		return false;
+	}
+
+	// Multisampled target, the same as the window gets from GLFW_SAMPLES
+	if (samples > 0) {
+		glGenFramebuffers(1, &msaa_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, msaa_fbo);
+		glGenRenderbuffers(1, &msaa_color);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_color);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		track_gpu_resource(GPU_RENDERBUFFER, msaa_color, "capture MSAA color",
+			texture_bytes(GL_RGBA8, width, height, samples, 1), GL_RGBA8, width, height, 1, 1, samples);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa_color);
+		glGenRenderbuffers(1, &msaa_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_depth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+		track_gpu_resource(GPU_RENDERBUFFER, msaa_depth, "capture MSAA depth",
+			texture_bytes(GL_DEPTH_COMPONENT24, width, height, samples, 1), GL_DEPTH_COMPONENT24, width, height, 1, 1, samples);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, msaa_depth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			printf("Multisampled offscreen framebuffer is incomplete\n");
+			return false;
+		}
+	}
+
+	glGenBuffers(ring_size, pbos);
+	for (int i = 0; i < ring_size; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		track_gpu_resource(GPU_BUFFER, pbos[i], "capture readback", width * height * 4, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glGenQueries(ring_size, queries);
+
+	return true;
+}
+
+void FrameCapture::cleanup() {
+	if (timings)
+		fclose(timings);
+	timings = NULL;
+
+	glDeleteQueries(ring_size, queries);
+	delete_tracked_buffers(ring_size, pbos);
+	delete_tracked_renderbuffers(1, &resolve_color);
+	delete_tracked_renderbuffers(1, &resolve_depth);
+	glDeleteFramebuffers(1, &resolve_fbo);
+	if (msaa_fbo) {
+		delete_tracked_renderbuffers(1, &msaa_color);
+		delete_tracked_renderbuffers(1, &msaa_depth);
+		glDeleteFramebuffers(1, &msaa_fbo);
+	}
+}
+
+void FrameCapture::begin_frame() {
+	// The ring slot used by this frame must be free
+	if (count == ring_size)
+		retire_oldest();
+
+	int slot = (head + count) % ring_size;
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, samples > 0 ? msaa_fbo : resolve_fbo);
+	glViewport(0, 0, width, height);
+}
+
+void FrameCapture::end_frame(int frame_index, double cpu_ms, bool save_image) {
+	int slot = (head + count) % ring_size;
+
+	if (samples > 0) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+
+	if (save_image) {
+		// Only queues the copy, the data is mapped when the slot is retired
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_fbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	Pending& frame = pending[slot];
+	frame.frame_index = frame_index;
+	frame.cpu_ms = cpu_ms;
+	frame.save_image = save_image;
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	count++;
+
+	// Retire everything the GPU is already done with, without blocking
+	while (count > 0) {
+		GLenum state = glClientWaitSync(pending[head].fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			break;
+		retire_oldest();
+	}
+}
+
+void FrameCapture::finish() {
+	while (count > 0) {
+		retire_oldest();
+	}
+	if (timings)
+		fflush(timings);
+}
+
+void FrameCapture::retire_oldest() {
+	Pending& frame = pending[head];
+
+	glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	glDeleteSync(frame.fence);
+
+	GLuint64 gpu_ns = 0;
+	glGetQueryObjectui64v(queries[head], GL_QUERY_RESULT, &gpu_ns);
+	fprintf(timings, "%d,%.3f,%.3f\n", frame.frame_index, frame.cpu_ms, gpu_ns / 1000000.0);
+
+	if (frame.save_image) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+		const unsigned char* pixels = (const unsigned char*)glMapBufferRange(
+			GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT);
+		if (pixels) {
+			char name[32];
+			sprintf(name, "frame_%05d.bmp", frame.frame_index);
+			saveBMP((prefix + name).c_str(), width, height, pixels);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	head = (head + 1) % ring_size;
+	count--;
+}
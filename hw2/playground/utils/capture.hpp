@@ -0,0 +1,49 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#include <string>
+
+// Renders into an offscreen framebuffer and reads frames back asynchronously :
+// glReadPixels goes into one of a ring of pixel buffer objects and is only mapped
+// a few frames later, once its fence has signaled, so the GPU never has to drain.
+// Every retired frame adds a line to <prefix>timings.csv with the CPU time of the
+// frame and the GPU time measured by a GL_TIME_ELAPSED query.
+class FrameCapture {
+public:
+	FrameCapture();
+
+	// samples = 0 renders straight into the single-sampled resolve target
+	bool init(int width, int height, int samples, const char * output_prefix);
+	void cleanup();
+
+	void begin_frame();
+	void end_frame(int frame_index, double cpu_ms, bool save_image);
+
+	// Waits for all frames still in flight
+	void finish();
+
+private:
+	static const int ring_size = 3;
+
+	struct Pending {
+		int frame_index;
+		double cpu_ms;
+		bool save_image;
+		GLsync fence;
+	};
+
+	void retire_oldest();
+
+	int width, height, samples;
+	std::string prefix;
+	FILE * timings;
+
+	GLuint msaa_fbo, msaa_color, msaa_depth;
+	GLuint resolve_fbo, resolve_color, resolve_depth;
+	GLuint pbos[ring_size];
+	GLuint queries[ring_size];
+	Pending pending[ring_size];
+	int head, count;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+#include "memtrack.hpp"
+#include "clustered.hpp"
+
+
+// After the fireball texture on 0 and the particle emitters on 1
+static const int lights_texture_unit = 2;
+static const int cluster_texture_unit = 3;
+static const int index_texture_unit = 4;
+
+// Lights of a cluster past that many are dropped, in no particular order
+static const unsigned int max_cluster_lights = 256;
+
+
+LightingUniforms get_lighting_uniforms(GLuint program) {
+	LightingUniforms uniforms;
+	uniforms.LightsID = glGetUniformLocation(program, "Lights");
+	uniforms.ClusterLightsID = glGetUniformLocation(program, "ClusterLights");
+	uniforms.LightIndicesID = glGetUniformLocation(program, "LightIndices");
+	uniforms.ClusterCountID = glGetUniformLocation(program, "ClusterCount");
+	uniforms.ClusterTileScaleID = glGetUniformLocation(program, "ClusterTileScale");
+	uniforms.ClusterDepthID = glGetUniformLocation(program, "ClusterDepth");
+	uniforms.AmbientLightID = glGetUniformLocation(program, "AmbientLight");
+	return uniforms;
+}
+
+// Samplers of different types can't share a unit, even unused ones
+static void set_sampler_units(const LightingUniforms& uniforms) {
+	glUniform1i(uniforms.LightsID, lights_texture_unit);
+	glUniform1i(uniforms.ClusterLightsID, cluster_texture_unit);
+	glUniform1i(uniforms.LightIndicesID, index_texture_unit);
+}
+
+void set_unlit(const LightingUniforms& uniforms) {
+	set_sampler_units(uniforms);
+	glUniform3i(uniforms.ClusterCountID, 0, 0, 0);
+	glUniform3f(uniforms.AmbientLightID, 1, 1, 1);
+}
+
+static int tile_of(float ndc, int tiles) {
+	int tile = (int)floorf((ndc + 1) * 0.5f * tiles);
+	return std::min(std::max(tile, 0), tiles - 1);
+}
+
+// Squared distance from p to the box, 0 inside
+static float distance2(const glm::vec3& p, const glm::vec3& min, const glm::vec3& max) {
+	glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+	return glm::dot(d, d);
+}
+
+static GLuint create_buffer_texture(GLuint& buffer, GLenum format, size_t size, const char* label) {
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+	track_gpu_resource(GPU_BUFFER, buffer, label, size, GL_STREAM_DRAW);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	return texture;
+}
+
+// Orphans the storage of the last frame
+static void upload(GLuint buffer, const void* data, size_t size, const char* label) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+	if (size > 0)
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	track_gpu_resource(GPU_BUFFER, buffer, label, std::max(size, (size_t)16), GL_STREAM_DRAW);
+}
+
+
+ClusteredLights::ClusteredLights() {
+	tiles_x = tiles_y = slices = 0;
+	near = far = 0;
+	max_indices = 0;
+	light_buffer = light_texture = 0;
+	cluster_buffer = cluster_texture = 0;
+	index_buffer = index_texture = 0;
+	frame_count = 0;
+	light_total = 0;
+	index_total = 0;
+	max_cluster_lights_seen = 0;
+	truncated_frames = 0;
+	build_ms = 0;
+}
+
+bool ClusteredLights::init(int tiles_x, int tiles_y, int slices, float near, float far) {
+	this->tiles_x = tiles_x;
+	this->tiles_y = tiles_y;
+	this->slices = slices;
+	this->near = near;
+	this->far = far;
+
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	max_indices = max_texels;
+	int cluster_count = tiles_x * tiles_y * slices;
+	if (2 * cluster_count > max_texels) {
+		printf("%d clusters are more than the %d texels a buffer texture can have\n", cluster_count, max_texels);
+		return false;
+	}
+
+	slice_lights.resize(slices);
+	slice_indices.resize(slices);
+	cluster_data.assign(2 * cluster_count, 0);
+
+	light_texture = create_buffer_texture(light_buffer, GL_RGBA32F, 16, "cluster lights");
+	cluster_texture = create_buffer_texture(cluster_buffer, GL_RG32UI, cluster_data.size() * sizeof(unsigned int), "clusters");
+	index_texture = create_buffer_texture(index_buffer, GL_R32UI, 16, "cluster light indices");
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	return true;
+}
+
+void ClusteredLights::cleanup() {
+	delete_tracked_buffers(1, &light_buffer);
+	delete_tracked_buffers(1, &cluster_buffer);
+	delete_tracked_buffers(1, &index_buffer);
+	glDeleteTextures(1, &light_texture);
+	glDeleteTextures(1, &cluster_texture);
+	glDeleteTextures(1, &index_texture);
+	light_buffer = light_texture = 0;
+	cluster_buffer = cluster_texture = 0;
+	index_buffer = index_texture = 0;
+}
+
+int ClusteredLights::slice_of(float depth) const {
+	if (depth <= near)
+		return 0;
+	int slice = (int)(logf(depth / near) / logf(far / near) * slices);
+	return std::min(slice, slices - 1);
+}
+
+void ClusteredLights::update(const std::vector<PointLight>& lights, const glm::mat4& View, const glm::mat4& Projection) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// View space bounds of every light that reaches into the frustum. A point
+	// at depth d lands on ndc x = p00 * x / d - p20 : over the box around the
+	// sphere, the extremes are at its corners.
+	float p00 = Projection[0][0], p11 = Projection[1][1];
+	float p20 = Projection[2][0], p21 = Projection[2][1];
+	bounds.clear();
+	light_data.clear();
+	for (size_t i = 0; i < lights.size(); i++) {
+		glm::vec3 c = glm::vec3(View * glm::vec4(lights[i].position, 1));
+		float r = lights[i].radius;
+		float d0 = std::max(-c.z - r, near);
+		float d1 = std::min(-c.z + r, far);
+		if (d0 > d1)
+			continue;
+
+		float nx0 = 1e30f, nx1 = -1e30f, ny0 = 1e30f, ny1 = -1e30f;
+		float depths[2] = { d0, d1 };
+		for (int k = 0; k < 2; k++) {
+			for (int side = -1; side <= 1; side += 2) {
+				float nx = p00 * (c.x + side * r) / depths[k] - p20;
+				float ny = p11 * (c.y + side * r) / depths[k] - p21;
+				nx0 = std::min(nx0, nx);
+				nx1 = std::max(nx1, nx);
+				ny0 = std::min(ny0, ny);
+				ny1 = std::max(ny1, ny);
+			}
+		}
+		if (nx1 < -1 || nx0 > 1 || ny1 < -1 || ny0 > 1)
+			continue;
+
+		LightBounds b;
+		b.sphere = glm::vec4(c, r);
+		b.x0 = tile_of(nx0, tiles_x);
+		b.x1 = tile_of(nx1, tiles_x);
+		b.y0 = tile_of(ny0, tiles_y);
+		b.y1 = tile_of(ny1, tiles_y);
+		b.z0 = slice_of(d0);
+		b.z1 = slice_of(d1);
+		bounds.push_back(b);
+		light_data.push_back(glm::vec4(c, r));
+		light_data.push_back(glm::vec4(lights[i].color, 0));
+	}
+
+	for (int s = 0; s < slices; s++)
+		slice_lights[s].clear();
+	for (size_t i = 0; i < bounds.size(); i++) {
+		for (int s = bounds[i].z0; s <= bounds[i].z1; s++)
+			slice_lights[s].push_back(i);
+	}
+
+	get_thread_pool().parallel_for(slices, [&](int slice) {
+		assign_slice(slice, Projection);
+	});
+
+	// Slice lists one after the other, the offsets were relative to their slice
+	int tiles = tiles_x * tiles_y;
+	size_t total = 0;
+	for (int s = 0; s < slices; s++) {
+		unsigned int* clusters = &cluster_data[2 * s * tiles];
+		for (int t = 0; t < tiles; t++) {
+			clusters[2 * t] += total;
+			max_cluster_lights_seen = std::max(max_cluster_lights_seen, (int)clusters[2 * t + 1]);
+		}
+		total += slice_indices[s].size();
+	}
+	indices.resize(total);
+	total = 0;
+	for (int s = 0; s < slices; s++) {
+		std::copy(slice_indices[s].begin(), slice_indices[s].end(), indices.begin() + total);
+		total += slice_indices[s].size();
+	}
+
+	// Too many for the buffer texture : the last clusters lose their lights
+	if (total > (size_t)max_indices) {
+		for (size_t c = 0; c < cluster_data.size(); c += 2) {
+			unsigned int end = std::min(cluster_data[c] + cluster_data[c + 1], (unsigned int)max_indices);
+			cluster_data[c + 1] = end > cluster_data[c] ? end - cluster_data[c] : 0;
+		}
+		indices.resize(max_indices);
+		truncated_frames++;
+	}
+
+	upload(light_buffer, light_data.empty() ? NULL : &light_data[0], light_data.size() * sizeof(glm::vec4), "cluster lights");
+	upload(cluster_buffer, &cluster_data[0], cluster_data.size() * sizeof(unsigned int), "clusters");
+	upload(index_buffer, indices.empty() ? NULL : &indices[0], indices.size() * sizeof(unsigned int), "cluster light indices");
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	frame_count++;
+	light_total += bounds.size();
+	index_total += indices.size();
+	build_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// The clusters of one slice, a box in view space each : the tile corners at
+// the near and far depth of the slice, both unprojected
+void ClusteredLights::assign_slice(int slice, const glm::mat4& Projection) {
+	float p00 = Projection[0][0], p11 = Projection[1][1];
+	float p20 = Projection[2][0], p21 = Projection[2][1];
+	float d0 = near * powf(far / near, (float)slice / slices);
+	float d1 = near * powf(far / near, (float)(slice + 1) / slices);
+
+	const std::vector<int>& candidates = slice_lights[slice];
+	std::vector<unsigned int>& out = slice_indices[slice];
+	out.clear();
+	unsigned int* clusters = &cluster_data[2 * slice * tiles_x * tiles_y];
+	for (int ty = 0; ty < tiles_y; ty++) {
+		float ny0 = -1 + 2.0f * ty / tiles_y + p21;
+		float ny1 = -1 + 2.0f * (ty + 1) / tiles_y + p21;
+		float y0 = std::min(ny0 * d0, ny0 * d1) / p11;
+		float y1 = std::max(ny1 * d0, ny1 * d1) / p11;
+		for (int tx = 0; tx < tiles_x; tx++) {
+			float nx0 = -1 + 2.0f * tx / tiles_x + p20;
+			float nx1 = -1 + 2.0f * (tx + 1) / tiles_x + p20;
+			glm::vec3 min(std::min(nx0 * d0, nx0 * d1) / p00, y0, -d1);
+			glm::vec3 max(std::max(nx1 * d0, nx1 * d1) / p00, y1, -d0);
+
+			unsigned int offset = out.size();
+			unsigned int count = 0;
+			for (size_t k = 0; k < candidates.size() && count < max_cluster_lights; k++) {
+				const LightBounds& b = bounds[candidates[k]];
+				if (tx < b.x0 || tx > b.x1 || ty < b.y0 || ty > b.y1)
+					continue;
+				if (distance2(glm::vec3(b.sphere), min, max) > b.sphere.w * b.sphere.w)
+					continue;
+				out.push_back(candidates[k]);
+				count++;
+			}
+			unsigned int* cluster = clusters + 2 * (ty * tiles_x + tx);
+			cluster[0] = offset;
+			cluster[1] = count;
+		}
+	}
+}
+
+void ClusteredLights::bind(const LightingUniforms& uniforms, const glm::vec3& ambient) const {
+	glActiveTexture(GL_TEXTURE0 + lights_texture_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, light_texture);
+	glActiveTexture(GL_TEXTURE0 + cluster_texture_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, cluster_texture);
+	glActiveTexture(GL_TEXTURE0 + index_texture_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, index_texture);
+	glActiveTexture(GL_TEXTURE0);
+	set_sampler_units(uniforms);
+
+	// gl_FragCoord to tiles, for a viewport at the origin
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glUniform3i(uniforms.ClusterCountID, tiles_x, tiles_y, slices);
+	glUniform2f(uniforms.ClusterTileScaleID, (float)tiles_x / viewport[2], (float)tiles_y / viewport[3]);
+
+	// slice = log(depth) * x - y, slice_of() in the shader
+	float scale = slices / logf(far / near);
+	glUniform2f(uniforms.ClusterDepthID, scale, logf(near) * scale);
+	glUniform3fv(uniforms.AmbientLightID, 1, &ambient[0]);
+}
+
+void ClusteredLights::print_report() const {
+	if (frame_count == 0)
+		return;
+	printf("clustered lighting : %dx%dx%d clusters, %d frames, %.1f lights in view and %.1f light references per frame\n",
+		tiles_x, tiles_y, slices, frame_count, light_total / frame_count, index_total / frame_count);
+	printf("  at most %d lights in a cluster, %.3f ms per frame to build the clusters on %d threads\n",
+		max_cluster_lights_seen, build_ms / frame_count, get_thread_pool().size());
+	if (truncated_frames > 0)
+		printf("  light lists cut short in %d frames\n", truncated_frames);
+}
@@ -0,0 +1,93 @@
+#ifndef CLUSTERED_HPP
+#define CLUSTERED_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct PointLight {
+	glm::vec3 position; // world space
+	float radius;       // no light at all past it
+	glm::vec3 color;
+};
+
+// Uniforms of ClusteredLighting.fragmentshader in one program
+struct LightingUniforms {
+	GLint LightsID;
+	GLint ClusterLightsID;
+	GLint LightIndicesID;
+	GLint ClusterCountID;
+	GLint ClusterTileScaleID;
+	GLint ClusterDepthID;
+	GLint AmbientLightID;
+};
+
+LightingUniforms get_lighting_uniforms(GLuint program);
+
+// No light but the ambient one, which is white : the shaders draw the unlit
+// colors. For the program in use.
+void set_unlit(const LightingUniforms& uniforms);
+
+// Clustered forward lighting.
+//
+// The view frustum is cut into tiles_x * tiles_y screen tiles and slices depth
+// slices, exponentially spaced between the near and far planes. Every update
+// bounds the lights in view space, bins them by slice, then finds the clusters
+// each light touches, a slice per task on the thread pool. A cluster is
+// touched when the sphere of the light meets the bounding box of the cluster.
+// The slices write their own lists, which are concatenated in slice order so
+// the result does not depend on the number of threads.
+//
+// Three texture buffers go to the fragment shader : the lights (view space
+// position and radius, then color), an offset and a count per cluster, and the
+// light indices the offsets point into. A fragment finds its cluster from
+// gl_FragCoord and its view depth, and only loops over the lights listed there.
+class ClusteredLights {
+public:
+	ClusteredLights();
+
+	bool init(int tiles_x, int tiles_y, int slices, float near, float far);
+	void cleanup();
+
+	void update(const std::vector<PointLight>& lights, const glm::mat4& View, const glm::mat4& Projection);
+
+	// Binds the buffers to their texture units and sets the uniforms of the
+	// program in use. The tiles follow the viewport, set it first.
+	void bind(const LightingUniforms& uniforms, const glm::vec3& ambient) const;
+
+	void print_report() const;
+
+private:
+	struct LightBounds {
+		glm::vec4 sphere; // view space
+		int x0, x1, y0, y1, z0, z1; // clusters it may touch, inclusive
+	};
+
+	int slice_of(float depth) const;
+	void assign_slice(int slice, const glm::mat4& Projection);
+
+	int tiles_x, tiles_y, slices;
+	float near, far;
+	int max_indices; // of the index buffer texture
+
+	std::vector<LightBounds> bounds;
+	std::vector<std::vector<int> > slice_lights;
+	std::vector<std::vector<unsigned int> > slice_indices;
+	std::vector<glm::vec4> light_data;
+	std::vector<unsigned int> cluster_data; // offset, count
+	std::vector<unsigned int> indices;
+
+	GLuint light_buffer, light_texture;
+	GLuint cluster_buffer, cluster_texture;
+	GLuint index_buffer, index_texture;
+
+	// Report
+	int frame_count;
+	double light_total;
+	double index_total;
+	int max_cluster_lights_seen;
+	int truncated_frames;
+	double build_ms;
+};
+
+#endif
@@ -38,30 +38,8 @@ float speed = 3.0f; // 3 units / second
 float mouseSpeed = 0.005f;
 
 
-void computeMatricesFromInputs(){
-	// glfwGetTime is called only once, the first time this function is called
-	static double lastTime = glfwGetTime();
-
-	// Compute time difference between current and last frame
-	double currentTime = glfwGetTime();
-	float deltaTime = float(currentTime - lastTime);
-
-
-	// Get mouse position
-	double xpos, ypos;
-	glfwGetCursorPos(window, &xpos, &ypos);
-
-	int width, height;
-	glfwGetWindowSize(window, &width, &height);
-
-	// Reset mouse position for next frame
-	glfwSetCursorPos(window, float(width)/2, float(height)/2);
-
-	// Compute new orientation
-	horizontalAngle += mouseSpeed * (float(width)/2 - xpos);
-	verticalAngle   += mouseSpeed * (float(height)/2 - ypos);
-
-
+// Direction, right and up vectors for the current angles
+static void computeCameraVectors(glm::vec3& right, glm::vec3& up) {
 	// Direction : Spherical coordinates to Cartesian coordinates conversion
 	direction = glm::vec3(
 		cos(verticalAngle) * sin(horizontalAngle), 
@@ -70,14 +48,72 @@ void computeMatricesFromInputs(){
 	);
 	
 	// Right vector
-	glm::vec3 right = glm::vec3(
+	right = glm::vec3(
 		sin(horizontalAngle - 3.14f/2.0f), 
 		0,
 		cos(horizontalAngle - 3.14f/2.0f)
 	);
 	
 	// Up vector
-	glm::vec3 up = glm::cross( right, direction );
+	up = glm::cross( right, direction );
+}
+
+static void computeViewMatrix(glm::vec3 up) {
+	// Camera matrix
+	ViewMatrix       = glm::lookAt(
+								position,           // Camera is here
+								position+direction, // and looks here : at the same position, plus "direction"
+								up                  // Head is up (set to 0,-1,0 to look upside-down)
+						   );
+}
+
+// Used instead of computeMatricesFromInputs when there is no window to read input from
+void setCameraAngles(float horizontal, float vertical) {
+	horizontalAngle = horizontal;
+	verticalAngle = vertical;
+
+	glm::vec3 right, up;
+	computeCameraVectors(right, up);
+	computeViewMatrix(up);
+}
+
+
+// Saved and restored with the world snapshots
+void getCameraState(glm::vec3& position_out, float& horizontal, float& vertical) {
+	position_out = position;
+	horizontal = horizontalAngle;
+	vertical = verticalAngle;
+}
+
+void setCameraState(glm::vec3 new_position, float horizontal, float vertical) {
+	position = new_position;
+	setCameraAngles(horizontal, vertical);
+}
+
+
+// Mouse look : called for every cursor motion event, in the order they happened
+void rotateCamera(double dx, double dy) {
+	// Compute new orientation
+	horizontalAngle -= mouseSpeed * float(dx);
+	verticalAngle   -= mouseSpeed * float(dy);
+
+	glm::vec3 right, up;
+	computeCameraVectors(right, up);
+}
+
+
+void computeMatricesFromInputs(){
+	// glfwGetTime is called only once, the first time this function is called
+	static double lastTime = glfwGetTime();
+
+	// Compute time difference between current and last frame
+	double currentTime = glfwGetTime();
+	float deltaTime = float(currentTime - lastTime);
+
+
+	// The orientation comes from the cursor motion events (rotateCamera)
+	glm::vec3 right, up;
+	computeCameraVectors(right, up);
 
 
 	// Move forward
@@ -106,12 +142,7 @@ void computeMatricesFromInputs(){
 	}
 
 
-	// Camera matrix
-	ViewMatrix       = glm::lookAt(
-								position,           // Camera is here
-								position+direction, // and looks here : at the same position, plus "direction"
-								up                  // Head is up (set to 0,-1,0 to look upside-down)
-						   );
+	computeViewMatrix(up);
 
 	// For the next frame, the "last time" will be "now"
 	lastTime = currentTime;
@@ -2,3 +2,7 @@ void computeMatricesFromInputs();
 glm::mat4 getViewMatrix();
 glm::vec3 getCameraPosition();
 glm::vec3 getCameraDirection();
+void setCameraAngles(float horizontal, float vertical);
+void getCameraState(glm::vec3& position, float& horizontal, float& vertical);
+void setCameraState(glm::vec3 position, float horizontal, float vertical);
+void rotateCamera(double dx, double dy);
@@ -0,0 +1,349 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "bcdecode.hpp"
+#include "dds.hpp"
+
+#define FOURCC(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+#define FOURCC_DXT1 FOURCC('D', 'X', 'T', '1')
+#define FOURCC_DXT2 FOURCC('D', 'X', 'T', '2')
+#define FOURCC_DXT3 FOURCC('D', 'X', 'T', '3')
+#define FOURCC_DXT4 FOURCC('D', 'X', 'T', '4')
+#define FOURCC_DXT5 FOURCC('D', 'X', 'T', '5')
+#define FOURCC_ATI1 FOURCC('A', 'T', 'I', '1')
+#define FOURCC_BC4U FOURCC('B', 'C', '4', 'U')
+#define FOURCC_BC4S FOURCC('B', 'C', '4', 'S')
+#define FOURCC_ATI2 FOURCC('A', 'T', 'I', '2')
+#define FOURCC_BC5U FOURCC('B', 'C', '5', 'U')
+#define FOURCC_BC5S FOURCC('B', 'C', '5', 'S')
+#define FOURCC_DX10 FOURCC('D', 'X', '1', '0')
+
+// Header layout, offsets from the start of the file (after the "DDS " magic)
+#define DDS_HEADER_SIZE        124
+#define DDS_DX10_HEADER_SIZE   20
+#define DDSD_CAPS              0x1
+#define DDSD_HEIGHT            0x2
+#define DDSD_WIDTH             0x4
+#define DDSD_PIXELFORMAT       0x1000
+#define DDSD_MIPMAPCOUNT       0x20000
+#define DDSD_LINEARSIZE        0x80000
+#define DDSCAPS_COMPLEX        0x8
+#define DDSCAPS_TEXTURE        0x1000
+#define DDSCAPS_MIPMAP         0x400000
+#define DDPF_ALPHAPIXELS       0x1
+#define DDPF_FOURCC            0x4
+#define DDPF_RGB               0x40
+#define DDSCAPS2_CUBEMAP       0x200
+#define DDSCAPS2_CUBEMAP_ALL   0xFC00
+#define DDSCAPS2_VOLUME        0x200000
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+#define DDS_DIMENSION_TEXTURE2D 3
+
+// The DXGI_FORMAT values we can upload
+enum {
+	DXGI_FORMAT_R8G8B8A8_UNORM      = 28,
+	DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DXGI_FORMAT_BC1_UNORM           = 71,
+	DXGI_FORMAT_BC1_UNORM_SRGB      = 72,
+	DXGI_FORMAT_BC2_UNORM           = 74,
+	DXGI_FORMAT_BC2_UNORM_SRGB      = 75,
+	DXGI_FORMAT_BC3_UNORM           = 77,
+	DXGI_FORMAT_BC3_UNORM_SRGB      = 78,
+	DXGI_FORMAT_BC4_UNORM           = 80,
+	DXGI_FORMAT_BC4_SNORM           = 81,
+	DXGI_FORMAT_BC5_UNORM           = 83,
+	DXGI_FORMAT_BC5_SNORM           = 84,
+	DXGI_FORMAT_B8G8R8A8_UNORM      = 87,
+	DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+	DXGI_FORMAT_BC6H_UF16           = 95,
+	DXGI_FORMAT_BC6H_SF16           = 96,
+	DXGI_FORMAT_BC7_UNORM           = 98,
+	DXGI_FORMAT_BC7_UNORM_SRGB      = 99
+};
+
+// Until set_dds_limits() is given the driver's, the D3D11 ones : without a GL
+// context (the software renderer) nothing larger can be used anyway
+static unsigned int max_dds_size = 16384;
+static unsigned int max_dds_layers = 2048;
+
+void set_dds_limits(int max_texture_size, int max_array_layers) {
+	if (max_texture_size > 0)
+		max_dds_size = max_texture_size;
+	if (max_array_layers > 0)
+		max_dds_layers = max_array_layers;
+}
+
+// The mapping has no alignment guarantees past the magic
+static unsigned int read_u32(const unsigned char * p) {
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static void write_u32(unsigned char * p, unsigned int v) {
+	memcpy(p, &v, 4);
+}
+
+static void set_compressed(DDSImage & image, unsigned int gl_format, unsigned int block_size, int bc_format) {
+	image.compressed = true;
+	image.gl_format = gl_format;
+	image.block_size = block_size;
+	image.bc_format = bc_format;
+}
+
+static void set_uncompressed(DDSImage & image, unsigned int gl_format, unsigned int gl_pixel_format) {
+	image.compressed = false;
+	image.gl_format = gl_format;
+	image.gl_pixel_format = gl_pixel_format;
+	image.block_size = 4;
+	image.bc_format = -1;
+}
+
+static bool set_dxgi_format(DDSImage & image, unsigned int dxgi_format) {
+	switch (dxgi_format) {
+	case DXGI_FORMAT_BC1_UNORM:      set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8, BC_FORMAT_BC1); break;
+	case DXGI_FORMAT_BC1_UNORM_SRGB: set_compressed(image, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8, -1); break;
+	case DXGI_FORMAT_BC2_UNORM:      set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16, BC_FORMAT_BC2); break;
+	case DXGI_FORMAT_BC2_UNORM_SRGB: set_compressed(image, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16, -1); break;
+	case DXGI_FORMAT_BC3_UNORM:      set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16, BC_FORMAT_BC3); break;
+	case DXGI_FORMAT_BC3_UNORM_SRGB: set_compressed(image, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16, -1); break;
+	case DXGI_FORMAT_BC4_UNORM:      set_compressed(image, GL_COMPRESSED_RED_RGTC1, 8, -1); break;
+	case DXGI_FORMAT_BC4_SNORM:      set_compressed(image, GL_COMPRESSED_SIGNED_RED_RGTC1, 8, -1); break;
+	case DXGI_FORMAT_BC5_UNORM:      set_compressed(image, GL_COMPRESSED_RG_RGTC2, 16, -1); break;
+	case DXGI_FORMAT_BC5_SNORM:      set_compressed(image, GL_COMPRESSED_SIGNED_RG_RGTC2, 16, -1); break;
+	case DXGI_FORMAT_BC6H_UF16:      set_compressed(image, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16, -1); break;
+	case DXGI_FORMAT_BC6H_SF16:      set_compressed(image, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16, -1); break;
+	case DXGI_FORMAT_BC7_UNORM:      set_compressed(image, GL_COMPRESSED_RGBA_BPTC_UNORM, 16, -1); break;
+	case DXGI_FORMAT_BC7_UNORM_SRGB: set_compressed(image, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16, -1); break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM:      set_uncompressed(image, GL_RGBA8, GL_RGBA); break;
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: set_uncompressed(image, GL_SRGB8_ALPHA8, GL_RGBA); break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:      set_uncompressed(image, GL_RGBA8, GL_BGRA); break;
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB: set_uncompressed(image, GL_SRGB8_ALPHA8, GL_BGRA); break;
+	default:
+		printf("Unsupported DXGI format %u\n", dxgi_format);
+		return false;
+	}
+	return true;
+}
+
+static bool set_legacy_format(DDSImage & image, const unsigned char * pixel_format) {
+	unsigned int flags = read_u32(pixel_format + 4);
+	unsigned int fourCC = read_u32(pixel_format + 8);
+
+	if (flags & DDPF_FOURCC) {
+		switch (fourCC) {
+		case FOURCC_DXT1: set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8, BC_FORMAT_BC1); break;
+		// DXT2 and DXT4 only differ by premultiplied alpha, the blocks are the same
+		case FOURCC_DXT2:
+		case FOURCC_DXT3: set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16, BC_FORMAT_BC2); break;
+		case FOURCC_DXT4:
+		case FOURCC_DXT5: set_compressed(image, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16, BC_FORMAT_BC3); break;
+		case FOURCC_ATI1:
+		case FOURCC_BC4U: set_compressed(image, GL_COMPRESSED_RED_RGTC1, 8, -1); break;
+		case FOURCC_BC4S: set_compressed(image, GL_COMPRESSED_SIGNED_RED_RGTC1, 8, -1); break;
+		case FOURCC_ATI2:
+		case FOURCC_BC5U: set_compressed(image, GL_COMPRESSED_RG_RGTC2, 16, -1); break;
+		case FOURCC_BC5S: set_compressed(image, GL_COMPRESSED_SIGNED_RG_RGTC2, 16, -1); break;
+		default:
+			printf("Unsupported DDS fourCC 0x%08x\n", fourCC);
+			return false;
+		}
+		return true;
+	}
+
+	// Plain 32bpp pixels, either byte order
+	unsigned int bit_count = read_u32(pixel_format + 12);
+	unsigned int r_mask = read_u32(pixel_format + 16);
+	if ((flags & DDPF_RGB) && bit_count == 32) {
+		if (r_mask == 0x000000ff) {
+			set_uncompressed(image, GL_RGBA8, GL_RGBA);
+			return true;
+		}
+		if (r_mask == 0x00ff0000) {
+			set_uncompressed(image, GL_RGBA8, GL_BGRA);
+			return true;
+		}
+	}
+
+	printf("Unsupported DDS pixel format (flags 0x%x, %u bits)\n", flags, bit_count);
+	return false;
+}
+
+// Bytes of one level, w and h are clamped to 1
+static uint64_t dds_level_size(const DDSImage & image, uint64_t w, uint64_t h) {
+	w = w > 1 ? w : 1;
+	h = h > 1 ? h : 1;
+	if (image.compressed)
+		return ((w + 3) / 4) * ((h + 3) / 4) * image.block_size;
+	return w * h * image.block_size;
+}
+
+bool parse_dds(const unsigned char * data, size_t size, DDSImage & image) {
+	if (size < 4 + DDS_HEADER_SIZE || strncmp((const char *)data, "DDS ", 4) != 0) {
+		printf("Not a correct DDS file\n");
+		return false;
+	}
+
+	const unsigned char * header = data + 4;
+	if (read_u32(header) != DDS_HEADER_SIZE || read_u32(header + 72) != 32) {
+		printf("Not a correct DDS file\n");
+		return false;
+	}
+
+	unsigned int flags       = read_u32(header + 4);
+	unsigned int height      = read_u32(header + 8);
+	unsigned int width       = read_u32(header + 12);
+	unsigned int mipMapCount = read_u32(header + 24);
+	unsigned int fourCC      = read_u32(header + 80);
+	unsigned int caps2       = read_u32(header + 108);
+
+	if (width == 0 || height == 0 || width > max_dds_size || height > max_dds_size) {
+		printf("Bad DDS size %ux%u\n", width, height);
+		return false;
+	}
+	if (caps2 & DDSCAPS2_VOLUME) {
+		printf("Volume DDS textures are not supported\n");
+		return false;
+	}
+
+	size_t offset = 4 + DDS_HEADER_SIZE;
+	unsigned int array_size = 1;
+	bool cubemap = (caps2 & DDSCAPS2_CUBEMAP) != 0;
+
+	if ((read_u32(header + 76) & DDPF_FOURCC) && fourCC == FOURCC_DX10) {
+		if (size < offset + DDS_DX10_HEADER_SIZE) {
+			printf("Truncated DX10 DDS header\n");
+			return false;
+		}
+		const unsigned char * dx10 = data + offset;
+		offset += DDS_DX10_HEADER_SIZE;
+
+		if (read_u32(dx10 + 4) != DDS_DIMENSION_TEXTURE2D) {
+			printf("Only 2D DDS textures are supported\n");
+			return false;
+		}
+		if (!set_dxgi_format(image, read_u32(dx10)))
+			return false;
+		cubemap = (read_u32(dx10 + 8) & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+		array_size = read_u32(dx10 + 12);
+		if (array_size == 0 || array_size > max_dds_layers) {
+			printf("Bad DDS array size %u\n", array_size);
+			return false;
+		}
+	} else {
+		if (!set_legacy_format(image, header + 72))
+			return false;
+		// Legacy cubemaps may leave faces out, GL needs all six
+		if (cubemap && (caps2 & DDSCAPS2_CUBEMAP_ALL) != DDSCAPS2_CUBEMAP_ALL) {
+			printf("Partial DDS cubemaps are not supported\n");
+			return false;
+		}
+	}
+
+	if (cubemap && (width != height || array_size != 1)) {
+		printf("Only single square DDS cubemaps are supported\n");
+		return false;
+	}
+
+	// Reject a mip count larger than the size allows
+	unsigned int max_levels = 1;
+	for (unsigned int s = width > height ? width : height; s > 1; s /= 2) {
+		max_levels++;
+	}
+	if (!(flags & DDSD_MIPMAPCOUNT) || mipMapCount == 0)
+		mipMapCount = 1;
+	if (mipMapCount > max_levels) {
+		printf("DDS file claims %u mipmaps, only %u fit\n", mipMapCount, max_levels);
+		return false;
+	}
+
+	// Sizes are 64 bits : with the limits above nothing can wrap, and the whole
+	// chain is checked against the file before anything is allocated for it
+	unsigned int layer_count = array_size * (cubemap ? 6 : 1);
+	uint64_t layer_size = 0;
+	for (unsigned int level = 0; level < mipMapCount; level++) {
+		layer_size += dds_level_size(image, width >> level, height >> level);
+	}
+	if (layer_size * layer_count > size - offset) {
+		printf("DDS file is truncated : %u layers of %llu bytes, %zu bytes left\n",
+			layer_count, (unsigned long long)layer_size, size - offset);
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.mip_count = mipMapCount;
+	image.cubemap = cubemap;
+	image.layer_count = layer_count;
+	image.levels.clear();
+	image.levels.reserve(layer_count * mipMapCount);
+
+	// Walk the real chain : every layer holds all of its mips, back to back
+	for (int layer = 0; layer < image.layer_count; layer++) {
+		unsigned int w = width;
+		unsigned int h = height;
+		for (unsigned int level = 0; level < mipMapCount; level++) {
+			uint64_t level_size = dds_level_size(image, w, h);
+
+			// GL takes the size of a level as a GLsizei
+			if (level_size > INT_MAX || level_size > size - offset) {
+				printf("DDS file is truncated : layer %d, mip %u ends at %llu of %zu bytes\n",
+					layer, level, (unsigned long long)(offset + level_size), size);
+				return false;
+			}
+
+			DDSLevel entry;
+			entry.data = data + offset;
+			entry.size = (unsigned int)level_size;
+			entry.width = w;
+			entry.height = h;
+			image.levels.push_back(entry);
+
+			offset += level_size;
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+
+	return true;
+}
+
+bool save_dds(const char * path, int width, int height, int mip_count, int bc_format,
+	const unsigned char * data, size_t size) {
+	unsigned char header[4 + DDS_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "DDS ", 4);
+
+	unsigned int fourCC = bc_format == BC_FORMAT_BC1 ? FOURCC_DXT1 : (bc_format == BC_FORMAT_BC2 ? FOURCC_DXT3 : FOURCC_DXT5);
+	unsigned int block_size = bc_block_size((BCFormat)bc_format);
+	unsigned char * h = header + 4;
+	write_u32(h, DDS_HEADER_SIZE);
+	write_u32(h + 4, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	write_u32(h + 8, height);
+	write_u32(h + 12, width);
+	write_u32(h + 16, ((width + 3) / 4) * ((height + 3) / 4) * block_size);
+	write_u32(h + 24, mip_count);
+	write_u32(h + 72, 32);
+	write_u32(h + 76, DDPF_FOURCC);
+	write_u32(h + 80, fourCC);
+	write_u32(h + 104, DDSCAPS_TEXTURE | (mip_count > 1 ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0));
+
+	FILE * file = fopen(path, "wb");
+	if (!file) {
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+	bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) && fwrite(data, 1, size, file) == size;
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok) {
+		printf("%s could not be written\n", path);
+		remove(path);
+	}
+	return ok;
+}
@@ -0,0 +1,49 @@
+#ifndef DDS_HPP
+#define DDS_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// One mip level of one layer, pointing into the file data
+struct DDSLevel {
+	const unsigned char * data;
+	unsigned int size;
+	int width;
+	int height;
+};
+
+// Description of a .DDS file : legacy headers (DXT1-5, ATI1/ATI2, 32bpp RGBA/BGRA)
+// and the DX10 extension (BC1-BC7 with their sRGB variants, RGBA8/BGRA8,
+// texture arrays and cubemaps).
+struct DDSImage {
+	int width;
+	int height;
+	int mip_count;
+	int layer_count;    // array size, times 6 for cubemaps
+	bool cubemap;
+
+	bool compressed;
+	unsigned int block_size;      // bytes per 4x4 block, or per pixel when not compressed
+	unsigned int gl_format;       // internal format for glCompressedTexImage* / glTexImage*
+	unsigned int gl_pixel_format; // GL_RGBA / GL_BGRA for uncompressed data
+	int bc_format;                // BCFormat the CPU decoder can handle, -1 if none
+
+	// layer_count * mip_count entries, all mips of layer 0 first (the file order)
+	std::vector<DDSLevel> levels;
+
+	const DDSLevel & level(int layer, int mip) const { return levels[layer * mip_count + mip]; }
+};
+
+// Largest width/height and array size parse_dds() accepts, from
+// GL_MAX_TEXTURE_SIZE and GL_MAX_ARRAY_TEXTURE_LAYERS once a context exists
+void set_dds_limits(int max_texture_size, int max_array_layers);
+
+// Parse and validate the header against the real size of the mip chain.
+// No data is copied : the levels point into `data`, which must stay alive.
+bool parse_dds(const unsigned char * data, size_t size, DDSImage & image);
+
+// Write a BC1/2/3 (BCFormat) mip chain with a legacy DXTn header
+bool save_dds(const char * path, int width, int height, int mip_count, int bc_format,
+	const unsigned char * data, size_t size);
+
+#endif
@@ -0,0 +1,37 @@
+#include <string.h>
+
+#include "drawsort.hpp"
+
+unsigned int quantize_depth(float view_depth, float near_plane, float far_plane, bool back_to_front) {
+	float t = (view_depth - near_plane) / (far_plane - near_plane);
+	if (!(t > 0.0f)) // NaN too
+		t = 0.0f;
+	if (t > 1.0f)
+		t = 1.0f;
+	unsigned int key = (unsigned int)(t * 65535.0f + 0.5f);
+	return back_to_front ? 65535 - key : key;
+}
+
+void radix_sort(std::vector<DepthKey>& keys, std::vector<DepthKey>& scratch) {
+	size_t count = keys.size();
+	scratch.resize(count);
+
+	for (int shift = 0; shift < 16; shift += 8) {
+		unsigned int histogram[256];
+		memset(histogram, 0, sizeof(histogram));
+		for (size_t i = 0; i < count; i++)
+			histogram[(keys[i].key >> shift) & 0xff]++;
+		if (count == 0 || histogram[(keys[0].key >> shift) & 0xff] == count)
+			continue;
+
+		unsigned int offset = 0;
+		for (int digit = 0; digit < 256; digit++) {
+			unsigned int digit_count = histogram[digit];
+			histogram[digit] = offset;
+			offset += digit_count;
+		}
+		for (size_t i = 0; i < count; i++)
+			scratch[histogram[(keys[i].key >> shift) & 0xff]++] = keys[i];
+		keys.swap(scratch);
+	}
+}
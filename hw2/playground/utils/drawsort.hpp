@@ -0,0 +1,21 @@
+#ifndef DRAWSORT_HPP
+#define DRAWSORT_HPP
+
+#include <vector>
+
+// Sort key of one draw : its view depth quantized to 16 bits, and the index
+// of what to draw
+struct DepthKey {
+	unsigned int key;
+	unsigned int index;
+};
+
+// Linear view depth between the near and far planes to 0..65535. Back to front
+// reverses the order, so both passes sort their keys ascending.
+unsigned int quantize_depth(float view_depth, float near_plane, float far_plane, bool back_to_front);
+
+// Stable LSD radix sort on the 16 bit keys, two passes of 8 bits. A pass whose
+// digit is the same for every key is skipped.
+void radix_sort(std::vector<DepthKey>& keys, std::vector<DepthKey>& scratch);
+
+#endif
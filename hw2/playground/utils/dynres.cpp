@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <math.h>
+
+#include <GL/glew.h>
+
+#include "memtrack.hpp"
+#include "dynres.hpp"
+
+// Internal resolution, relative to the window, in steps of scale_step
+static const float min_scale = 0.5f;
+static const float max_scale = 1.0f;
+static const float scale_step = 1.0f / 16;
+
+// Frames between two decisions, enough for the smoothed time to settle
+static const int adjust_interval = 8;
+// Under that fraction of the target there is room to go up
+static const double headroom = 0.75;
+
+
+DynamicResolution::DynamicResolution() {
+	window_width = window_height = 0;
+	target_ms = 0;
+	max_samples = 0;
+	scale = max_scale;
+	samples = 0;
+	render_width = render_height = 0;
+	msaa_fbo = msaa_color = msaa_depth = 0;
+	resolve_fbo = resolve_color = resolve_depth = 0;
+	for (int i = 0; i < query_ring_size; i++)
+		queries[i] = 0;
+	query_head = query_count = 0;
+	query_running = false;
+	stale_queries = 0;
+	gpu_ms = 0;
+	measured_frames = 0;
+	frames_since_adjust = 0;
+	frame_count = 0;
+	scale_sum = 0;
+	gpu_ms_sum = 0;
+	gpu_ms_count = 0;
+	min_scale_seen = max_scale;
+	change_count = 0;
+}
+
+bool DynamicResolution::init(int window_width, int window_height, double target_ms, int max_samples) {
+	this->window_width = window_width;
+	this->window_height = window_height;
+	this->target_ms = target_ms;
+	this->max_samples = max_samples;
+
+	GLint supported_samples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &supported_samples);
+	if (this->max_samples > supported_samples)
+		this->max_samples = supported_samples;
+	// Start at full resolution with the most MSAA, and come down if it's too much
+	samples = this->max_samples;
+
+	glGenQueries(query_ring_size, queries);
+	return create_targets();
+}
+
+void DynamicResolution::cleanup() {
+	delete_targets();
+	glDeleteQueries(query_ring_size, queries);
+	for (int i = 0; i < query_ring_size; i++)
+		queries[i] = 0;
+}
+
+bool DynamicResolution::create_targets() {
+	// Single-sampled target : drawn into without MSAA, resolved into with it, blitted from
+	glGenFramebuffers(1, &resolve_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+	glGenRenderbuffers(1, &resolve_color);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolve_color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, window_width, window_height);
+	track_gpu_resource(GPU_RENDERBUFFER, resolve_color, "dynamic resolution color",
+		texture_bytes(GL_RGBA8, window_width, window_height, 1, 1), GL_RGBA8, window_width, window_height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolve_color);
+	glGenRenderbuffers(1, &resolve_depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, resolve_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, window_width, window_height);
+	track_gpu_resource(GPU_RENDERBUFFER, resolve_depth, "dynamic resolution depth",
+		texture_bytes(GL_DEPTH_COMPONENT24, window_width, window_height, 1, 1), GL_DEPTH_COMPONENT24, window_width, window_height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, resolve_depth);
+	bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	if (ok && samples > 0) {
+		glGenFramebuffers(1, &msaa_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, msaa_fbo);
+		glGenRenderbuffers(1, &msaa_color);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_color);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, window_width, window_height);
+		track_gpu_resource(GPU_RENDERBUFFER, msaa_color, "dynamic resolution MSAA color",
+			texture_bytes(GL_RGBA8, window_width, window_height, samples, 1), GL_RGBA8, window_width, window_height, 1, 1, samples);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa_color);
+		glGenRenderbuffers(1, &msaa_depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, msaa_depth);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, window_width, window_height);
+		track_gpu_resource(GPU_RENDERBUFFER, msaa_depth, "dynamic resolution MSAA depth",
+			texture_bytes(GL_DEPTH_COMPONENT24, window_width, window_height, samples, 1), GL_DEPTH_COMPONENT24,
+			window_width, window_height, 1, 1, samples);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, msaa_depth);
+		ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	if (!ok)
+		printf("Dynamic resolution framebuffer is incomplete (%dx%d, %d samples)\n", window_width, window_height, samples);
+	return ok;
+}
+
+void DynamicResolution::delete_targets() {
+	delete_tracked_renderbuffers(1, &resolve_color);
+	delete_tracked_renderbuffers(1, &resolve_depth);
+	glDeleteFramebuffers(1, &resolve_fbo);
+	resolve_fbo = resolve_color = resolve_depth = 0;
+	if (msaa_fbo) {
+		delete_tracked_renderbuffers(1, &msaa_color);
+		delete_tracked_renderbuffers(1, &msaa_depth);
+		glDeleteFramebuffers(1, &msaa_fbo);
+	}
+	msaa_fbo = msaa_color = msaa_depth = 0;
+}
+
+// Results of the queries the GPU is done with, oldest first, never waiting
+void DynamicResolution::read_timings() {
+	while (query_count > 0) {
+		GLuint query = queries[query_head];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		query_head = (query_head + 1) % query_ring_size;
+		query_count--;
+
+		if (stale_queries > 0) {
+			stale_queries--;
+			continue;
+		}
+		double ms = elapsed / 1000000.0;
+		gpu_ms = measured_frames == 0 ? ms : gpu_ms + (ms - gpu_ms) * 0.2;
+		measured_frames++;
+		gpu_ms_sum += ms;
+		gpu_ms_count++;
+	}
+}
+
+void DynamicResolution::adjust() {
+	float new_scale = scale;
+	int new_samples = samples;
+	if (gpu_ms > target_ms) {
+		// GPU time goes with the pixel count, the square of the scale
+		if (samples > 0) {
+			new_samples = samples > 2 ? samples / 2 : 0;
+		} else {
+			float wanted = scale * (float)sqrt(target_ms * 0.9 / gpu_ms);
+			new_scale = floorf(wanted / scale_step) * scale_step;
+			if (new_scale >= scale)
+				new_scale = scale - scale_step;
+			if (new_scale < min_scale)
+				new_scale = min_scale;
+		}
+	} else if (gpu_ms < target_ms * headroom) {
+		// Up one step at a time, overshooting means a visible drop right after
+		if (scale < max_scale)
+			new_scale = scale + scale_step > max_scale ? max_scale : scale + scale_step;
+		else if (samples < max_samples)
+			new_samples = samples ? (samples * 2 > max_samples ? max_samples : samples * 2) : (max_samples < 2 ? max_samples : 2);
+	}
+
+	frames_since_adjust = 0;
+	if (new_scale == scale && new_samples == samples)
+		return;
+
+	scale = new_scale;
+	if (new_samples != samples) {
+		samples = new_samples;
+		delete_targets();
+		create_targets();
+	}
+	change_count++;
+
+	// Start measuring again : the queries still in flight time the old setting
+	stale_queries = query_count + (query_running ? 1 : 0);
+	measured_frames = 0;
+}
+
+void DynamicResolution::begin_frame(int window_width, int window_height) {
+	// A minimized window is 0x0 : keep the targets until it comes back
+	bool resized = window_width != this->window_width || window_height != this->window_height;
+	if (resized && window_width > 0 && window_height > 0) {
+		this->window_width = window_width;
+		this->window_height = window_height;
+		delete_targets();
+		create_targets();
+	}
+
+	read_timings();
+	frames_since_adjust++;
+	if (frames_since_adjust >= adjust_interval && measured_frames >= adjust_interval / 2)
+		adjust();
+
+	render_width = (int)(window_width * scale + 0.5f);
+	render_height = (int)(window_height * scale + 0.5f);
+	if (render_width < 1) render_width = 1;
+	if (render_height < 1) render_height = 1;
+
+	frame_count++;
+	scale_sum += scale;
+	if (scale < min_scale_seen)
+		min_scale_seen = scale;
+
+	// No free query : this frame goes untimed rather than waiting
+	query_running = query_count < query_ring_size;
+	if (query_running)
+		glBeginQuery(GL_TIME_ELAPSED, queries[(query_head + query_count) % query_ring_size]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, samples > 0 ? msaa_fbo : resolve_fbo);
+	glViewport(0, 0, render_width, render_height);
+}
+
+void DynamicResolution::end_frame() {
+	if (samples > 0) {
+		// Resolving needs the same rectangle on both sides
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+		glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, render_width, render_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, window_width, window_height, GL_COLOR_BUFFER_BIT,
+		render_width == window_width && render_height == window_height ? GL_NEAREST : GL_LINEAR);
+
+	if (query_running) {
+		glEndQuery(GL_TIME_ELAPSED);
+		query_count++;
+		query_running = false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, window_width, window_height);
+}
+
+void DynamicResolution::print_report() const {
+	printf("dynamic resolution : target %.2f ms, %d frames, %d changes\n", target_ms, frame_count, change_count);
+	if (frame_count == 0)
+		return;
+	printf("  scale avg %.2f, lowest %.2f, now %.2f with %d samples\n",
+		scale_sum / frame_count, min_scale_seen, scale, samples);
+	if (gpu_ms_count > 0)
+		printf("  gpu avg %.2f ms over %d timed frames\n", gpu_ms_sum / gpu_ms_count, gpu_ms_count);
+}
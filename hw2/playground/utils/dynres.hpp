@@ -0,0 +1,68 @@
+#ifndef DYNRES_HPP
+#define DYNRES_HPP
+
+// Dynamic resolution : the scene is drawn into a framebuffer object at a
+// fraction of the window size and stretched to the window with a linear blit.
+//
+// Every frame is timed on the GPU with a GL_TIME_ELAPSED query, read back a few
+// frames later so nothing waits for it. Every few frames the controller
+// compares the smoothed GPU time with the target : over budget it drops MSAA
+// first and then resolution, well under budget it climbs back up, resolution
+// first. The render targets are allocated at the window size once, a lower
+// resolution only uses a corner of them, so scale changes cost nothing.
+class DynamicResolution {
+public:
+	DynamicResolution();
+
+	// max_samples = 0 never uses MSAA. The window itself must not be multisampled.
+	bool init(int window_width, int window_height, double target_ms, int max_samples);
+	void cleanup();
+
+	// Binds the scene framebuffer and sets the viewport to the current resolution
+	void begin_frame(int window_width, int window_height);
+	// Resolves and upscales into the window, leaves framebuffer 0 bound
+	void end_frame();
+
+	float get_scale() const { return scale; }
+	int get_samples() const { return samples; }
+
+	void print_report() const;
+
+private:
+	static const int query_ring_size = 4;
+
+	bool create_targets();
+	void delete_targets();
+	void read_timings();
+	void adjust();
+
+	int window_width, window_height;
+	double target_ms;
+	int max_samples;
+
+	float scale;
+	int samples;
+	int render_width, render_height;
+
+	GLuint msaa_fbo, msaa_color, msaa_depth;
+	GLuint resolve_fbo, resolve_color, resolve_depth;
+
+	GLuint queries[query_ring_size];
+	int query_head, query_count;
+	bool query_running;
+	int stale_queries; // still timing a configuration that has been changed since
+
+	double gpu_ms;       // smoothed
+	int measured_frames; // since the last change
+	int frames_since_adjust;
+
+	// Report
+	int frame_count;
+	double scale_sum;
+	double gpu_ms_sum;
+	int gpu_ms_count;
+	float min_scale_seen;
+	int change_count;
+};
+
+#endif
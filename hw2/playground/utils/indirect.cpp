@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shaders.hpp"
+#include "vertexformat.hpp"
+#include "memtrack.hpp"
+#include "indirect.hpp"
+
+
+// Written by the compute shader for every visible entity
+struct IndirectInstance {
+	glm::mat4 model;
+	glm::vec4 params; // x : texture layer
+};
+
+static const int cull_group_size = 64; // local_size_x of CullInstances.computeshader
+
+IndirectRenderer::IndirectRenderer() {
+	vertex_array = 0;
+	vertex_buffer = index_buffer = 0;
+	entity_buffer = instance_buffer = command_buffer = 0;
+	capacity = 0;
+	cull_program = draw_program = 0;
+	PlanesID = EntityCountID = VPID = TextureID = 0;
+}
+
+bool IndirectRenderer::is_supported() {
+	return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+		GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+bool IndirectRenderer::init(const std::vector<IndirectMesh>& meshes, const VertexFormat& format) {
+	// A failed init leaves nothing behind, the caller only cleans up after success
+	cull_program = load_compute_program("CullInstances.computeshader");
+	if (!cull_program) {
+		cleanup();
+		return false;
+	}
+	PlanesID = glGetUniformLocation(cull_program, "Planes");
+	EntityCountID = glGetUniformLocation(cull_program, "EntityCount");
+
+	draw_program = load_program("TransformVertexShader_indirect.vertexshader", "TextureFragmentShader_indirect.fragmentshader");
+	if (!draw_program) {
+		cleanup();
+		return false;
+	}
+	VPID = glGetUniformLocation(draw_program, "VP");
+	TextureID = glGetUniformLocation(draw_program, "myTextureSampler");
+
+	// All the meshes one after the other, indices relative to their mesh. Every
+	// vertex gets a color, a uv and a textured flag, the unused ones at defaults.
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec4> colors;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned char> textured; // 0 : vertex color, 255 : texture
+	std::vector<unsigned int> indices;
+	commands.resize(meshes.size());
+	mesh_entities.resize(meshes.size());
+	for (size_t m = 0; m < meshes.size(); m++) {
+		const IndirectMesh& mesh = meshes[m];
+		commands[m].count = mesh.indices.size();
+		commands[m].instance_count = 0;
+		commands[m].first_index = indices.size();
+		commands[m].base_vertex = positions.size();
+		commands[m].base_instance = 0;
+
+		size_t vertex_count = mesh.positions.size();
+		positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+		if (mesh.colors.empty())
+			colors.resize(colors.size() + vertex_count, glm::vec4(1.0f));
+		else
+			colors.insert(colors.end(), mesh.colors.begin(), mesh.colors.end());
+		if (mesh.uvs.empty())
+			uvs.resize(uvs.size() + vertex_count, glm::vec2(0.0f));
+		else
+			uvs.insert(uvs.end(), mesh.uvs.begin(), mesh.uvs.end());
+		for (size_t i = 0; i < vertex_count; i++)
+			textured.push_back(mesh.uvs.empty() ? 0 : 255);
+		indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+	}
+
+	// One block per attribute, the positions quantized within the bounds of all
+	// the meshes as a single uniform dequantizes them
+	VertexFormat fitted = fit_vertex_format(format, uvs);
+	glm::vec3 min, max;
+	get_position_bounds(positions, min, max);
+	MeshLayout layout = get_mesh_layout(fitted, min, max);
+	std::vector<unsigned char> vertices;
+	pack_positions(positions, fitted, min, max, vertices);
+	size_t color_offset = vertices.size();
+	pack_colors(colors, fitted, vertices);
+	size_t uv_offset = vertices.size();
+	pack_uvs(uvs, fitted, vertices);
+	size_t textured_offset = vertices.size();
+	for (size_t i = 0; i < textured.size(); i++) {
+		unsigned char padded[4] = { textured[i], 0, 0, 0 };
+		vertices.insert(vertices.end(), padded, padded + 4);
+	}
+	VertexAttribute textured_attribute = { 1, GL_UNSIGNED_BYTE, GL_TRUE, 4 };
+
+	glUseProgram(draw_program);
+	glUniform3fv(glGetUniformLocation(draw_program, "PositionOffset"), 1, &layout.position_offset[0]);
+	glUniform3fv(glGetUniformLocation(draw_program, "PositionScale"), 1, &layout.position_scale[0]);
+	glUseProgram(0);
+
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size(), &vertices[0], GL_STATIC_DRAW);
+	track_gpu_resource(GPU_BUFFER, vertex_buffer, "indirect vertices", vertices.size(), GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	set_vertex_attribute(0, layout.position, 0);
+	glEnableVertexAttribArray(1);
+	set_vertex_attribute(1, layout.color, color_offset);
+	glEnableVertexAttribArray(2);
+	set_vertex_attribute(2, layout.uv, uv_offset);
+	glEnableVertexAttribArray(3);
+	set_vertex_attribute(3, textured_attribute, textured_offset);
+
+	glGenBuffers(1, &index_buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	track_gpu_resource(GPU_BUFFER, index_buffer, "indirect indices", indices.size() * sizeof(unsigned int), GL_STATIC_DRAW);
+
+	// Instance attributes come from the buffer the compute shader fills,
+	// base_instance picks the range of each mesh
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	for (int column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(4 + column);
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(IndirectInstance), (void*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(4 + column, 1);
+	}
+	glEnableVertexAttribArray(8);
+	glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(IndirectInstance), (void*)offsetof(IndirectInstance, params));
+	glVertexAttribDivisor(8, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &entity_buffer);
+	glGenBuffers(1, &command_buffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), NULL, GL_DYNAMIC_DRAW);
+	track_gpu_resource(GPU_BUFFER, command_buffer, "indirect commands", commands.size() * sizeof(DrawCommand), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	reserve(1024);
+	return true;
+}
+
+void IndirectRenderer::cleanup() {
+	delete_tracked_buffers(1, &vertex_buffer);
+	delete_tracked_buffers(1, &index_buffer);
+	delete_tracked_buffers(1, &entity_buffer);
+	delete_tracked_buffers(1, &instance_buffer);
+	delete_tracked_buffers(1, &command_buffer);
+	glDeleteVertexArrays(1, &vertex_array);
+	glDeleteProgram(cull_program);
+	glDeleteProgram(draw_program);
+	vertex_buffer = index_buffer = entity_buffer = instance_buffer = command_buffer = 0;
+	vertex_array = 0;
+	cull_program = draw_program = 0;
+	capacity = 0;
+}
+
+void IndirectRenderer::reserve(size_t entity_count) {
+	if (entity_count <= capacity)
+		return;
+	while (capacity < entity_count)
+		capacity = capacity ? capacity * 2 : 1024;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, entity_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(IndirectEntity), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(IndirectInstance), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	track_gpu_resource(GPU_BUFFER, entity_buffer, "indirect entities", capacity * sizeof(IndirectEntity), GL_STREAM_DRAW);
+	track_gpu_resource(GPU_BUFFER, instance_buffer, "indirect instances", capacity * sizeof(IndirectInstance), GL_DYNAMIC_COPY);
+}
+
+
+void IndirectRenderer::draw(
+	const std::vector<IndirectEntity>& entities, const glm::mat4& View, const glm::mat4& Projection,
+	GLuint texture_array
+) {
+	if (entities.empty())
+		return;
+	reserve(entities.size());
+
+	// Every mesh gets a range of the instance buffer as large as its entities
+	for (size_t m = 0; m < mesh_entities.size(); m++)
+		mesh_entities[m] = 0;
+	for (size_t i = 0; i < entities.size(); i++)
+		mesh_entities[entities[i].mesh]++;
+	unsigned int base = 0;
+	for (size_t m = 0; m < commands.size(); m++) {
+		commands[m].instance_count = 0;
+		commands[m].base_instance = base;
+		base += mesh_entities[m];
+	}
+
+	// Orphan the storage of the last frame instead of waiting for the GPU to be done with it
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, entity_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(IndirectEntity), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, entities.size() * sizeof(IndirectEntity), &entities[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(DrawCommand), &commands[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Frustum planes of the view-projection matrix, normalized, inside positive
+	glm::mat4 VP = Projection * View;
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; row++)
+		rows[row] = glm::vec4(VP[0][row], VP[1][row], VP[2][row], VP[3][row]);
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2],
+	};
+	for (int i = 0; i < 6; i++)
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+
+	glUseProgram(cull_program);
+	glUniform4fv(PlanesID, 6, &planes[0].x);
+	glUniform1ui(EntityCountID, (GLuint)entities.size());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, entity_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instance_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, command_buffer);
+	glDispatchCompute((GLuint)((entities.size() + cull_group_size - 1) / cull_group_size), 1, 1);
+
+	// The draw reads the commands and the instances the dispatch wrote
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+	glUseProgram(draw_program);
+	glUniformMatrix4fv(VPID, 1, GL_FALSE, &VP[0][0]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture_array);
+	glUniform1i(TextureID, 0);
+
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, (GLsizei)commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+
+	for (int i = 0; i < 3; i++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+}
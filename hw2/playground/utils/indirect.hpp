@@ -0,0 +1,84 @@
+#ifndef INDIRECT_HPP
+#define INDIRECT_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct VertexFormat;
+
+// A mesh of the GPU-driven path. Colored meshes have colors and no uvs,
+// textured ones uvs and no colors.
+struct IndirectMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec4> colors;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned int> indices;
+};
+
+// One object to cull and draw, std430 layout of CullInstances.computeshader
+struct IndirectEntity {
+	glm::mat4 model;
+	glm::vec4 sphere;  // world space bounding sphere : center and radius
+	float layer;       // texture layer, for textured meshes
+	unsigned int mesh; // index in the meshes given to init()
+	float padding[2];
+};
+
+// GPU-driven submission : all the meshes share one vertex and one index
+// buffer, the entities go to a shader storage buffer every frame, and a
+// compute shader frustum culls them. Every visible entity bumps the instance
+// count of its mesh's DrawElementsIndirectCommand and writes its instance data
+// to that mesh's range of the instance buffer, then a single
+// glMultiDrawElementsIndirect draws everything without the CPU knowing what
+// was visible.
+//
+// Needs compute shaders, shader storage buffers, multi-draw indirect and base
+// instance (GL 4.3) : check is_supported() and keep the CPU path otherwise.
+// Instances are not in any particular order.
+class IndirectRenderer {
+public:
+	IndirectRenderer();
+
+	static bool is_supported();
+
+	// The meshes go to the GPU in format, see VertexFormat
+	bool init(const std::vector<IndirectMesh>& meshes, const VertexFormat& format);
+	void cleanup();
+
+	// texture_array : the GL_TEXTURE_2D_ARRAY textured meshes sample
+	void draw(
+		const std::vector<IndirectEntity>& entities, const glm::mat4& View, const glm::mat4& Projection,
+		GLuint texture_array
+	);
+
+private:
+	// DrawElementsIndirectCommand
+	struct DrawCommand {
+		unsigned int count;
+		unsigned int instance_count;
+		unsigned int first_index;
+		int base_vertex;
+		unsigned int base_instance;
+	};
+
+	void reserve(size_t entity_count);
+
+	std::vector<DrawCommand> commands; // instance counts at 0, base instances set each frame
+	std::vector<unsigned int> mesh_entities;
+
+	GLuint vertex_array;
+	GLuint vertex_buffer, index_buffer;
+	GLuint entity_buffer, instance_buffer, command_buffer;
+	size_t capacity; // entities the entity and instance buffers can hold
+
+	GLuint cull_program;
+	GLuint PlanesID;
+	GLuint EntityCountID;
+
+	GLuint draw_program;
+	GLuint VPID;
+	GLuint TextureID;
+};
+
+#endif
@@ -10,8 +10,43 @@ extern GLFWwindow* window; // The "extern" keyword here is to access the variabl
 #include <glm/gtc/matrix_transform.hpp>
 using namespace glm;
 
+#include "dds.hpp"
+#include "init.hpp"
+#include "input.hpp"
 
-int init_all() {
+#ifdef USE_EGL // Surfaceless EGL for machines without a display, link with -lEGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+#endif
+
+
+// State shared by the window and the offscreen contexts
+void init_gl_state() {
+	// background
+	glClearColor(0.7f, 0.7f, 0.7f, 0.0f);
+
+	// Enable depth test
+	glEnable(GL_DEPTH_TEST);
+	// Accept fragment if it closer to the camera than the former one
+	glDepthFunc(GL_LESS);
+
+	// Blending is only turned on by the transparent pass of draw_scene
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	
+	//   ,     
+	glEnable(GL_CULL_FACE);
+
+	// DDS headers are checked against what this driver can actually create
+	GLint max_texture_size = 0, max_array_layers = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_array_layers);
+	set_dds_limits(max_texture_size, max_array_layers);
+}
+
+int init_all(int samples) {
 	// Initialise GLFW
 	if (!glfwInit()) {
 		fprintf(stderr, "Failed to initialize GLFW\n");
@@ -19,7 +54,7 @@ int init_all() {
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
+	glfwWindowHint(GLFW_SAMPLES, samples);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
@@ -46,28 +81,106 @@ int init_all() {
 
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 
-	// background
-	glClearColor(0.7f, 0.7f, 0.7f, 0.0f);
+	// Mouse and resize events go through the input queue
+	init_input(window);
 
-	// Enable depth test
-	glEnable(GL_DEPTH_TEST);
-	// Accept fragment if it closer to the camera than the former one
-	glDepthFunc(GL_LESS);
+	init_gl_state();
 
-	// Enable blending
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	
-	//   ,     
-	glEnable(GL_CULL_FACE);
+	return 0;
+}
 
-	int width, height;
-	glfwGetWindowSize(window, &width, &height);
+// Same GL 3.3 core context as init_all, but nothing is shown on screen and
+// rendering has to go to a framebuffer object. No getchar() on errors here :
+// this is meant to run unattended.
+int init_offscreen() {
+#ifdef USE_EGL
+	// Prefer the Mesa surfaceless platform, it needs neither X nor a GPU device node
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		egl_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (egl_display == EGL_NO_DISPLAY)
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
 
-	// Reset mouse position for next frame
-	glfwSetCursorPos(window, float(width) / 2, float(height) / 2);
+	if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL)) {
+		fprintf(stderr, "Failed to initialize EGL\n");
+		return -1;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+
+	EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+		fprintf(stderr, "No EGL config with desktop OpenGL support\n");
+		eglTerminate(egl_display);
+		return -1;
+	}
+
+	EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+	if (egl_context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+		fprintf(stderr, "Failed to create a surfaceless OpenGL 3.3 context\n");
+		eglTerminate(egl_display);
+		return -1;
+	}
+#else
+	// No EGL : an invisible GLFW window only provides the context
+	if (!glfwInit()) {
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return -1;
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	window = glfwCreateWindow(64, 64, "HW2 shooter (offscreen)", NULL, NULL);
+	if (window == NULL) {
+		fprintf(stderr, "Failed to create a hidden GLFW window\n");
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+#endif
 
+	glewExperimental = true; // Needed for core profile
+	GLenum glew_res = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// A GLX build of GLEW complains about the missing X display, the GL entry points are loaded anyway
+	if (glew_res == GLEW_ERROR_NO_GLX_DISPLAY)
+		glew_res = GLEW_OK;
+#endif
+	if (glew_res != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		terminate_offscreen();
+		return -1;
+	}
+
+	init_gl_state();
 	return 0;
-}
\ No newline at end of file
+}
+
+void terminate_offscreen() {
+#ifdef USE_EGL
+	if (egl_display != EGL_NO_DISPLAY) {
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (egl_context != EGL_NO_CONTEXT)
+			eglDestroyContext(egl_display, egl_context);
+		eglTerminate(egl_display);
+	}
+	egl_display = EGL_NO_DISPLAY;
+	egl_context = EGL_NO_CONTEXT;
+#else
+	glfwTerminate();
+#endif
+}
@@ -1 +1,5 @@
-int init_all();
\ No newline at end of file
+// samples : MSAA of the window, 0 when the scene is drawn into a framebuffer object and blitted
+int init_all(int samples = 4);
+void init_gl_state();
+int init_offscreen();
+void terminate_offscreen();
@@ -0,0 +1,91 @@
+#include <stdio.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include "input.hpp"
+
+
+bool InputQueue::push(const InputEvent & event) {
+	unsigned int write = head.load(std::memory_order_relaxed);
+	if (write - tail.load(std::memory_order_acquire) == capacity) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	events[write & (capacity - 1)] = event;
+	// Publish the slot only once it is written
+	head.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+bool InputQueue::pop(InputEvent & event) {
+	unsigned int read = tail.load(std::memory_order_relaxed);
+	if (read == head.load(std::memory_order_acquire))
+		return false;
+	event = events[read & (capacity - 1)];
+	// Hand the slot back to the producer
+	tail.store(read + 1, std::memory_order_release);
+	return true;
+}
+
+
+static InputQueue input_queue;
+
+static std::atomic<int> window_width(0);
+static std::atomic<int> window_height(0);
+
+static double last_cursor_x = 0;
+static double last_cursor_y = 0;
+
+static void mouse_button_callback(GLFWwindow * /*window*/, int button, int action, int /*mods*/) {
+	InputEvent event = InputEvent();
+	event.type = INPUT_MOUSE_BUTTON;
+	event.time = glfwGetTime();
+	event.button = button;
+	event.action = action;
+	input_queue.push(event);
+}
+
+static void cursor_position_callback(GLFWwindow * /*window*/, double xpos, double ypos) {
+	InputEvent event = InputEvent();
+	event.type = INPUT_CURSOR_MOTION;
+	event.time = glfwGetTime();
+	event.dx = xpos - last_cursor_x;
+	event.dy = ypos - last_cursor_y;
+	last_cursor_x = xpos;
+	last_cursor_y = ypos;
+	input_queue.push(event);
+}
+
+static void window_size_callback(GLFWwindow * /*window*/, int width, int height) {
+	window_width.store(width, std::memory_order_relaxed);
+	window_height.store(height, std::memory_order_relaxed);
+}
+
+void init_input(GLFWwindow * window) {
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+	window_size_callback(window, width, height);
+
+	// A disabled cursor is hidden and not limited by the window borders
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#ifdef GLFW_RAW_MOUSE_MOTION
+	// Unaccelerated motion straight from the device when the platform supports it
+	if (glfwRawMouseMotionSupported())
+		glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+#endif
+	glfwGetCursorPos(window, &last_cursor_x, &last_cursor_y);
+
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetCursorPosCallback(window, cursor_position_callback);
+	glfwSetWindowSizeCallback(window, window_size_callback);
+}
+
+bool poll_input_event(InputEvent & event) {
+	return input_queue.pop(event);
+}
+
+void get_window_size(int & width, int & height) {
+	width = window_width.load(std::memory_order_relaxed);
+	height = window_height.load(std::memory_order_relaxed);
+}
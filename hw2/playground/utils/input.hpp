@@ -0,0 +1,58 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <atomic>
+
+enum InputEventType {
+	INPUT_MOUSE_BUTTON,
+	INPUT_CURSOR_MOTION
+};
+
+// One event as delivered by a GLFW callback.
+// GLFW does not report when the OS received an event, so time is the
+// glfwGetTime() of the callback, i.e. of the glfwPollEvents that delivered it.
+struct InputEvent {
+	int type;
+	double time;
+
+	// INPUT_MOUSE_BUTTON
+	int button;
+	int action;
+
+	// INPUT_CURSOR_MOTION : pixels since the previous motion event
+	double dx;
+	double dy;
+};
+
+// Lock-free ring between one producer (the GLFW callbacks) and one consumer
+// (the simulation tick). A full queue drops new events and counts them.
+class InputQueue {
+public:
+	static const unsigned int capacity = 1024; // power of two
+
+	InputQueue() : head(0), tail(0), dropped(0) {}
+
+	bool push(const InputEvent & event);
+	bool pop(InputEvent & event);
+
+	unsigned int get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	InputEvent events[capacity];
+	std::atomic<unsigned int> head; // next slot to write, only moved by the producer
+	std::atomic<unsigned int> tail; // next slot to read, only moved by the consumer
+	std::atomic<unsigned int> dropped;
+};
+
+// Install the mouse button, cursor and window size callbacks on the window.
+// The cursor is captured (unbounded motion, raw when the platform has it),
+// so mouse look no longer needs to re-center it every frame.
+void init_input(GLFWwindow * window);
+
+// Next event in the order they happened, false when the queue is empty
+bool poll_input_event(InputEvent & event);
+
+// Window size, kept up to date by the resize callback
+void get_window_size(int & width, int & height);
+
+#endif
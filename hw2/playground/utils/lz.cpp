@@ -0,0 +1,139 @@
+#include <string.h>
+#include <vector>
+
+#include "lz.hpp"
+
+
+static const int min_match = 4;
+static const int hash_bits = 14;
+static const size_t max_offset = 65535;
+// The last bytes always go out as literals, a match never reads up to the end
+static const size_t end_literals = 5;
+
+static unsigned int read_u32(const unsigned char * p) {
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static unsigned int hash4(unsigned int v) {
+	return (v * 2654435761u) >> (32 - hash_bits);
+}
+
+// 15 in the token nibble, then 255s and the remainder
+static void write_length(std::vector<unsigned char>& out, size_t length) {
+	while (length >= 255) {
+		out.push_back(255);
+		length -= 255;
+	}
+	out.push_back((unsigned char)length);
+}
+
+static void write_sequence(std::vector<unsigned char>& out, const unsigned char * literals, size_t literal_count,
+	size_t offset, size_t match_length) {
+	size_t match_code = match_length ? match_length - min_match : 0;
+	out.push_back((unsigned char)(((literal_count < 15 ? literal_count : 15) << 4) | (match_code < 15 ? match_code : 15)));
+	if (literal_count >= 15)
+		write_length(out, literal_count - 15);
+	out.insert(out.end(), literals, literals + literal_count);
+	if (match_length == 0)
+		return;
+
+	out.push_back((unsigned char)(offset & 0xFF));
+	out.push_back((unsigned char)(offset >> 8));
+	if (match_code >= 15)
+		write_length(out, match_code - 15);
+}
+
+void lz_compress(const unsigned char * src, size_t size, std::vector<unsigned char>& out) {
+	std::vector<size_t> table(1 << hash_bits, (size_t)-1);
+
+	size_t anchor = 0; // first byte not written yet
+	size_t pos = 0;
+	size_t misses = 0;
+	while (size >= end_literals + min_match && pos + min_match <= size - end_literals) {
+		unsigned int sequence = read_u32(src + pos);
+		unsigned int h = hash4(sequence);
+		size_t candidate = table[h];
+		table[h] = pos;
+
+		if (candidate == (size_t)-1 || pos - candidate > max_offset || read_u32(src + candidate) != sequence) {
+			// Incompressible data is skipped over faster and faster
+			pos += 1 + (misses++ >> 6);
+			continue;
+		}
+		misses = 0;
+
+		size_t length = min_match;
+		while (pos + length < size - end_literals && src[candidate + length] == src[pos + length])
+			length++;
+
+		write_sequence(out, src + anchor, pos - anchor, pos - candidate, length);
+		pos += length;
+		anchor = pos;
+	}
+
+	write_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz_decompress(const unsigned char * src, size_t size, unsigned char * dst, size_t dst_size) {
+	size_t in = 0;
+	size_t out = 0;
+	while (in < size) {
+		unsigned char token = src[in++];
+
+		size_t literal_count = token >> 4;
+		if (literal_count == 15) {
+			unsigned char b;
+			do {
+				if (in >= size)
+					return false;
+				b = src[in++];
+				literal_count += b;
+			} while (b == 255);
+		}
+		if (literal_count > size - in || literal_count > dst_size - out)
+			return false;
+		memcpy(dst + out, src + in, literal_count);
+		in += literal_count;
+		out += literal_count;
+
+		// The last sequence has no match
+		if (in == size)
+			break;
+
+		if (size - in < 2)
+			return false;
+		size_t offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+		if (offset == 0 || offset > out)
+			return false;
+
+		size_t match_length = token & 15;
+		if (match_length == 15) {
+			unsigned char b;
+			do {
+				if (in >= size)
+					return false;
+				b = src[in++];
+				match_length += b;
+			} while (b == 255);
+		}
+		match_length += min_match;
+		if (match_length > dst_size - out)
+			return false;
+
+		// The match may overlap what it is copying : 8 bytes at a time only
+		// when the chunks can't
+		const unsigned char * from = dst + out - offset;
+		size_t i = 0;
+		if (offset >= 8) {
+			for (; i + 8 <= match_length; i += 8)
+				memcpy(dst + out + i, from + i, 8);
+		}
+		for (; i < match_length; i++)
+			dst[out + i] = from[i];
+		out += match_length;
+	}
+	return out == dst_size;
+}
@@ -0,0 +1,18 @@
+#ifndef LZ_HPP
+#define LZ_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// Byte-oriented LZ77 in the LZ4 block layout : a token with the literal and
+// match lengths, the literals, then a 2 byte offset back into the output.
+// Fast enough on both sides to sit between a file and a memcpy.
+
+// Appends the compressed form of src to out
+void lz_compress(const unsigned char * src, size_t size, std::vector<unsigned char>& out);
+
+// dst_size has to be the exact uncompressed size. False on corrupt input,
+// never reads or writes out of bounds.
+bool lz_decompress(const unsigned char * src, size_t size, unsigned char * dst, size_t dst_size);
+
+#endif
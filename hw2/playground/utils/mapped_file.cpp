@@ -0,0 +1,104 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "memtrack.hpp"
+#include "mapped_file.hpp"
+
+
+MappedFile::MappedFile() {
+	bytes = NULL;
+	length = 0;
+#ifdef _WIN32
+	file_handle = INVALID_HANDLE_VALUE;
+	mapping_handle = NULL;
+#else
+	fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const char * path) {
+	close();
+
+#ifdef _WIN32
+	file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		printf("%s could not be opened. Are you in the right directory ?\n", path);
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	length = (size_t)file_size.QuadPart;
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle == NULL) {
+		close();
+		return false;
+	}
+	bytes = (const unsigned char *)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+	fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("%s could not be opened. Are you in the right directory ?\n", path);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close();
+		return false;
+	}
+	length = (size_t)st.st_size;
+
+	void * mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	bytes = mapping == MAP_FAILED ? NULL : (const unsigned char *)mapping;
+#endif
+
+	if (bytes == NULL) {
+		printf("%s could not be mapped\n", path);
+		close();
+		return false;
+	}
+	track_allocation(MEMORY_MAPPED, length);
+	return true;
+}
+
+void MappedFile::close() {
+	if (bytes)
+		track_free(MEMORY_MAPPED, length);
+
+#ifdef _WIN32
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+	mapping_handle = NULL;
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if (bytes)
+		munmap((void *)bytes, length);
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	bytes = NULL;
+	length = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file. The pages come straight from the
+// OS page cache, so loaders can hand pointers into the file to GL without
+// reading or copying it first.
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char * path);
+	void close();
+
+	const unsigned char * data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const unsigned char * bytes;
+	size_t length;
+#ifdef _WIN32
+	void * file_handle;
+	void * mapping_handle;
+#else
+	int fd;
+#endif
+};
+
+#endif
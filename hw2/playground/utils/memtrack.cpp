@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "memtrack.hpp"
+
+
+static const char * tag_names[MEMORY_TAG_COUNT] = { "objects", "draw", "swarm", "mapped" };
+static const char * kind_names[GPU_KIND_COUNT] = { "buffer", "texture", "renderbuffer" };
+
+static std::atomic<long long> current_bytes[MEMORY_TAG_COUNT];
+static std::atomic<long long> peak_bytes[MEMORY_TAG_COUNT];
+static std::atomic<long long> allocation_count[MEMORY_TAG_COUNT];
+
+struct GpuResource {
+	GpuResourceKind kind;
+	unsigned int id;
+	std::string label;
+	size_t bytes;
+	unsigned int format;
+	int width, height, depth, levels, samples;
+};
+
+// By kind then name, which GL only keeps unique per kind
+static std::map<std::pair<int, unsigned int>, GpuResource> gpu_resources;
+
+static volatile sig_atomic_t dump_requested = 0;
+
+
+void track_allocation(MemoryTag tag, size_t bytes) {
+	long long now = current_bytes[tag].fetch_add((long long)bytes) + (long long)bytes;
+	long long peak = peak_bytes[tag].load();
+	while (now > peak && !peak_bytes[tag].compare_exchange_weak(peak, now)) {
+	}
+	allocation_count[tag]++;
+}
+
+void track_free(MemoryTag tag, size_t bytes) {
+	current_bytes[tag].fetch_sub((long long)bytes);
+}
+
+
+void track_gpu_resource(
+	GpuResourceKind kind, unsigned int id, const char * label, size_t bytes, unsigned int format,
+	int width, int height, int depth, int levels, int samples
+) {
+	if (id == 0)
+		return;
+	GpuResource& r = gpu_resources[std::make_pair((int)kind, id)];
+	r.kind = kind;
+	r.id = id;
+	r.label = label;
+	r.bytes = bytes;
+	r.format = format;
+	r.width = width;
+	r.height = height;
+	r.depth = depth;
+	r.levels = levels;
+	r.samples = samples;
+}
+
+void untrack_gpu_resource(GpuResourceKind kind, unsigned int id) {
+	gpu_resources.erase(std::make_pair((int)kind, id));
+}
+
+void delete_tracked_buffers(int count, const unsigned int * ids) {
+	for (int i = 0; i < count; i++)
+		untrack_gpu_resource(GPU_BUFFER, ids[i]);
+	glDeleteBuffers(count, ids);
+}
+
+void delete_tracked_textures(int count, const unsigned int * ids) {
+	for (int i = 0; i < count; i++)
+		untrack_gpu_resource(GPU_TEXTURE, ids[i]);
+	glDeleteTextures(count, ids);
+}
+
+void delete_tracked_renderbuffers(int count, const unsigned int * ids) {
+	for (int i = 0; i < count; i++)
+		untrack_gpu_resource(GPU_RENDERBUFFER, ids[i]);
+	glDeleteRenderbuffers(count, ids);
+}
+
+// Bytes per 4x4 block for the compressed formats, per texel for the others
+static size_t format_size(unsigned int format, bool& compressed) {
+	compressed = true;
+	switch (format) {
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RED_RGTC1:
+	case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		return 8;
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_RG_RGTC2:
+	case GL_COMPRESSED_SIGNED_RG_RGTC2:
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+	case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+	case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+		return 16;
+	}
+	compressed = false;
+	switch (format) {
+	case GL_R8:
+	case GL_RED:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+		return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		// RGBA8, RGB8 padded to 4, R32F, depth 24 + 8 of padding or stencil
+		return 4;
+	}
+}
+
+size_t texture_bytes(unsigned int internal_format, int width, int height, int depth, int levels) {
+	bool compressed;
+	size_t size = format_size(internal_format, compressed);
+	if (levels <= 0) {
+		levels = 1;
+		for (int s = std::max(width, height); s > 1; s /= 2)
+			levels++;
+	}
+	size_t total = 0;
+	for (int level = 0; level < levels; level++) {
+		size_t w = std::max(width >> level, 1);
+		size_t h = std::max(height >> level, 1);
+		if (compressed)
+			total += ((w + 3) / 4) * ((h + 3) / 4) * size;
+		else
+			total += w * h * size;
+	}
+	return total * std::max(depth, 1);
+}
+
+static const char * format_name(unsigned int format) {
+	switch (format) {
+	case GL_STATIC_DRAW: return "static draw";
+	case GL_DYNAMIC_DRAW: return "dynamic draw";
+	case GL_STREAM_DRAW: return "stream draw";
+	case GL_DYNAMIC_COPY: return "dynamic copy";
+	case GL_STREAM_READ: return "stream read";
+	case GL_RGBA8: return "RGBA8";
+	case GL_RGB: return "RGB";
+	case GL_RGBA: return "RGBA";
+	case GL_DEPTH_COMPONENT24: return "depth 24";
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "DXT1";
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT: return "DXT1 alpha";
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: return "DXT3";
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "DXT5";
+	case GL_COMPRESSED_RED_RGTC1: return "BC4";
+	case GL_COMPRESSED_RG_RGTC2: return "BC5";
+	case GL_COMPRESSED_RGBA_BPTC_UNORM: return "BC7";
+	default: return NULL;
+	}
+}
+
+static void print_bytes(long long bytes) {
+	if (bytes >= 1024 * 1024)
+		printf("%.2f MB", bytes / (1024.0 * 1024.0));
+	else
+		printf("%.1f KB", bytes / 1024.0);
+}
+
+
+void print_memory_summary() {
+	printf("memory : CPU");
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		printf(" %s ", tag_names[tag]);
+		print_bytes(current_bytes[tag].load());
+	}
+
+	size_t kind_bytes[GPU_KIND_COUNT] = { 0 };
+	int kind_count[GPU_KIND_COUNT] = { 0 };
+	for (std::map<std::pair<int, unsigned int>, GpuResource>::const_iterator it = gpu_resources.begin();
+		it != gpu_resources.end(); ++it) {
+		kind_bytes[it->second.kind] += it->second.bytes;
+		kind_count[it->second.kind]++;
+	}
+	printf(", GPU");
+	for (int kind = 0; kind < GPU_KIND_COUNT; kind++) {
+		printf(" %d %s%s ", kind_count[kind], kind_names[kind], kind_count[kind] == 1 ? "" : "s");
+		print_bytes(kind_bytes[kind]);
+	}
+	printf("\n");
+}
+
+static void print_resources(const std::vector<const GpuResource *>& resources) {
+	for (size_t i = 0; i < resources.size(); i++) {
+		const GpuResource& r = *resources[i];
+		printf("  %-12s %5u  ", kind_names[r.kind], r.id);
+		print_bytes(r.bytes);
+		const char * name = format_name(r.format);
+		if (name)
+			printf("  %s", name);
+		else
+			printf("  0x%04x", r.format);
+		if (r.kind != GPU_BUFFER) {
+			printf(" %dx%d", r.width, r.height);
+			if (r.depth > 1)
+				printf("x%d", r.depth);
+			if (r.levels > 1)
+				printf(", %d levels", r.levels);
+			if (r.samples > 1)
+				printf(", %dx MSAA", r.samples);
+		}
+		printf("  %s\n", r.label.c_str());
+	}
+}
+
+void print_memory_dump() {
+	printf("memory dump :\n");
+	long long cpu_total = 0;
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		printf("  %-12s ", tag_names[tag]);
+		print_bytes(current_bytes[tag].load());
+		printf(", peak ");
+		print_bytes(peak_bytes[tag].load());
+		printf(", %lld allocations\n", allocation_count[tag].load());
+		cpu_total += current_bytes[tag].load();
+	}
+
+	std::vector<const GpuResource *> resources;
+	size_t gpu_total = 0;
+	for (std::map<std::pair<int, unsigned int>, GpuResource>::const_iterator it = gpu_resources.begin();
+		it != gpu_resources.end(); ++it) {
+		resources.push_back(&it->second);
+		gpu_total += it->second.bytes;
+	}
+	std::stable_sort(resources.begin(), resources.end(),
+		[](const GpuResource * a, const GpuResource * b) { return a->bytes > b->bytes; });
+	print_resources(resources);
+
+	printf("  total : CPU ");
+	print_bytes(cpu_total);
+	printf(", GPU ");
+	print_bytes(gpu_total);
+	printf(" in %d objects\n", (int)resources.size());
+}
+
+int print_gpu_leaks() {
+	std::vector<const GpuResource *> resources;
+	for (std::map<std::pair<int, unsigned int>, GpuResource>::const_iterator it = gpu_resources.begin();
+		it != gpu_resources.end(); ++it)
+		resources.push_back(&it->second);
+	if (!resources.empty()) {
+		printf("%d GL objects were never deleted :\n", (int)resources.size());
+		print_resources(resources);
+	}
+	return resources.size();
+}
+
+
+static void request_dump(int signal_number) {
+	dump_requested = 1;
+	signal(signal_number, request_dump);
+}
+
+void install_memory_dump_signal() {
+#if defined(SIGUSR1)
+	signal(SIGUSR1, request_dump);
+#elif defined(SIGBREAK)
+	signal(SIGBREAK, request_dump);
+#endif
+}
+
+bool memory_dump_requested() {
+	if (!dump_requested)
+		return false;
+	dump_requested = 0;
+	return true;
+}
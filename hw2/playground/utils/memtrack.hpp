@@ -0,0 +1,96 @@
+#ifndef MEMTRACK_HPP
+#define MEMTRACK_HPP
+
+#include <stddef.h>
+#include <new>
+
+// CPU memory by subsystem. The counters are atomic : any thread can update
+// them, through a TrackedAllocator or by hand.
+enum MemoryTag {
+	MEMORY_OBJECTS,  // enemies and fireballs, and their copies for drawing
+	MEMORY_DRAW,     // per frame data on its way to the GPU
+	MEMORY_SWARM,    // agent arrays of the boids
+	MEMORY_MAPPED,   // mapped files : address space, the OS pages them in and out
+	MEMORY_TAG_COUNT
+};
+
+void track_allocation(MemoryTag tag, size_t bytes);
+void track_free(MemoryTag tag, size_t bytes);
+
+// Allocator for the standard containers that counts what they hold under Tag,
+// e.g. std::vector<float, TrackedAllocator<float, MEMORY_SWARM> >
+template <typename T, MemoryTag Tag>
+class TrackedAllocator {
+public:
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind {
+		typedef TrackedAllocator<U, Tag> other;
+	};
+
+	TrackedAllocator() {}
+	template <typename U>
+	TrackedAllocator(const TrackedAllocator<U, Tag>&) {}
+
+	T * allocate(size_t count) {
+		T * p = static_cast<T *>(::operator new(count * sizeof(T)));
+		track_allocation(Tag, count * sizeof(T));
+		return p;
+	}
+
+	void deallocate(T * p, size_t count) {
+		track_free(Tag, count * sizeof(T));
+		::operator delete(p);
+	}
+
+	template <typename U>
+	bool operator==(const TrackedAllocator<U, Tag>&) const { return true; }
+	template <typename U>
+	bool operator!=(const TrackedAllocator<U, Tag>&) const { return false; }
+};
+
+// Registry of the GL objects that hold memory, GL thread only. Tracking an
+// object again replaces what was known of it, so call it after every
+// glBufferData or storage allocation. Sizes of textures and renderbuffers are
+// estimates : the driver may pad, and RGB is counted as 4 bytes per texel.
+enum GpuResourceKind {
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_RENDERBUFFER,
+	GPU_KIND_COUNT
+};
+
+// format : the usage hint of buffers, the internal format of the others.
+// samples : 0 or 1 unless multisampled.
+void track_gpu_resource(
+	GpuResourceKind kind, unsigned int id, const char * label, size_t bytes, unsigned int format,
+	int width = 0, int height = 0, int depth = 0, int levels = 0, int samples = 0
+);
+void untrack_gpu_resource(GpuResourceKind kind, unsigned int id);
+
+// glDeleteBuffers and the others, untracking the objects first
+void delete_tracked_buffers(int count, const unsigned int * ids);
+void delete_tracked_textures(int count, const unsigned int * ids);
+void delete_tracked_renderbuffers(int count, const unsigned int * ids);
+
+// Bytes of a texture of that format with levels mipmaps, all of them for 0.
+// Compressed formats count whole blocks.
+size_t texture_bytes(unsigned int internal_format, int width, int height, int depth, int levels);
+
+// One line : CPU per tag, GPU per kind
+void print_memory_summary();
+
+// Every tag with its peak and allocation count, then every GL object, largest first
+void print_memory_dump();
+
+// GL objects still tracked, for after the cleanup : every one is a leak.
+// Returns how many there were.
+int print_gpu_leaks();
+
+// A SIGUSR1 (SIGBREAK on Windows, Ctrl+Break) asks for a dump. The handler only
+// raises a flag, the main loop polls it and dumps at a safe point.
+void install_memory_dump_signal();
+bool memory_dump_requested(); // clears the request
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "meshopt.hpp"
+
+// Vertex cache the orders are made for and measured with. Small enough for any
+// GPU, the bigger ones only do better.
+static const int mesh_cache_size = 16;
+
+// All the attributes of a vertex, compared bit for bit
+struct VertexKey {
+	float values[12];
+
+	bool operator==(const VertexKey& other) const {
+		return memcmp(values, other.values, sizeof(values)) == 0;
+	}
+};
+
+struct VertexKeyHash {
+	size_t operator()(const VertexKey& key) const {
+		// FNV-1a over the bytes
+		const unsigned char* bytes = (const unsigned char*)key.values;
+		unsigned int hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(key.values); i++)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+};
+
+void index_mesh(
+	const glm::vec3* positions, const glm::vec2* uvs, const glm::vec3* normals, const glm::vec4* colors,
+	int vertex_count, IndexedMesh& mesh
+) {
+	mesh.positions.clear();
+	mesh.uvs.clear();
+	mesh.normals.clear();
+	mesh.colors.clear();
+	mesh.indices.resize(vertex_count);
+
+	std::unordered_map<VertexKey, unsigned int, VertexKeyHash> unique;
+	for (int i = 0; i < vertex_count; i++) {
+		VertexKey key;
+		memset(key.values, 0, sizeof(key.values));
+		memcpy(key.values, &positions[i], sizeof(glm::vec3));
+		if (uvs)
+			memcpy(key.values + 3, &uvs[i], sizeof(glm::vec2));
+		if (normals)
+			memcpy(key.values + 5, &normals[i], sizeof(glm::vec3));
+		if (colors)
+			memcpy(key.values + 8, &colors[i], sizeof(glm::vec4));
+
+		std::pair<std::unordered_map<VertexKey, unsigned int, VertexKeyHash>::iterator, bool> found =
+			unique.insert(std::make_pair(key, (unsigned int)mesh.positions.size()));
+		if (found.second) {
+			mesh.positions.push_back(positions[i]);
+			if (uvs)
+				mesh.uvs.push_back(uvs[i]);
+			if (normals)
+				mesh.normals.push_back(normals[i]);
+			if (colors)
+				mesh.colors.push_back(colors[i]);
+		}
+		mesh.indices[i] = found.first->second;
+	}
+}
+
+MeshCacheStats get_cache_stats(const std::vector<unsigned int>& indices, int vertex_count, int cache_size) {
+	// FIFO : a hit doesn't move the vertex, a miss pushes the oldest one out
+	std::vector<int> cache(cache_size, -1);
+	std::vector<int> cache_slot(vertex_count, -1);
+	int next = 0;
+	int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int v = indices[i];
+		if (cache_slot[v] >= 0)
+			continue;
+		misses++;
+		if (cache[next] >= 0)
+			cache_slot[cache[next]] = -1;
+		cache[next] = v;
+		cache_slot[v] = next;
+		next = (next + 1) % cache_size;
+	}
+
+	MeshCacheStats stats;
+	int triangle_count = indices.size() / 3;
+	stats.acmr = triangle_count ? (float)misses / triangle_count : 0;
+	stats.atvr = vertex_count ? (float)misses / vertex_count : 0;
+	return stats;
+}
+
+// Next vertex to fan around once the current one is done
+static int skip_dead_end(
+	const std::vector<int>& live, std::vector<unsigned int>& dead_ends, int& cursor, int vertex_count
+) {
+	// Recently used vertices first, they may still be in the cache
+	while (!dead_ends.empty()) {
+		unsigned int v = dead_ends.back();
+		dead_ends.pop_back();
+		if (live[v] > 0)
+			return v;
+	}
+	// Then any vertex with triangles left, in input order
+	while (cursor < vertex_count) {
+		if (live[cursor] > 0)
+			return cursor;
+		cursor++;
+	}
+	return -1;
+}
+
+void optimize_vertex_cache(
+	std::vector<unsigned int>& indices, int vertex_count, int cache_size, std::vector<int>& cluster_starts
+) {
+	int triangle_count = indices.size() / 3;
+	cluster_starts.clear();
+	if (triangle_count == 0)
+		return;
+
+	// Triangles of every vertex, packed
+	std::vector<int> live(vertex_count, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		live[indices[i]]++;
+	std::vector<int> first(vertex_count + 1, 0);
+	for (int v = 0; v < vertex_count; v++)
+		first[v + 1] = first[v] + live[v];
+	std::vector<int> adjacency(indices.size());
+	std::vector<int> fill(first.begin(), first.end() - 1);
+	for (int t = 0; t < triangle_count; t++) {
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+	}
+
+	std::vector<int> timestamps(vertex_count, 0);
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<unsigned int> dead_ends;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	int time = cache_size + 1;
+	int cursor = 0;
+	int fan = 0;
+	cluster_starts.push_back(0);
+	while (fan >= 0) {
+		// Every triangle left around the fanning vertex
+		candidates.clear();
+		for (int a = first[fan]; a < first[fan + 1]; a++) {
+			int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[t * 3 + k];
+				output.push_back(v);
+				dead_ends.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - timestamps[v] > cache_size)
+					timestamps[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// The candidate that will stay in the cache longest while fanning around it
+		int next = -1;
+		int best = -1;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			unsigned int v = candidates[i];
+			if (live[v] <= 0)
+				continue;
+			int priority = 0;
+			if (time - timestamps[v] + 2 * live[v] <= cache_size)
+				priority = time - timestamps[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		if (next < 0) {
+			next = skip_dead_end(live, dead_ends, cursor, vertex_count);
+			if (next >= 0 && output.size() < indices.size())
+				cluster_starts.push_back(output.size() / 3);
+		}
+		fan = next;
+	}
+
+	indices.swap(output);
+}
+
+void optimize_overdraw(
+	std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, const std::vector<int>& cluster_starts
+) {
+	int triangle_count = indices.size() / 3;
+	int cluster_count = cluster_starts.size();
+	if (cluster_count < 2)
+		return;
+
+	// Area weighted centroid of the whole mesh
+	glm::vec3 mesh_center(0.0f);
+	float mesh_area = 0;
+	for (int t = 0; t < triangle_count; t++) {
+		glm::vec3 p0 = positions[indices[t * 3]], p1 = positions[indices[t * 3 + 1]], p2 = positions[indices[t * 3 + 2]];
+		float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+		mesh_center += (p0 + p1 + p2) * (area / 3);
+		mesh_area += area;
+	}
+	if (mesh_area > 0)
+		mesh_center /= mesh_area;
+
+	// How much each cluster faces outward : its average normal along the way from the center
+	std::vector< std::pair<float, int> > order(cluster_count);
+	for (int c = 0; c < cluster_count; c++) {
+		int end = c + 1 < cluster_count ? cluster_starts[c + 1] : triangle_count;
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area_sum = 0;
+		for (int t = cluster_starts[c]; t < end; t++) {
+			glm::vec3 p0 = positions[indices[t * 3]], p1 = positions[indices[t * 3 + 1]], p2 = positions[indices[t * 3 + 2]];
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0); // length : twice the area
+			float area = glm::length(n);
+			center += (p0 + p1 + p2) * (area / 3);
+			normal += n;
+			area_sum += area;
+		}
+		if (area_sum > 0)
+			center /= area_sum;
+		float normal_length = glm::length(normal);
+		if (normal_length > 0)
+			normal /= normal_length;
+		// Sorted ascending, so the most outward goes first
+		order[c] = std::make_pair(-glm::dot(center - mesh_center, normal), c);
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	for (int i = 0; i < cluster_count; i++) {
+		int c = order[i].second;
+		int end = c + 1 < cluster_count ? cluster_starts[c + 1] : triangle_count;
+		output.insert(output.end(), indices.begin() + cluster_starts[c] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(output);
+}
+
+template <typename T>
+static void remap_attribute(std::vector<T>& values, const std::vector<unsigned int>& old_index) {
+	if (values.empty())
+		return;
+	std::vector<T> remapped(old_index.size());
+	for (size_t i = 0; i < old_index.size(); i++)
+		remapped[i] = values[old_index[i]];
+	values.swap(remapped);
+}
+
+void optimize_vertex_fetch(IndexedMesh& mesh) {
+	int vertex_count = mesh.positions.size();
+	std::vector<int> new_index(vertex_count, -1);
+	std::vector<unsigned int> old_index;
+	old_index.reserve(vertex_count);
+	for (size_t i = 0; i < mesh.indices.size(); i++) {
+		unsigned int v = mesh.indices[i];
+		if (new_index[v] < 0) {
+			new_index[v] = old_index.size();
+			old_index.push_back(v);
+		}
+		mesh.indices[i] = new_index[v];
+	}
+
+	// Vertices no triangle uses are dropped
+	remap_attribute(mesh.positions, old_index);
+	remap_attribute(mesh.uvs, old_index);
+	remap_attribute(mesh.normals, old_index);
+	remap_attribute(mesh.colors, old_index);
+}
+
+void optimize_mesh(IndexedMesh& mesh, const char* name) {
+	int vertex_count = mesh.positions.size();
+	MeshCacheStats before = get_cache_stats(mesh.indices, vertex_count, mesh_cache_size);
+
+	std::vector<int> cluster_starts;
+	optimize_vertex_cache(mesh.indices, vertex_count, mesh_cache_size, cluster_starts);
+	optimize_overdraw(mesh.indices, mesh.positions, cluster_starts);
+	optimize_vertex_fetch(mesh);
+
+	MeshCacheStats after = get_cache_stats(mesh.indices, mesh.positions.size(), mesh_cache_size);
+	printf("mesh %s : %d vertices, %d triangles in %d clusters, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		name, (int)mesh.positions.size(), (int)mesh.indices.size() / 3, (int)cluster_starts.size(),
+		before.acmr, after.acmr, before.atvr, after.atvr);
+}
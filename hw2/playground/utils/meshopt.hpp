@@ -0,0 +1,53 @@
+#ifndef MESHOPT_HPP
+#define MESHOPT_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Indexed triangle list. The attribute arrays a mesh doesn't have stay empty,
+// the others have one entry per vertex.
+struct IndexedMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec4> colors;
+	std::vector<unsigned int> indices;
+};
+
+// Post-transform cache behavior of an index order, on a FIFO cache
+struct MeshCacheStats {
+	float acmr; // transformed vertices per triangle : 3 without reuse, 0.5 at best
+	float atvr; // transformed vertices per vertex : 1 at best
+};
+
+// Vertices per triangle order from loadOBJ or the figures, NULL for the missing
+// attributes. Identical vertices are merged, the triangles keep their order.
+void index_mesh(
+	const glm::vec3* positions, const glm::vec2* uvs, const glm::vec3* normals, const glm::vec4* colors,
+	int vertex_count, IndexedMesh& mesh
+);
+
+MeshCacheStats get_cache_stats(const std::vector<unsigned int>& indices, int vertex_count, int cache_size);
+
+// Tipsify (Sander, Nehab and Barczak 2007) : fans around the vertices still in
+// the cache, in linear time. Every jump out of the cache neighborhood starts a
+// cluster, its first triangle goes to cluster_starts.
+void optimize_vertex_cache(
+	std::vector<unsigned int>& indices, int vertex_count, int cache_size, std::vector<int>& cluster_starts
+);
+
+// Moves whole clusters, so the cache order inside them holds : the ones facing
+// away from the center of the mesh first, as they tend to hide the others
+void optimize_overdraw(
+	std::vector<unsigned int>& indices, const std::vector<glm::vec3>& positions, const std::vector<int>& cluster_starts
+);
+
+// Vertices renumbered in the order the triangles first use them, so the
+// vertex fetches walk the buffers forward
+void optimize_vertex_fetch(IndexedMesh& mesh);
+
+// All of the above, with a line about the cache before and after
+void optimize_mesh(IndexedMesh& mesh, const char* name);
+
+#endif
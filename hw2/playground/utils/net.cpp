@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "net.hpp"
+
+// Big enough for a few hundred snapshot fragments arriving between two frames
+static const int socket_buffer_size = 4 << 20;
+
+#ifdef _WIN32
+static const unsigned long long no_socket = INVALID_SOCKET;
+#else
+static const int no_socket = -1;
+#endif
+
+
+bool resolve_address(const char * host, unsigned short port, NetAddress& address) {
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+		return false;
+#endif
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	addrinfo * result = NULL;
+	bool ok = getaddrinfo(host, NULL, &hints, &result) == 0 && result;
+	if (ok) {
+		address.ip = ntohl(((sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+		address.port = port;
+	} else {
+		printf("%s could not be resolved\n", host);
+	}
+	if (result)
+		freeaddrinfo(result);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return ok;
+}
+
+
+UdpSocket::UdpSocket() {
+	handle = no_socket;
+	port = 0;
+#ifdef _WIN32
+	winsock_started = false;
+#endif
+}
+
+UdpSocket::~UdpSocket() {
+	close();
+}
+
+bool UdpSocket::open(unsigned short port) {
+	close();
+
+#ifdef _WIN32
+	// Winsock counts the startups and cleanups itself
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+		printf("Winsock could not be started\n");
+		return false;
+	}
+	winsock_started = true;
+#endif
+
+	handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (handle == no_socket) {
+		printf("UDP socket could not be created\n");
+		close();
+		return false;
+	}
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(handle, (const sockaddr *)&address, sizeof(address)) != 0) {
+		printf("UDP port %u could not be bound\n", port);
+		close();
+		return false;
+	}
+
+	socklen_t length = sizeof(address);
+	getsockname(handle, (sockaddr *)&address, &length);
+	this->port = ntohs(address.sin_port);
+
+	setsockopt(handle, SOL_SOCKET, SO_RCVBUF, (const char *)&socket_buffer_size, sizeof(socket_buffer_size));
+	setsockopt(handle, SOL_SOCKET, SO_SNDBUF, (const char *)&socket_buffer_size, sizeof(socket_buffer_size));
+
+#ifdef _WIN32
+	u_long non_blocking = 1;
+	ioctlsocket(handle, FIONBIO, &non_blocking);
+#else
+	fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	return true;
+}
+
+void UdpSocket::close() {
+#ifdef _WIN32
+	if (handle != no_socket)
+		closesocket(handle);
+	if (winsock_started)
+		WSACleanup();
+	winsock_started = false;
+#else
+	if (handle != no_socket)
+		::close(handle);
+#endif
+	handle = no_socket;
+	port = 0;
+}
+
+bool UdpSocket::send(const NetAddress& to, const void * data, size_t size) {
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(to.ip);
+	address.sin_port = htons(to.port);
+	return sendto(handle, (const char *)data, (int)size, 0, (const sockaddr *)&address, sizeof(address)) == (int)size;
+}
+
+int UdpSocket::receive(NetAddress& from, void * data, size_t capacity) {
+	sockaddr_in address;
+	socklen_t length = sizeof(address);
+	int size = recvfrom(handle, (char *)data, (int)capacity, 0, (sockaddr *)&address, &length);
+	if (size < 0)
+		return -1;
+	from.ip = ntohl(address.sin_addr.s_addr);
+	from.port = ntohs(address.sin_port);
+	return size;
+}
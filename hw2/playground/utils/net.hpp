@@ -0,0 +1,46 @@
+#ifndef NET_HPP
+#define NET_HPP
+
+#include <stddef.h>
+
+// IPv4 address and port, in host byte order
+struct NetAddress {
+	unsigned int ip;
+	unsigned short port;
+
+	bool operator==(const NetAddress& other) const { return ip == other.ip && port == other.port; }
+};
+
+bool resolve_address(const char * host, unsigned short port, NetAddress& address);
+
+// Non-blocking UDP socket
+class UdpSocket {
+public:
+	UdpSocket();
+	~UdpSocket();
+
+	// Port 0 lets the OS pick one, see get_port()
+	bool open(unsigned short port);
+	void close();
+
+	unsigned short get_port() const { return port; }
+
+	bool send(const NetAddress& to, const void * data, size_t size);
+
+	// Size of the datagram, -1 when nothing is waiting
+	int receive(NetAddress& from, void * data, size_t capacity);
+
+private:
+	UdpSocket(const UdpSocket&);
+	UdpSocket& operator=(const UdpSocket&);
+
+#ifdef _WIN32
+	unsigned long long handle; // SOCKET
+	bool winsock_started;
+#else
+	int handle;
+#endif
+	unsigned short port;
+};
+
+#endif
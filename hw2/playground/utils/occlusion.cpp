@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "occlusion.hpp"
+#include "simd.hpp"
+
+using namespace glm;
+
+OcclusionCuller::OcclusionCuller(int width, int height) {
+	this->width = (width + 3) & ~3;
+	this->height = height;
+
+	int w = this->width, h = this->height;
+	while (true) {
+		level_width.push_back(w);
+		level_height.push_back(h);
+		levels_max.push_back(std::vector<float>(w * h, 1.0f));
+		levels_min.push_back(std::vector<float>(levels_max.size() > 1 ? w * h : 0, 1.0f));
+		if (w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+
+	VP = mat4(1.0f);
+	frame_count = 0;
+	tested_total = outside_total = occluded_total = 0;
+	occluder_triangles = 0;
+}
+
+void OcclusionCuller::begin_frame(const mat4& VP) {
+	this->VP = VP;
+	std::vector<float>& depth = levels_max[0];
+	for (size_t i = 0; i < depth.size(); i++)
+		depth[i] = 1.0f;
+	occluder_triangles = 0;
+}
+
+void OcclusionCuller::add_occluder(const float* vertices, int polygon_count, const mat4& model) {
+	mat4 MVP = VP * model;
+	for (int i = 0; i < polygon_count; i++) {
+		const float* v = vertices + i * 9;
+		raster_triangle(
+			MVP * vec4(v[0], v[1], v[2], 1.0f),
+			MVP * vec4(v[3], v[4], v[5], 1.0f),
+			MVP * vec4(v[6], v[7], v[8], 1.0f)
+		);
+	}
+}
+
+void OcclusionCuller::raster_triangle(const vec4& c0, const vec4& c1, const vec4& c2) {
+	// No clipping : a triangle crossing the near plane just doesn't occlude
+	const float min_w = 1e-4f;
+	if (c0.w < min_w || c1.w < min_w || c2.w < min_w)
+		return;
+
+	float x[3], y[3], z[3];
+	const vec4* c[3] = { &c0, &c1, &c2 };
+	for (int i = 0; i < 3; i++) {
+		float inv_w = 1.0f / c[i]->w;
+		x[i] = (c[i]->x * inv_w * 0.5f + 0.5f) * width;
+		y[i] = (c[i]->y * inv_w * 0.5f + 0.5f) * height;
+		z[i] = c[i]->z * inv_w * 0.5f + 0.5f;
+	}
+
+	// Counter-clockwise in window space is front facing
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area <= 0)
+		return;
+
+	int min_x = (int)floorf(fminf(x[0], fminf(x[1], x[2])));
+	int max_x = (int)ceilf(fmaxf(x[0], fmaxf(x[1], x[2])));
+	int min_y = (int)floorf(fminf(y[0], fminf(y[1], y[2])));
+	int max_y = (int)ceilf(fmaxf(y[0], fmaxf(y[1], y[2])));
+	if (min_x < 0) min_x = 0;
+	if (min_y < 0) min_y = 0;
+	if (max_x > width - 1) max_x = width - 1;
+	if (max_y > height - 1) max_y = height - 1;
+	if (min_x > max_x || min_y > max_y)
+		return;
+	min_x &= ~3;
+
+	// Edge functions E(x, y) = A*x + B*y + C, positive inside
+	float A[3], B[3], C[3];
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		A[i] = y[i] - y[j];
+		B[i] = x[j] - x[i];
+		C[i] = -(A[i] * x[i] + B[i] * y[i]);
+	}
+
+	// Depth plane, moved to its farthest point inside the pixel
+	float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	float z_bias = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+	float z_origin = z[0] - dzdx * x[0] - dzdy * y[0] + z_bias;
+
+	float* depth = &levels_max[0][0];
+	occluder_triangles++;
+
+#ifdef SIMD_SSE2
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+	__m128 step[3];
+	for (int i = 0; i < 3; i++)
+		step[i] = _mm_set1_ps(A[i] * 4);
+	__m128 z_step = _mm_set1_ps(dzdx * 4);
+
+	for (int py = min_y; py <= max_y; py++) {
+		float center_y = py + 0.5f;
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)min_x), offsets);
+		__m128 e[3];
+		for (int i = 0; i < 3; i++)
+			e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[i]), px), _mm_set1_ps(B[i] * center_y + C[i]));
+		__m128 zv = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * center_y + z_origin));
+
+		float* row = depth + py * width;
+		for (int px4 = min_x; px4 <= max_x; px4 += 4) {
+			__m128 inside = _mm_and_ps(_mm_and_ps(
+				_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+			if (_mm_movemask_ps(inside)) {
+				__m128 old = _mm_loadu_ps(row + px4);
+				__m128 nearest = _mm_min_ps(old, zv);
+				_mm_storeu_ps(row + px4, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+			for (int i = 0; i < 3; i++)
+				e[i] = _mm_add_ps(e[i], step[i]);
+			zv = _mm_add_ps(zv, z_step);
+		}
+	}
+#else
+	for (int py = min_y; py <= max_y; py++) {
+		float center_y = py + 0.5f;
+		float* row = depth + py * width;
+		for (int px = min_x; px <= max_x; px++) {
+			float center_x = px + 0.5f;
+			if (A[0] * center_x + B[0] * center_y + C[0] < 0 ||
+				A[1] * center_x + B[1] * center_y + C[1] < 0 ||
+				A[2] * center_x + B[2] * center_y + C[2] < 0)
+				continue;
+			float zp = z_origin + dzdx * center_x + dzdy * center_y;
+			if (zp < row[px])
+				row[px] = zp;
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::build_pyramid() {
+	for (size_t level = 1; level < levels_max.size(); level++) {
+		int src_width = level_width[level - 1], src_height = level_height[level - 1];
+		const float* src_max = &levels_max[level - 1][0];
+		// Level 0 is both the min and the max
+		const float* src_min = level == 1 ? src_max : &levels_min[level - 1][0];
+		float* dst_max = &levels_max[level][0];
+		float* dst_min = &levels_min[level][0];
+		int dst_width = level_width[level], dst_height = level_height[level];
+
+		for (int y = 0; y < dst_height; y++) {
+			int y0 = y * 2, y1 = y * 2 + 1 < src_height ? y * 2 + 1 : y * 2;
+			for (int x = 0; x < dst_width; x++) {
+				int x0 = x * 2, x1 = x * 2 + 1 < src_width ? x * 2 + 1 : x * 2;
+				int a = y0 * src_width + x0, b = y0 * src_width + x1;
+				int c = y1 * src_width + x0, d = y1 * src_width + x1;
+				dst_max[y * dst_width + x] = fmaxf(fmaxf(src_max[a], src_max[b]), fmaxf(src_max[c], src_max[d]));
+				dst_min[y * dst_width + x] = fminf(fminf(src_min[a], src_min[b]), fminf(src_min[c], src_min[d]));
+			}
+		}
+	}
+}
+
+// Corners of the bounding box of a sphere in clip space, and whether it is
+// outside the frustum : all the corners on the outer side of one plane
+static bool get_clip_corners(const mat4& VP, vec3 center, float radius, vec4 corners[8]) {
+	vec4 c = VP * vec4(center, 1.0f);
+	vec4 ex = VP[0] * radius, ey = VP[1] * radius, ez = VP[2] * radius;
+	int out_left = 0, out_right = 0, out_bottom = 0, out_top = 0, out_near = 0, out_far = 0;
+	for (int i = 0; i < 8; i++) {
+		vec4& p = corners[i];
+		p = c + (i & 1 ? ex : -ex) + (i & 2 ? ey : -ey) + (i & 4 ? ez : -ez);
+		out_left += p.x < -p.w;
+		out_right += p.x > p.w;
+		out_bottom += p.y < -p.w;
+		out_top += p.y > p.w;
+		out_near += p.z < -p.w;
+		out_far += p.z > p.w;
+	}
+	return out_left == 8 || out_right == 8 || out_bottom == 8 || out_top == 8 || out_near == 8 || out_far == 8;
+}
+
+bool OcclusionCuller::in_frustum(vec3 center, float radius) const {
+	vec4 corners[8];
+	return !get_clip_corners(VP, center, radius, corners);
+}
+
+CullResult OcclusionCuller::classify(vec3 center, float radius) const {
+	vec4 corners[8];
+	if (get_clip_corners(VP, center, radius, corners))
+		return CULL_OUTSIDE;
+
+	// Can't be projected, too close to be hidden anyway
+	bool crosses_near = false;
+	for (int i = 0; i < 8; i++)
+		crosses_near |= corners[i].w < 1e-4f;
+	if (crosses_near)
+		return CULL_VISIBLE;
+
+	float min_x = 1e30f, max_x = -1e30f, min_y = 1e30f, max_y = -1e30f, min_z = 1e30f;
+	for (int i = 0; i < 8; i++) {
+		float inv_w = 1.0f / corners[i].w;
+		float x = corners[i].x * inv_w, y = corners[i].y * inv_w, z = corners[i].z * inv_w;
+		min_x = fminf(min_x, x); max_x = fmaxf(max_x, x);
+		min_y = fminf(min_y, y); max_y = fmaxf(max_y, y);
+		min_z = fminf(min_z, z);
+	}
+	float nearest = min_z * 0.5f + 0.5f;
+
+	int x0 = (int)floorf((min_x * 0.5f + 0.5f) * width);
+	int x1 = (int)floorf((max_x * 0.5f + 0.5f) * width);
+	int y0 = (int)floorf((min_y * 0.5f + 0.5f) * height);
+	int y1 = (int)floorf((max_y * 0.5f + 0.5f) * height);
+	x0 = x0 < 0 ? 0 : (x0 > width - 1 ? width - 1 : x0);
+	y0 = y0 < 0 ? 0 : (y0 > height - 1 ? height - 1 : y0);
+	x1 = x1 < x0 ? x0 : (x1 > width - 1 ? width - 1 : x1);
+	y1 = y1 < y0 ? y0 : (y1 > height - 1 ? height - 1 : y1);
+
+	// Level where the rectangle covers about 2x2 texels, and the one above it
+	int level = 0;
+	int size = (x1 - x0 > y1 - y0 ? x1 - x0 : y1 - y0) + 1;
+	while (size > 2 && level + 1 < (int)levels_max.size()) {
+		size = (size + 1) / 2;
+		level++;
+	}
+	int coarse = level + 1 < (int)levels_max.size() ? level + 1 : level;
+
+	// Coarse level : behind every max is hidden, in front of a min is visible
+	{
+		const float* texel_max = &levels_max[coarse][0];
+		const float* texel_min = coarse == 0 ? texel_max : &levels_min[coarse][0];
+		int w = level_width[coarse];
+		bool hidden = true;
+		for (int y = y0 >> coarse; y <= y1 >> coarse; y++) {
+			for (int x = x0 >> coarse; x <= x1 >> coarse; x++) {
+				if (nearest < texel_min[y * w + x])
+					return CULL_VISIBLE;
+				if (nearest <= texel_max[y * w + x])
+					hidden = false;
+			}
+		}
+		if (hidden)
+			return CULL_OCCLUDED;
+	}
+
+	// Finer level, max only
+	const float* texel_max = &levels_max[level][0];
+	int w = level_width[level];
+	for (int y = y0 >> level; y <= y1 >> level; y++)
+		for (int x = x0 >> level; x <= x1 >> level; x++)
+			if (nearest <= texel_max[y * w + x])
+				return CULL_VISIBLE;
+	return CULL_OCCLUDED;
+}
+
+void OcclusionCuller::count(int tested, int outside, int occluded) {
+	frame_count++;
+	tested_total += tested;
+	outside_total += outside;
+	occluded_total += occluded;
+}
+
+void OcclusionCuller::print_report() const {
+	printf("occlusion culling : %dx%d depth buffer, %d frames\n", width, height, frame_count);
+	if (frame_count == 0 || tested_total == 0)
+		return;
+	printf("  %.1f objects tested per frame, %.1f%% outside the frustum, %.1f%% occluded\n",
+		(double)tested_total / frame_count,
+		100.0 * outside_total / tested_total, 100.0 * occluded_total / tested_total);
+}
@@ -0,0 +1,71 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+enum CullResult {
+	CULL_VISIBLE = 0,
+	CULL_OUTSIDE = 1,  // of the view frustum
+	CULL_OCCLUDED = 2,
+};
+
+// Software occlusion culling against a small depth buffer.
+//
+// A frame goes : begin_frame() with the view-projection matrix, add_occluder()
+// for the few objects closest to the camera, build_pyramid(), then classify()
+// every object about to be drawn. Occluders are rasterized 4 pixels at a time
+// with SSE2 at a fraction of the screen resolution, keeping the nearest depth.
+// The pyramid then holds, for every level, the farthest (max) and nearest (min)
+// depth under each texel. An object is tested on the texels of two levels around
+// the size of its bounds : on the coarse one, behind every max is hidden and in
+// front of a min is visible, the finer one settles the rest with its max.
+//
+// Coverage is sampled at pixel centers like GL does, so an object peeking out
+// by less than a low resolution pixel next to an occluder edge can be culled.
+// Depth is stored as the farthest point of the occluder inside each pixel.
+class OcclusionCuller {
+public:
+	// width is rounded up to a multiple of 4
+	OcclusionCuller(int width = 256, int height = 192);
+
+	void begin_frame(const glm::mat4& VP);
+
+	// Same vertex layout as draw_object : 3 floats per vertex, 3 vertices per
+	// polygon, counter-clockwise front faces. Closed meshes only : back faces are
+	// skipped, and so are triangles crossing the near plane.
+	void add_occluder(const float* vertices, int polygon_count, const glm::mat4& model);
+
+	void build_pyramid();
+
+	// Bounding sphere against the frustum only, usable before build_pyramid()
+	bool in_frustum(glm::vec3 center, float radius) const;
+
+	// Bounding sphere against the frustum and the pyramid, read only
+	CullResult classify(glm::vec3 center, float radius) const;
+
+	// Statistics of a frame, from the classify() results
+	void count(int tested, int outside, int occluded);
+	void print_report() const;
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+	int get_occluder_triangles() const { return occluder_triangles; }
+
+private:
+	void raster_triangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2);
+
+	int width, height;
+	glm::mat4 VP;
+
+	std::vector<int> level_width, level_height;
+	std::vector< std::vector<float> > levels_max; // level 0 is the depth buffer itself
+	std::vector< std::vector<float> > levels_min; // level 0 unused, same as the max
+
+	int frame_count;
+	long long tested_total, outside_total, occluded_total;
+	int occluder_triangles;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "overdraw.hpp"
+
+static const char* pass_names[pass_count] = { "opaque", "transparent" };
+
+OverdrawCounter::OverdrawCounter() {
+	for (int i = 0; i < ring_size; i++) {
+		for (int pass = 0; pass < pass_count; pass++) {
+			queries[i][pass] = 0;
+			issued[i][pass] = false;
+		}
+		viewport_samples[i] = 0;
+	}
+	slot = 0;
+	for (int pass = 0; pass < pass_count; pass++)
+		fragments_total[pass] = 0;
+	samples_total = 0;
+	frame_count = 0;
+}
+
+void OverdrawCounter::init() {
+	glGenQueries(ring_size * pass_count, &queries[0][0]);
+}
+
+void OverdrawCounter::cleanup() {
+	glDeleteQueries(ring_size * pass_count, &queries[0][0]);
+}
+
+void OverdrawCounter::begin_pass(RenderPass pass) {
+	if (!issued[slot][PASS_OPAQUE] && !issued[slot][PASS_TRANSPARENT]) {
+		// Samples of the target the frame is drawn into, whatever its resolution
+		GLint viewport[4];
+		GLint samples = 0;
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		glGetIntegerv(GL_SAMPLES, &samples);
+		viewport_samples[slot] = (double)viewport[2] * viewport[3] * (samples > 0 ? samples : 1);
+	}
+	glBeginQuery(GL_SAMPLES_PASSED, queries[slot][pass]);
+	issued[slot][pass] = true;
+}
+
+void OverdrawCounter::end_pass() {
+	glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void OverdrawCounter::end_frame() {
+	slot = (slot + 1) % ring_size;
+
+	// The oldest frame of the ring, about to be reused
+	bool any = false;
+	for (int pass = 0; pass < pass_count; pass++) {
+		if (!issued[slot][pass])
+			continue;
+		GLuint64 fragments = 0;
+		glGetQueryObjectui64v(queries[slot][pass], GL_QUERY_RESULT, &fragments);
+		fragments_total[pass] += (double)fragments;
+		issued[slot][pass] = false;
+		any = true;
+	}
+	if (any) {
+		samples_total += viewport_samples[slot];
+		frame_count++;
+	}
+}
+
+void OverdrawCounter::print_report() const {
+	printf("overdraw : %d frames\n", frame_count);
+	if (samples_total == 0)
+		return;
+	for (int pass = 0; pass < pass_count; pass++)
+		printf("  %s pass : %.2f fragments per sample\n", pass_names[pass], fragments_total[pass] / samples_total);
+}
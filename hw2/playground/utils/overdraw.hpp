@@ -0,0 +1,43 @@
+#ifndef OVERDRAW_HPP
+#define OVERDRAW_HPP
+
+enum RenderPass {
+	PASS_OPAQUE = 0,
+	PASS_TRANSPARENT = 1,
+	pass_count
+};
+
+// Debug mode counting the fragments of every pass with GL_SAMPLES_PASSED
+// queries : samples that passed the depth test, divided by the samples of the
+// viewport. 1.0 for the opaque pass means every covered pixel was shaded once.
+// Results are read back ring_size frames later, waiting for them if needed.
+class OverdrawCounter {
+public:
+	OverdrawCounter();
+
+	void init();
+	void cleanup();
+
+	// Around the draws of a pass, at most once per frame and pass
+	void begin_pass(RenderPass pass);
+	void end_pass();
+
+	// After the last pass of the frame
+	void end_frame();
+
+	void print_report() const;
+
+private:
+	static const int ring_size = 3;
+
+	GLuint queries[ring_size][pass_count];
+	bool issued[ring_size][pass_count];
+	double viewport_samples[ring_size];
+	int slot;
+
+	double fragments_total[pass_count];
+	double samples_total;
+	int frame_count;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <thread>
+#include <chrono>
+
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+
+#include "pacing.hpp"
+
+// sleep_for usually oversleeps by a millisecond or so : the last part of a wait is spun
+static const double spin_duration = 0.002;
+
+// Longest wait for a frame fence before giving up on it, in nanoseconds
+static const GLuint64 fence_timeout = 1000000000;
+
+
+FramePacer::Stats::Stats() {
+	for (int i = 0; i < bin_count; i++)
+		bins[i] = 0;
+	count = 0;
+	sum = 0;
+	worst = 0;
+}
+
+void FramePacer::Stats::add(double ms) {
+	int bin = (int)(ms * 10);
+	bins[bin < 0 ? 0 : (bin < bin_count ? bin : bin_count - 1)]++;
+	count++;
+	sum += ms;
+	if (ms > worst)
+		worst = ms;
+}
+
+void FramePacer::Stats::print(const char * name) const {
+	if (count == 0)
+		return;
+
+	int p99_bin = bin_count - 1;
+	int seen = 0;
+	for (int i = 0; i < bin_count; i++) {
+		seen += bins[i];
+		if (seen * 100 >= count * 99) {
+			p99_bin = i;
+			break;
+		}
+	}
+	printf("  %-16s avg %6.2f ms, 99%% < %6.1f ms, worst %6.2f ms\n", name, sum / count, (p99_bin + 1) * 0.1, worst);
+}
+
+
+FramePacer::FramePacer() {
+	swap_interval = 1;
+	max_frames_in_flight = 2;
+	frame_duration = 0;
+	for (int i = 0; i < max_fences; i++)
+		fences[i] = 0;
+	frame_index = 0;
+	next_frame_time = input_time = last_submit_time = 0;
+}
+
+void FramePacer::init(int swap_interval, int max_frames_in_flight, double fps_cap) {
+	if (max_frames_in_flight < 1) max_frames_in_flight = 1;
+	if (max_frames_in_flight > max_fences) max_frames_in_flight = max_fences;
+
+	this->swap_interval = swap_interval;
+	this->max_frames_in_flight = max_frames_in_flight;
+	frame_duration = fps_cap > 0 ? 1.0 / fps_cap : 0;
+
+	glfwSwapInterval(swap_interval);
+	next_frame_time = glfwGetTime();
+}
+
+void FramePacer::cleanup() {
+	for (int i = 0; i < max_fences; i++) {
+		if (fences[i])
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+}
+
+void FramePacer::wait_for_frame() {
+	// GPU : the frame that used this slot max_frames_in_flight frames ago has to be done
+	int slot = frame_index % max_frames_in_flight;
+	if (fences[slot]) {
+		glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, fence_timeout);
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+	}
+
+	// CPU : frame rate cap
+	if (frame_duration > 0) {
+		double now = glfwGetTime();
+		// More than a frame late : start again from now rather than catching up with a burst
+		if (now - next_frame_time > frame_duration)
+			next_frame_time = now;
+
+		double remaining = next_frame_time - now;
+		if (remaining > spin_duration)
+			std::this_thread::sleep_for(std::chrono::duration<double>(remaining - spin_duration));
+		while (glfwGetTime() < next_frame_time)
+			std::this_thread::yield();
+
+		next_frame_time += frame_duration;
+	}
+}
+
+void FramePacer::input_sampled() {
+	input_time = glfwGetTime();
+}
+
+void FramePacer::input_sampled(double time) {
+	input_time = time;
+}
+
+void FramePacer::submitted() {
+	double now = glfwGetTime();
+	latency.add((now - input_time) * 1000);
+	if (last_submit_time > 0)
+		frame_time.add((now - last_submit_time) * 1000);
+	last_submit_time = now;
+
+	// Signaled once the GPU has executed every command of this frame
+	fences[frame_index % max_frames_in_flight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame_index++;
+}
+
+void FramePacer::print_report() const {
+	printf("frame pacing : swap interval %d, %d frame(s) in flight", swap_interval, max_frames_in_flight);
+	if (frame_duration > 0)
+		printf(", capped at %.1f fps", 1.0 / frame_duration);
+	printf(", %d frames\n", frame_index);
+	latency.print("input to submit");
+	frame_time.print("frame time");
+}
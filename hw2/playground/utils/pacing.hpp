@@ -0,0 +1,66 @@
+#ifndef PACING_HPP
+#define PACING_HPP
+
+// Frame pacing for the windowed loop, to keep the CPU from running ahead of
+// the GPU and the display and piling up input lag :
+// - swap interval (0 = no vsync, 1 = every refresh, ...)
+// - at most max_frames_in_flight frames queued on the GPU, enforced with fences
+// - optional frame-rate cap, slept for most of the wait and spun for the rest
+// A frame goes : wait_for_frame(), poll input (late, just before it is used),
+// input_sampled(), draw, submitted(), swap.
+class FramePacer {
+public:
+	FramePacer();
+
+	void init(int swap_interval, int max_frames_in_flight, double fps_cap);
+	void cleanup();
+
+	// Blocks until the frame may start
+	void wait_for_frame();
+
+	// The input of this frame has been read
+	void input_sampled();
+	// ... at time, glfwGetTime() of another thread, e.g. the simulation's
+	void input_sampled(double time);
+
+	// All the draw calls of this frame have been issued
+	void submitted();
+
+	// Input-to-submit latency and frame time statistics since init
+	void print_report() const;
+
+	// Average, 99th percentile and worst value of a series of durations,
+	// kept as a histogram of 0.1 ms bins so long sessions take no memory
+	class Stats {
+	public:
+		Stats();
+		void add(double ms);
+		void print(const char * name) const;
+
+	private:
+		static const int bin_count = 1000;
+		int bins[bin_count];
+		int count;
+		double sum;
+		double worst;
+	};
+
+private:
+	static const int max_fences = 8;
+
+	int swap_interval;
+	int max_frames_in_flight;
+	double frame_duration; // 0 when the frame rate is not capped
+
+	GLsync fences[max_fences];
+	int frame_index;
+
+	double next_frame_time;
+	double input_time;
+	double last_submit_time;
+
+	Stats latency;
+	Stats frame_time;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shaders.hpp"
+#include "memtrack.hpp"
+#include "particles.hpp"
+
+
+// Layout of one particle, matching the update shader outputs
+struct Particle {
+	glm::vec3 position;
+	glm::vec3 velocity;
+	float age;
+	float lifetime;
+};
+
+// Emitter texels unit, unit 0 is used by the object textures
+static const int emitter_texture_unit = 1;
+
+// load_program links right away, but the captured outputs have to be known before linking
+static GLuint load_feedback_program(const char * vertex_path, const char ** varyings, int varying_count) {
+	GLuint shader = compile_shader(GL_VERTEX_SHADER, vertex_path);
+	if (!shader)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glTransformFeedbackVaryings(program, varying_count, varyings, GL_INTERLEAVED_ATTRIBS);
+	bool linked = link_program(program);
+	if (linked)
+		glDetachShader(program, shader);
+	glDeleteShader(shader);
+	return linked ? program : 0;
+}
+
+
+ParticleSystem::ParticleSystem() {
+	particle_count = 0;
+	current = 0;
+	time = 0;
+	buffers[0] = buffers[1] = 0;
+	vaos[0] = vaos[1] = 0;
+	update_program = render_program = 0;
+	emitter_buffer = emitter_texture = 0;
+	emitter_count = 0;
+}
+
+bool ParticleSystem::init(int particle_count) {
+	this->particle_count = particle_count;
+
+	const char * varyings[] = { "outPosition", "outVelocity", "outAge", "outLifetime" };
+	update_program = load_feedback_program("ParticleUpdateVertexShader.vertexshader", varyings, 4);
+	if (!update_program)
+		return false;
+	DeltaTimeID = glGetUniformLocation(update_program, "DeltaTime");
+	TimeID = glGetUniformLocation(update_program, "Time");
+	EmitterCountID = glGetUniformLocation(update_program, "EmitterCount");
+	EmittersID = glGetUniformLocation(update_program, "Emitters");
+
+	render_program = load_program("ParticleVertexShader.vertexshader", "ParticleFragmentShader.fragmentshader");
+	VPID = glGetUniformLocation(render_program, "VP");
+	PointScaleID = glGetUniformLocation(render_program, "PointScale");
+
+	// Everything starts dead, age == lifetime
+	std::vector<Particle> particles(particle_count);
+	for (int i = 0; i < particle_count; i++) {
+		particles[i].position = glm::vec3(0, 0, 0);
+		particles[i].velocity = glm::vec3(0, 0, 0);
+		particles[i].age = 0;
+		particles[i].lifetime = 0;
+	}
+
+	glGenBuffers(2, buffers);
+	glGenVertexArrays(2, vaos);
+	for (int i = 0; i < 2; i++) {
+		glBindVertexArray(vaos[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, particle_count * sizeof(Particle), &particles[0], GL_DYNAMIC_COPY);
+		track_gpu_resource(GPU_BUFFER, buffers[i], "particles", particle_count * sizeof(Particle), GL_DYNAMIC_COPY);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(sizeof(glm::vec3)));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(2 * sizeof(glm::vec3)));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)(2 * sizeof(glm::vec3) + sizeof(float)));
+	}
+	glBindVertexArray(0);
+
+	// Emitter positions, read by the update shader through a buffer texture
+	glGenBuffers(1, &emitter_buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, emitter_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+	track_gpu_resource(GPU_BUFFER, emitter_buffer, "particle emitters", 2 * sizeof(glm::vec4), GL_STREAM_DRAW);
+	// The texture only views the buffer, it has no storage to track
+	glGenTextures(1, &emitter_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, emitter_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, emitter_buffer);
+
+	return render_program != 0;
+}
+
+void ParticleSystem::cleanup() {
+	delete_tracked_buffers(2, buffers);
+	glDeleteVertexArrays(2, vaos);
+	delete_tracked_buffers(1, &emitter_buffer);
+	glDeleteTextures(1, &emitter_texture);
+	glDeleteProgram(update_program);
+	glDeleteProgram(render_program);
+	buffers[0] = buffers[1] = vaos[0] = vaos[1] = 0;
+	emitter_buffer = emitter_texture = update_program = render_program = 0;
+}
+
+void ParticleSystem::update(
+	const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& previous_positions,
+	float deltaTime
+) {
+	time += deltaTime;
+
+	emitter_count = positions.size();
+	if (emitter_count > 0) {
+		emitter_data.resize(emitter_count * 2);
+		for (int i = 0; i < emitter_count; i++) {
+			emitter_data[i * 2] = glm::vec4(positions[i], 1);
+			emitter_data[i * 2 + 1] = glm::vec4(previous_positions[i], 1);
+		}
+		// Orphan the storage of the last step
+		glBindBuffer(GL_TEXTURE_BUFFER, emitter_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, emitter_data.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, emitter_data.size() * sizeof(glm::vec4), &emitter_data[0]);
+		track_gpu_resource(GPU_BUFFER, emitter_buffer, "particle emitters", emitter_data.size() * sizeof(glm::vec4), GL_STREAM_DRAW);
+	}
+	simulate(deltaTime);
+}
+
+void ParticleSystem::update(GLuint emitter_source, int emitter_count, float deltaTime) {
+	time += deltaTime;
+
+	this->emitter_count = emitter_count;
+	if (emitter_count > 0) {
+		// Copied on the GPU, the emitters never come to the CPU
+		glBindBuffer(GL_TEXTURE_BUFFER, emitter_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, emitter_count * 2 * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		track_gpu_resource(GPU_BUFFER, emitter_buffer, "particle emitters", emitter_count * 2 * sizeof(glm::vec4), GL_STREAM_DRAW);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, emitter_source);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_TEXTURE_BUFFER, 0, 0, emitter_count * 2 * sizeof(glm::vec4));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	simulate(deltaTime);
+}
+
+void ParticleSystem::simulate(float deltaTime) {
+	glUseProgram(update_program);
+	glUniform1f(DeltaTimeID, deltaTime);
+	glUniform1f(TimeID, time);
+	glUniform1i(EmitterCountID, emitter_count);
+	glActiveTexture(GL_TEXTURE0 + emitter_texture_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, emitter_texture);
+	glUniform1i(EmittersID, emitter_texture_unit);
+	glActiveTexture(GL_TEXTURE0);
+
+	// current -> next, nothing is rasterized
+	int next = 1 - current;
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(vaos[current]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[next]);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, particle_count);
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	current = next;
+}
+
+void ParticleSystem::draw(const glm::mat4& View, const glm::mat4& Projection) {
+	// Sprite size in pixels = world size * PointScale / distance
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float point_scale = Projection[1][1] * viewport[3] * 0.5f;
+
+	glm::mat4 VP = Projection * View;
+	glUseProgram(render_program);
+	glUniformMatrix4fv(VPID, 1, GL_FALSE, &VP[0][0]);
+	glUniform1f(PointScaleID, point_scale);
+
+	// Additive, depth tested against the scene but not written : the sprites
+	// don't hide each other, so their order does not matter
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	glDepthMask(GL_FALSE);
+
+	glBindVertexArray(vaos[current]);
+	glDrawArrays(GL_POINTS, 0, particle_count);
+
+	glDepthMask(GL_TRUE);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_PROGRAM_POINT_SIZE);
+}
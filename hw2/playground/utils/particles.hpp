@@ -0,0 +1,64 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Fireball trails simulated entirely on the GPU.
+//
+// The particles live in two vertex buffers used in turn : every update draws the
+// current one as points through ParticleUpdateVertexShader with rasterization
+// off, and transform feedback captures the new state into the other buffer.
+// The CPU only uploads the emitter positions each step and never reads the
+// particles back. Dead particles respawn on emitter (particle index % emitter count).
+class ParticleSystem {
+public:
+	ParticleSystem();
+
+	bool init(int particle_count);
+	void cleanup();
+
+	// Emitters for this step : where they are now and where they were at the
+	// previous step, new particles are spread along that segment
+	void update(
+		const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& previous_positions,
+		float deltaTime
+	);
+
+	// Same, with the emitters already in a GL buffer : two vec4 per emitter, now
+	// then before, and w at 0 for the emitters that are off
+	void update(GLuint emitter_source, int emitter_count, float deltaTime);
+
+	// Additive point sprites, after the opaque geometry
+	void draw(const glm::mat4& View, const glm::mat4& Projection);
+
+	int get_particle_count() const { return particle_count; }
+
+private:
+	void simulate(float deltaTime);
+
+	int particle_count;
+	int current; // buffer holding the latest state
+	float time;
+
+	GLuint buffers[2];
+	GLuint vaos[2];
+
+	GLuint update_program;
+	GLuint DeltaTimeID;
+	GLuint TimeID;
+	GLuint EmitterCountID;
+	GLuint EmittersID;
+
+	GLuint render_program;
+	GLuint VPID;
+	GLuint PointScaleID;
+
+	GLuint emitter_buffer;
+	GLuint emitter_texture;
+	int emitter_count;
+	std::vector<glm::vec4> emitter_data;
+};
+
+#endif
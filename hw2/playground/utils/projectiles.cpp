@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shaders.hpp"
+#include "memtrack.hpp"
+#include "projectiles.hpp"
+
+
+// local_size_x of ProjectileBin and ProjectileStep
+static const int group_size = 64;
+
+// End of a cell list, and an empty cell
+static const GLuint no_enemy = 0xFFFFFFFFu;
+
+// Event list as the step shader writes it : count, then (fireball, enemy) pairs
+static const size_t event_header_size = 2 * sizeof(GLuint);
+
+// std430 binding points shared by both shaders
+enum ProjectileBinding {
+	BINDING_FIREBALLS = 0,
+	BINDING_EMITTERS = 1,
+	BINDING_ENEMIES = 2,
+	BINDING_CELL_HEADS = 3,
+	BINDING_CELL_NEXT = 4,
+	BINDING_ENEMY_DEAD = 5,
+	BINDING_EVENTS = 6,
+	binding_count
+};
+
+
+ProjectileSimulation::ProjectileSimulation() {
+	fireball_capacity = 0;
+	lifetime = hit_distance = 0;
+	fireball_count = 0;
+	enemy_slot_count = enemy_slot_capacity = 0;
+	fireball_buffer = emitter_buffer = 0;
+	enemy_buffer = cell_next_buffer = cell_head_buffer = enemy_dead_buffer = 0;
+	event_buffer = 0;
+	enemy_capacity = 0;
+	cell_count = 0;
+	bin_program = step_program = 0;
+	BinEnemyCountID = BinCellSizeID = BinCellCountID = 0;
+	FireballCountID = DeltaTimeID = LifetimeID = HitDistanceID = StepCellCountID = EventCapacityID = 0;
+	for (int i = 0; i < readback_ring_size; i++) {
+		readbacks[i] = 0;
+		pending[i].step_index = 0;
+		pending[i].fence = 0;
+	}
+	head = count = 0;
+	step_count = 0;
+	hit_total = expired_total = dropped_total = 0;
+	latency_total = event_reads = 0;
+}
+
+bool ProjectileSimulation::is_supported() {
+	return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+		GLEW_ARB_clear_buffer_object);
+}
+
+bool ProjectileSimulation::init(int fireball_capacity, float lifetime, float hit_distance) {
+	this->fireball_capacity = fireball_capacity;
+	this->lifetime = lifetime;
+	this->hit_distance = hit_distance;
+
+	bin_program = load_compute_program("ProjectileBin.computeshader");
+	step_program = load_compute_program("ProjectileStep.computeshader");
+	if (!bin_program || !step_program)
+		return false;
+	BinEnemyCountID = glGetUniformLocation(bin_program, "EnemyCount");
+	BinCellSizeID = glGetUniformLocation(bin_program, "CellSize");
+	BinCellCountID = glGetUniformLocation(bin_program, "CellCount");
+	FireballCountID = glGetUniformLocation(step_program, "FireballCount");
+	DeltaTimeID = glGetUniformLocation(step_program, "DeltaTime");
+	LifetimeID = glGetUniformLocation(step_program, "Lifetime");
+	HitDistanceID = glGetUniformLocation(step_program, "HitDistance");
+	StepCellCountID = glGetUniformLocation(step_program, "CellCount");
+	EventCapacityID = glGetUniformLocation(step_program, "EventCapacity");
+
+	// Every slot starts free : zero matrices, emitters off
+	GLuint zero = 0;
+	glGenBuffers(1, &fireball_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fireball_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, fireball_capacity * sizeof(GpuFireball), NULL, GL_DYNAMIC_COPY);
+	track_gpu_resource(GPU_BUFFER, fireball_buffer, "projectile fireballs", fireball_capacity * sizeof(GpuFireball), GL_DYNAMIC_COPY);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glGenBuffers(1, &emitter_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, emitter_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, fireball_capacity * 2 * sizeof(glm::vec4), NULL, GL_DYNAMIC_COPY);
+	track_gpu_resource(GPU_BUFFER, emitter_buffer, "projectile emitters", fireball_capacity * 2 * sizeof(glm::vec4), GL_DYNAMIC_COPY);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	size_t event_size = event_header_size + event_capacity * 2 * sizeof(GLint);
+	glGenBuffers(1, &event_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, event_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, event_size, NULL, GL_DYNAMIC_COPY);
+	track_gpu_resource(GPU_BUFFER, event_buffer, "projectile events", event_size, GL_DYNAMIC_COPY);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+	glGenBuffers(readback_ring_size, readbacks);
+	for (int i = 0; i < readback_ring_size; i++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readbacks[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, event_size, NULL, GL_STREAM_READ);
+		track_gpu_resource(GPU_BUFFER, readbacks[i], "projectile event readback", event_size, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glGenBuffers(1, &enemy_buffer);
+	glGenBuffers(1, &cell_next_buffer);
+	glGenBuffers(1, &cell_head_buffer);
+	glGenBuffers(1, &enemy_dead_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	fireball_count = 0;
+	free_fireballs.clear();
+	enemy_slot_count = 0;
+	free_enemies.clear();
+	reserve_enemies(1024);
+	return true;
+}
+
+void ProjectileSimulation::cleanup() {
+	while (count > 0)
+		retire_oldest();
+	retired_events.clear();
+	delete_tracked_buffers(1, &fireball_buffer);
+	delete_tracked_buffers(1, &emitter_buffer);
+	delete_tracked_buffers(1, &enemy_buffer);
+	delete_tracked_buffers(1, &cell_next_buffer);
+	delete_tracked_buffers(1, &cell_head_buffer);
+	delete_tracked_buffers(1, &enemy_dead_buffer);
+	delete_tracked_buffers(1, &event_buffer);
+	delete_tracked_buffers(readback_ring_size, readbacks);
+	glDeleteProgram(bin_program);
+	glDeleteProgram(step_program);
+	fireball_buffer = emitter_buffer = 0;
+	enemy_buffer = cell_next_buffer = cell_head_buffer = enemy_dead_buffer = 0;
+	event_buffer = 0;
+	for (int i = 0; i < readback_ring_size; i++)
+		readbacks[i] = 0;
+	bin_program = step_program = 0;
+	enemy_capacity = 0;
+	enemy_slot_capacity = 0;
+	cell_count = 0;
+}
+
+void ProjectileSimulation::reset() {
+	while (count > 0)
+		retire_oldest();
+	retired_events.clear();
+
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fireball_buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, emitter_buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, event_buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	fireball_count = 0;
+	free_fireballs.clear();
+	enemy_slot_count = 0;
+	free_enemies.clear();
+}
+
+bool ProjectileSimulation::add_fireball(glm::vec3 position, glm::vec3 velocity, const glm::mat4& rotation, float layer) {
+	int slot;
+	if (!free_fireballs.empty()) {
+		slot = free_fireballs.back();
+		free_fireballs.pop_back();
+	} else if (fireball_count < fireball_capacity) {
+		slot = fireball_count++;
+	} else {
+		dropped_total++;
+		return false;
+	}
+
+	GpuFireball fireball;
+	fireball.model = rotation;
+	fireball.model[3] = glm::vec4(position, 1.0f);
+	fireball.velocity = glm::vec4(velocity, layer);
+	fireball.state = glm::vec4(0.0f);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, fireball_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * sizeof(GpuFireball), sizeof(GpuFireball), &fireball);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return true;
+}
+
+unsigned int ProjectileSimulation::add_enemy() {
+	unsigned int slot;
+	if (!free_enemies.empty()) {
+		slot = free_enemies.back();
+		free_enemies.pop_back();
+	} else {
+		slot = enemy_slot_count++;
+	}
+
+	// Alive again : the slot may hold the last enemy that died in it
+	if (slot < enemy_slot_capacity) {
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, enemy_dead_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * sizeof(GLuint), sizeof(GLuint), &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+	return slot;
+}
+
+void ProjectileSimulation::reserve_enemies(size_t enemy_count) {
+	// Per step data : the uploaded enemies and their cell links
+	if (enemy_count > enemy_capacity) {
+		while (enemy_capacity < enemy_count)
+			enemy_capacity = enemy_capacity ? enemy_capacity * 2 : 1024;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, enemy_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, enemy_capacity * sizeof(GpuEnemy), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cell_next_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, enemy_capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+		// About two cells per enemy, a power of two for the hash
+		cell_count = 1;
+		while (cell_count < 2 * enemy_capacity)
+			cell_count *= 2;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, cell_head_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, cell_count * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		track_gpu_resource(GPU_BUFFER, enemy_buffer, "projectile enemies", enemy_capacity * sizeof(GpuEnemy), GL_STREAM_DRAW);
+		track_gpu_resource(GPU_BUFFER, cell_next_buffer, "projectile cell links", enemy_capacity * sizeof(GLuint), GL_DYNAMIC_COPY);
+		track_gpu_resource(GPU_BUFFER, cell_head_buffer, "projectile cell heads", cell_count * sizeof(GLuint), GL_DYNAMIC_COPY);
+	}
+
+	// Persistent data : the dead flags of every slot handed out, kept across a resize
+	if (enemy_slot_count > enemy_slot_capacity || enemy_slot_capacity == 0) {
+		unsigned int capacity = enemy_slot_capacity ? enemy_slot_capacity : 1024;
+		while (capacity < enemy_slot_count)
+			capacity *= 2;
+
+		GLuint resized;
+		glGenBuffers(1, &resized);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, resized);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+		GLuint zero = 0;
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		if (enemy_slot_capacity > 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, enemy_dead_buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_SHADER_STORAGE_BUFFER, 0, 0, enemy_slot_capacity * sizeof(GLuint));
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		delete_tracked_buffers(1, &enemy_dead_buffer);
+		enemy_dead_buffer = resized;
+		track_gpu_resource(GPU_BUFFER, enemy_dead_buffer, "projectile dead flags", capacity * sizeof(GLuint), GL_DYNAMIC_COPY);
+
+		enemy_slot_capacity = capacity;
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ProjectileSimulation::step(const std::vector<GpuEnemy>& enemies, float deltaTime) {
+	reserve_enemies(enemies.size());
+	step_count++;
+
+	// Orphan the storage of the last step instead of waiting for the GPU to be done with it
+	if (!enemies.empty()) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, enemy_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, enemy_capacity * sizeof(GpuEnemy), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, enemies.size() * sizeof(GpuEnemy), &enemies[0]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cell_head_buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &no_enemy);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_FIREBALLS, fireball_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_EMITTERS, emitter_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_ENEMIES, enemy_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_CELL_HEADS, cell_head_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_CELL_NEXT, cell_next_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_ENEMY_DEAD, enemy_dead_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING_EVENTS, event_buffer);
+
+	if (!enemies.empty()) {
+		glUseProgram(bin_program);
+		glUniform1ui(BinEnemyCountID, (GLuint)enemies.size());
+		glUniform1f(BinCellSizeID, hit_distance);
+		glUniform1ui(BinCellCountID, cell_count);
+		glDispatchCompute((GLuint)((enemies.size() + group_size - 1) / group_size), 1, 1);
+		// The step walks the lists the binning linked
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	if (fireball_count > 0) {
+		glUseProgram(step_program);
+		glUniform1ui(FireballCountID, (GLuint)fireball_count);
+		glUniform1f(DeltaTimeID, deltaTime);
+		glUniform1f(LifetimeID, lifetime);
+		glUniform1f(HitDistanceID, hit_distance);
+		glUniform1ui(StepCellCountID, cell_count);
+		glUniform1ui(EventCapacityID, (GLuint)event_capacity);
+		glDispatchCompute((GLuint)((fireball_count + group_size - 1) / group_size), 1, 1);
+	}
+
+	for (int i = 0; i < binding_count; i++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, 0);
+
+	// Next are the copies below, the fireball draw, the trail emitters and the next step
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// The ring slot used by this step must be free
+	if (count == readback_ring_size)
+		retire_oldest();
+	int slot = (head + count) % readback_ring_size;
+
+	// The events go to the readback buffer, and the list starts over for the next step
+	size_t event_size = event_header_size + event_capacity * 2 * sizeof(GLint);
+	glBindBuffer(GL_COPY_READ_BUFFER, event_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readbacks[slot]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, event_size);
+	GLuint zero = 0;
+	glClearBufferSubData(GL_COPY_READ_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	pending[slot].step_index = step_count;
+	pending[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	count++;
+}
+
+void ProjectileSimulation::read_events(std::vector<ProjectileEvent>& events) {
+	while (count > 0) {
+		GLenum state = glClientWaitSync(pending[head].fence, 0, 0);
+		if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+			break;
+		retire_oldest();
+	}
+
+	// The slots are only reused once the caller knows their objects are gone
+	for (size_t i = 0; i < retired_events.size(); i++) {
+		const ProjectileEvent& event = retired_events[i];
+		free_fireballs.push_back(event.fireball);
+		if (event.enemy >= 0)
+			free_enemies.push_back(event.enemy);
+	}
+	events.insert(events.end(), retired_events.begin(), retired_events.end());
+	retired_events.clear();
+}
+
+void ProjectileSimulation::retire_oldest() {
+	Pending& step = pending[head];
+	glClientWaitSync(step.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	glDeleteSync(step.fence);
+	step.fence = 0;
+
+	size_t event_size = event_header_size + event_capacity * 2 * sizeof(GLint);
+	glBindBuffer(GL_COPY_READ_BUFFER, readbacks[head]);
+	const GLuint* data = (const GLuint*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, event_size, GL_MAP_READ_BIT);
+	if (data) {
+		// The count went on past the capacity for the fireballs that found no room
+		GLuint event_count = data[0] < (GLuint)event_capacity ? data[0] : (GLuint)event_capacity;
+		const GLint* pairs = (const GLint*)(data + 2);
+		for (GLuint i = 0; i < event_count; i++) {
+			ProjectileEvent event;
+			event.fireball = pairs[i * 2];
+			event.enemy = pairs[i * 2 + 1];
+			retired_events.push_back(event);
+			if (event.enemy >= 0)
+				hit_total++;
+			else
+				expired_total++;
+		}
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	latency_total += step_count - step.step_index;
+	event_reads++;
+
+	head = (head + 1) % readback_ring_size;
+	count--;
+}
+
+void ProjectileSimulation::print_report() const {
+	printf("gpu projectiles : %d steps, %lld kills, %lld fireballs out of range, %lld dropped with %d slots\n",
+		step_count, hit_total, expired_total, dropped_total, fireball_capacity);
+	if (event_reads > 0)
+		printf("  events read back with %.2f newer steps queued on average\n", (double)latency_total / event_reads);
+}
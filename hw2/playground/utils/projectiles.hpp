@@ -0,0 +1,120 @@
+#ifndef PROJECTILES_HPP
+#define PROJECTILES_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// One fireball slot, std430 layout of ProjectileStep.computeshader. The first
+// 80 bytes are what the instanced fireball draw reads : model matrix, then the
+// texture layer in velocity.w.
+struct GpuFireball {
+	glm::mat4 model;    // zero when the slot is free
+	glm::vec4 velocity; // xyz : units per second, w : texture layer
+	glm::vec4 state;    // x : seconds since the launch
+};
+
+// Enemy position uploaded for a step, with the slot given by add_enemy()
+struct GpuEnemy {
+	glm::vec3 position;
+	unsigned int slot;
+};
+
+// What happened to a fireball during a step
+struct ProjectileEvent {
+	int fireball; // slot, already free again when the event is read
+	int enemy;    // slot of the enemy it killed, also free again ; -1 : out of range
+};
+
+// Fireballs simulated on the GPU.
+//
+// The fireballs live in a shader storage buffer and never come back to the CPU.
+// Every step, ProjectileBin.computeshader links the enemies into a hashed grid
+// of hit distance sized cells, then ProjectileStep.computeshader moves every
+// fireball, writes its trail emitter and looks in the 27 cells around it for an
+// enemy in reach. Kills and fireballs out of range go to a small event list,
+// which is copied to one of a ring of readback buffers behind a fence and handed
+// to read_events() a few steps later, once the GPU is done with it.
+//
+// The enemies are still steered by the swarm on the CPU and their positions are
+// uploaded every step. Each one holds a slot in which the GPU marks it dead the
+// moment it's hit, so it can't be hit twice before the CPU hears about it; the
+// CPU keeps drawing it until then. Slots come from add_fireball() and
+// add_enemy() and are free again when their event is read.
+//
+// Needs compute shaders, shader storage buffers and buffer clears (GL 4.3) :
+// check is_supported() and keep the CPU path otherwise.
+class ProjectileSimulation {
+public:
+	ProjectileSimulation();
+
+	static bool is_supported();
+
+	// Fireballs older than lifetime seconds are gone, hit_distance is between centers
+	bool init(int fireball_capacity, float lifetime, float hit_distance);
+	void cleanup();
+
+	// Every slot free and every pending event dropped, waits for the GPU
+	void reset();
+
+	// false when all the slots are taken
+	bool add_fireball(glm::vec3 position, glm::vec3 velocity, const glm::mat4& rotation, float layer);
+	unsigned int add_enemy();
+
+	void step(const std::vector<GpuEnemy>& enemies, float deltaTime);
+
+	// Events of the steps the GPU has finished, never waits
+	void read_events(std::vector<ProjectileEvent>& events);
+
+	// GpuFireball records, slots up to get_fireball_count()
+	GLuint get_fireball_buffer() const { return fireball_buffer; }
+	int get_fireball_count() const { return fireball_count; }
+	// Two vec4 per fireball slot, ParticleSystem emitter layout : position now and
+	// at the previous step, w at 0 for free slots
+	GLuint get_emitter_buffer() const { return emitter_buffer; }
+
+	void print_report() const;
+
+private:
+	static const int readback_ring_size = 3;
+	static const int event_capacity = 256;
+
+	struct Pending {
+		int step_index;
+		GLsync fence;
+	};
+
+	void reserve_enemies(size_t enemy_count);
+	void retire_oldest();
+
+	int fireball_capacity;
+	float lifetime, hit_distance;
+
+	int fireball_count; // high water mark of the slots
+	std::vector<int> free_fireballs;
+	unsigned int enemy_slot_count;
+	unsigned int enemy_slot_capacity;
+	std::vector<unsigned int> free_enemies;
+
+	GLuint fireball_buffer, emitter_buffer;
+	GLuint enemy_buffer, cell_next_buffer, cell_head_buffer, enemy_dead_buffer;
+	GLuint event_buffer;
+	size_t enemy_capacity;
+	unsigned int cell_count;
+
+	GLuint bin_program;
+	GLuint BinEnemyCountID, BinCellSizeID, BinCellCountID;
+	GLuint step_program;
+	GLuint FireballCountID, DeltaTimeID, LifetimeID, HitDistanceID, StepCellCountID, EventCapacityID;
+
+	GLuint readbacks[readback_ring_size];
+	Pending pending[readback_ring_size];
+	int head, count;
+	std::vector<ProjectileEvent> retired_events; // read back, not handed out yet
+
+	int step_count;
+	long long hit_total, expired_total, dropped_total;
+	long long latency_total, event_reads;
+};
+
+#endif
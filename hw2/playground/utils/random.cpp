@@ -0,0 +1,243 @@
+#include <math.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "simd.hpp"
+#include "random.hpp"
+
+
+static const float pi = 3.14159265f;
+static const float half_pi = 1.57079633f;
+
+// Spreads one seed over the whole state, as recommended for xoshiro
+static unsigned long long splitmix64(unsigned long long& x) {
+	unsigned long long z = (x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// sin and cos of 4 angles in [-pi, pi], within about 1e-7 of the exact values.
+// Taylor series up to x^11 on [-pi/2, pi/2] : sin is folded there with
+// sin(x) = sin(pi - x), and cos(x) = sin(pi/2 - |x|) is already there.
+static void sincos4(const float* angle, float* s, float* c) {
+#ifdef SIMD_SSE2
+	__m128 x = _mm_loadu_ps(angle);
+	__m128 sign_mask = _mm_set1_ps(-0.0f);
+	__m128 abs_x = _mm_andnot_ps(sign_mask, x);
+	__m128 x_sign = _mm_and_ps(sign_mask, x);
+
+	__m128 folded = _mm_or_ps(_mm_sub_ps(_mm_set1_ps(pi), abs_x), x_sign);
+	__m128 s_arg = _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(abs_x, _mm_set1_ps(half_pi)), folded),
+		_mm_andnot_ps(_mm_cmpgt_ps(abs_x, _mm_set1_ps(half_pi)), x));
+	__m128 c_arg = _mm_sub_ps(_mm_set1_ps(half_pi), abs_x);
+
+	__m128 args[2] = { s_arg, c_arg };
+	__m128 results[2];
+	for (int k = 0; k < 2; k++) {
+		__m128 a = args[k];
+		__m128 a2 = _mm_mul_ps(a, a);
+		__m128 p = _mm_set1_ps(-1.0f / 39916800);
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(1.0f / 362880));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-1.0f / 5040));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(1.0f / 120));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-1.0f / 6));
+		p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(1.0f));
+		results[k] = _mm_mul_ps(p, a);
+	}
+	_mm_storeu_ps(s, results[0]);
+	_mm_storeu_ps(c, results[1]);
+#else
+	for (int i = 0; i < 4; i++) {
+		float x = angle[i];
+		float abs_x = fabsf(x);
+		float args[2] = { abs_x > half_pi ? (x < 0 ? -(pi - abs_x) : pi - abs_x) : x, half_pi - abs_x };
+		float results[2];
+		for (int k = 0; k < 2; k++) {
+			float a = args[k];
+			float a2 = a * a;
+			float p = -1.0f / 39916800;
+			p = p * a2 + 1.0f / 362880;
+			p = p * a2 - 1.0f / 5040;
+			p = p * a2 + 1.0f / 120;
+			p = p * a2 - 1.0f / 6;
+			p = p * a2 + 1.0f;
+			results[k] = p * a;
+		}
+		s[i] = results[0];
+		c[i] = results[1];
+	}
+#endif
+}
+
+// Cube roots of 4 positive values : a guess from the float bits (exponent / 3),
+// then 3 Newton steps
+static void cbrt4(const float* x, float* out) {
+#ifdef SIMD_SSE2
+	__m128 v = _mm_loadu_ps(x);
+	__m128i bits = _mm_castps_si128(v);
+	__m128 third = _mm_set1_ps(1.0f / 3);
+	bits = _mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(bits), third)), _mm_set1_epi32(709921077));
+	__m128 y = _mm_castsi128_ps(bits);
+	for (int k = 0; k < 3; k++)
+		y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(v, _mm_mul_ps(y, y))), third);
+	_mm_storeu_ps(out, y);
+#else
+	for (int i = 0; i < 4; i++) {
+		union { float f; int i; } bits;
+		bits.f = x[i];
+		bits.i = (int)((float)bits.i * (1.0f / 3)) + 709921077;
+		float y = bits.f;
+		for (int k = 0; k < 3; k++)
+			y = (y + y + x[i] / (y * y)) * (1.0f / 3);
+		out[i] = y;
+	}
+#endif
+}
+
+
+RandomGenerator::RandomGenerator(unsigned long long seed) {
+	this->seed(seed);
+}
+
+void RandomGenerator::seed(unsigned long long seed) {
+	unsigned long long x = seed;
+	for (int lane = 0; lane < 4; lane++) {
+		for (int word = 0; word < 4; word += 2) {
+			unsigned long long bits = splitmix64(x);
+			state[word][lane] = (unsigned int)bits;
+			state[word + 1][lane] = (unsigned int)(bits >> 32);
+		}
+	}
+	spare_count = 0;
+}
+
+void RandomGenerator::next4(float* out) {
+	// xoshiro128+ : the low bits are weak, the float only keeps the top 23
+#ifdef SIMD_SSE2
+	__m128i s0 = _mm_loadu_si128((const __m128i*)state[0]);
+	__m128i s1 = _mm_loadu_si128((const __m128i*)state[1]);
+	__m128i s2 = _mm_loadu_si128((const __m128i*)state[2]);
+	__m128i s3 = _mm_loadu_si128((const __m128i*)state[3]);
+
+	__m128i result = _mm_add_epi32(s0, s3);
+	__m128i t = _mm_slli_epi32(s1, 9);
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, t);
+	s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+	_mm_storeu_si128((__m128i*)state[0], s0);
+	_mm_storeu_si128((__m128i*)state[1], s1);
+	_mm_storeu_si128((__m128i*)state[2], s2);
+	_mm_storeu_si128((__m128i*)state[3], s3);
+
+	// 1.mantissa in [1, 2), minus one
+	__m128i bits = _mm_or_si128(_mm_srli_epi32(result, 9), _mm_set1_epi32(0x3F800000));
+	_mm_storeu_ps(out, _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f)));
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		unsigned int s0 = state[0][lane], s1 = state[1][lane], s2 = state[2][lane], s3 = state[3][lane];
+
+		unsigned int result = s0 + s3;
+		unsigned int t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = (s3 << 11) | (s3 >> 21);
+
+		state[0][lane] = s0;
+		state[1][lane] = s1;
+		state[2][lane] = s2;
+		state[3][lane] = s3;
+
+		union { unsigned int u; float f; } bits;
+		bits.u = (result >> 9) | 0x3F800000;
+		out[lane] = bits.f - 1.0f;
+	}
+#endif
+}
+
+float RandomGenerator::uniform(float start, float end) {
+	if (spare_count == 0) {
+		next4(spare);
+		spare_count = 4;
+	}
+	return start + (end - start) * spare[--spare_count];
+}
+
+void RandomGenerator::fill_uniform(float* out, int count, float start, float end) {
+	float u[4];
+	for (int i = 0; i < count; i += 4) {
+		next4(u);
+		int n = count - i < 4 ? count - i : 4;
+		for (int j = 0; j < n; j++)
+			out[i + j] = start + (end - start) * u[j];
+	}
+}
+
+void RandomGenerator::fill_directions(glm::vec3* out, int count) {
+	// z uniform in [-1, 1] and a uniform angle around z (Archimedes)
+	float u[4], v[4], angle[4], s[4], c[4];
+	for (int i = 0; i < count; i += 4) {
+		next4(u);
+		next4(v);
+		for (int j = 0; j < 4; j++)
+			angle[j] = (2 * v[j] - 1) * pi;
+		sincos4(angle, s, c);
+
+		int n = count - i < 4 ? count - i : 4;
+		for (int j = 0; j < n; j++) {
+			float z = 2 * u[j] - 1;
+			float r = sqrtf(1 - z * z);
+			out[i + j] = glm::vec3(r * c[j], r * s[j], z);
+		}
+	}
+}
+
+void RandomGenerator::fill_rotations(glm::quat* out, int count) {
+	// Shoemake, "Uniform random rotations", Graphics Gems III
+	float u[4], v[4], w[4], angle[4], s1[4], c1[4], s2[4], c2[4];
+	for (int i = 0; i < count; i += 4) {
+		next4(u);
+		next4(v);
+		next4(w);
+		for (int j = 0; j < 4; j++)
+			angle[j] = (2 * v[j] - 1) * pi;
+		sincos4(angle, s1, c1);
+		for (int j = 0; j < 4; j++)
+			angle[j] = (2 * w[j] - 1) * pi;
+		sincos4(angle, s2, c2);
+
+		int n = count - i < 4 ? count - i : 4;
+		for (int j = 0; j < n; j++) {
+			float a = sqrtf(1 - u[j]);
+			float b = sqrtf(u[j]);
+			out[i + j] = glm::quat(b * c2[j], a * s1[j], a * c1[j], b * s2[j]);
+		}
+	}
+}
+
+void RandomGenerator::fill_spawn_points(glm::vec3* out, int count, glm::vec3 center, float min_radius, float max_radius) {
+	fill_directions(out, count);
+
+	// Radius with a density growing as r^2, so the points don't crowd the center
+	float min3 = min_radius * min_radius * min_radius;
+	float max3 = max_radius * max_radius * max_radius;
+	float u[4], radius[4];
+	for (int i = 0; i < count; i += 4) {
+		next4(u);
+		for (int j = 0; j < 4; j++)
+			u[j] = min3 + (max3 - min3) * u[j];
+		cbrt4(u, radius);
+
+		int n = count - i < 4 ? count - i : 4;
+		for (int j = 0; j < n; j++)
+			out[i + j] = center + out[i + j] * radius[j];
+	}
+}
@@ -0,0 +1,565 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "replication.hpp"
+
+
+// Positions in 1/position_scale units
+static const float position_scale = 128.0f;
+static const float max_position = 8000000.0f;
+
+// Header of a snapshot fragment : type, sequence, baseline, server time,
+// last click, fragment index and count
+static const size_t snapshot_header_size = 1 + 4 + 4 + 8 + 4 + 2 + 2;
+// Longest entity record : id, flags, type, layer, 3 positions, rotation
+static const size_t max_record_size = 5 + 1 + 5 + 5 + 3 * 5 + 4;
+
+enum RecordFlags {
+	RECORD_FULL = 1,     // no baseline entity, absolute values follow
+	RECORD_POSITION = 2,
+	RECORD_ROTATION = 4,
+	RECORD_TYPE = 8,     // type and layer
+};
+
+
+// Little-endian, like the snapshot files
+class ByteWriter {
+public:
+	explicit ByteWriter(std::vector<unsigned char>& bytes) : bytes(bytes) {}
+
+	void put_u8(unsigned int v) { bytes.push_back((unsigned char)v); }
+	void put_u16(unsigned int v) { put_raw(&v, 2); }
+	void put_u32(unsigned int v) { put_raw(&v, 4); }
+	void put_f32(float v) { put_raw(&v, 4); }
+	void put_f64(double v) { put_raw(&v, 8); }
+
+	// 7 bits per byte, small values in one byte
+	void put_varint(unsigned int v) {
+		while (v >= 0x80) {
+			bytes.push_back((unsigned char)(v | 0x80));
+			v >>= 7;
+		}
+		bytes.push_back((unsigned char)v);
+	}
+
+	// Small negative values stay small : 0, -1, 1, -2, 2...
+	void put_zigzag(int v) { put_varint(((unsigned int)v << 1) ^ (unsigned int)(v >> 31)); }
+
+	size_t size() const { return bytes.size(); }
+
+private:
+	void put_raw(const void * v, size_t size) {
+		const unsigned char * p = (const unsigned char *)v;
+		bytes.insert(bytes.end(), p, p + size);
+	}
+
+	std::vector<unsigned char>& bytes;
+};
+
+// Reads past the end give zeros and clear ok
+class ByteReader {
+public:
+	ByteReader(const unsigned char * data, size_t size) : ok(true), p(data), end(data + size) {}
+
+	unsigned int get_u8() { unsigned char v = 0; get_raw(&v, 1); return v; }
+	unsigned int get_u16() { unsigned short v = 0; get_raw(&v, 2); return v; }
+	unsigned int get_u32() { unsigned int v = 0; get_raw(&v, 4); return v; }
+	float get_f32() { float v = 0; get_raw(&v, 4); return v; }
+	double get_f64() { double v = 0; get_raw(&v, 8); return v; }
+
+	unsigned int get_varint() {
+		unsigned int v = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			unsigned int b = get_u8();
+			v |= (b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+		ok = false;
+		return 0;
+	}
+
+	int get_zigzag() {
+		unsigned int v = get_varint();
+		return (int)(v >> 1) ^ -(int)(v & 1);
+	}
+
+	bool at_end() const { return p == end; }
+
+	bool ok;
+
+private:
+	void get_raw(void * v, size_t size) {
+		if ((size_t)(end - p) < size) {
+			ok = false;
+			p = end;
+			return;
+		}
+		memcpy(v, p, size);
+		p += size;
+	}
+
+	const unsigned char * p;
+	const unsigned char * end;
+};
+
+
+static int quantize_position(float v) {
+	if (!(v > -max_position)) v = -max_position; // NaN too
+	if (v > max_position) v = max_position;
+	return (int)floorf(v * position_scale + 0.5f);
+}
+
+// Smallest three : the largest component is left out and recomputed from the
+// others, which are within +-1/sqrt(2) and get 10 bits each
+static unsigned int quantize_rotation(const glm::quat& r) {
+	float q[4] = { r.x, r.y, r.z, r.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++) {
+		if (fabsf(q[i]) > fabsf(q[largest]))
+			largest = i;
+	}
+	float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+	unsigned int packed = (unsigned int)largest << 30;
+	int shift = 20;
+	for (int i = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		float v = (q[i] * sign * 1.41421356f + 1) * 0.5f * 1023 + 0.5f;
+		int quantized = v < 0 ? 0 : (v > 1023 ? 1023 : (int)v);
+		packed |= (unsigned int)quantized << shift;
+		shift -= 10;
+	}
+	return packed;
+}
+
+static glm::quat dequantize_rotation(unsigned int packed) {
+	int largest = packed >> 30;
+	float q[4];
+	float sum = 0;
+	int shift = 20;
+	for (int i = 0; i < 4; i++) {
+		if (i == largest)
+			continue;
+		q[i] = (((packed >> shift) & 1023) / 1023.0f * 2 - 1) * 0.70710678f;
+		sum += q[i] * q[i];
+		shift -= 10;
+	}
+	q[largest] = sqrtf(sum < 1 ? 1 - sum : 0);
+	return glm::quat(q[3], q[0], q[1], q[2]);
+}
+
+static QuantizedEntity quantize(const NetEntity& e) {
+	QuantizedEntity q;
+	q.id = e.id;
+	q.type = e.type;
+	q.layer = e.layer;
+	for (int i = 0; i < 3; i++)
+		q.position[i] = quantize_position(e.position[i]);
+	q.rotation = quantize_rotation(e.rotation);
+	return q;
+}
+
+static NetEntity dequantize(const QuantizedEntity& q) {
+	NetEntity e;
+	e.id = q.id;
+	e.type = q.type;
+	e.layer = q.layer;
+	for (int i = 0; i < 3; i++)
+		e.position[i] = q.position[i] / position_scale;
+	e.rotation = dequantize_rotation(q.rotation);
+	return e;
+}
+
+static bool same_position(const QuantizedEntity& a, const QuantizedEntity& b) {
+	return a.position[0] == b.position[0] && a.position[1] == b.position[1] && a.position[2] == b.position[2];
+}
+
+static bool id_less(const QuantizedEntity& e, unsigned int id) {
+	return e.id < id;
+}
+
+static const QuantizedEntity * find_entity(const std::vector<QuantizedEntity>& entities, unsigned int id) {
+	std::vector<QuantizedEntity>::const_iterator it = std::lower_bound(entities.begin(), entities.end(), id, id_less);
+	return it != entities.end() && it->id == id ? &*it : NULL;
+}
+
+
+int get_packet_type(const unsigned char * packet, size_t size) {
+	if (size < 1 || (packet[0] != PACKET_INPUT && packet[0] != PACKET_SNAPSHOT))
+		return -1;
+	return packet[0];
+}
+
+size_t write_input_packet(const NetInput& input, unsigned char * packet) {
+	std::vector<unsigned char> bytes;
+	ByteWriter w(bytes);
+	w.put_u8(PACKET_INPUT);
+	w.put_u32(input.acknowledged);
+	w.put_f64(input.time);
+	for (int i = 0; i < 3; i++)
+		w.put_f32(input.camera_position[i]);
+	w.put_f32(input.horizontal_angle);
+	w.put_f32(input.vertical_angle);
+
+	int click_count = input.clicks.size() < (size_t)max_input_clicks ? (int)input.clicks.size() : max_input_clicks;
+	w.put_u8(click_count);
+	for (int i = 0; i < click_count; i++) {
+		const NetClick& click = input.clicks[i];
+		w.put_u32(click.number);
+		w.put_f64(click.time);
+		for (int k = 0; k < 3; k++)
+			w.put_f32(click.direction[k]);
+	}
+
+	memcpy(packet, &bytes[0], bytes.size());
+	return bytes.size();
+}
+
+bool read_input_packet(const unsigned char * packet, size_t size, NetInput& input) {
+	ByteReader r(packet, size);
+	if (r.get_u8() != PACKET_INPUT)
+		return false;
+	input.acknowledged = r.get_u32();
+	input.time = r.get_f64();
+	for (int i = 0; i < 3; i++)
+		input.camera_position[i] = r.get_f32();
+	input.horizontal_angle = r.get_f32();
+	input.vertical_angle = r.get_f32();
+
+	int click_count = r.get_u8();
+	input.clicks.resize(click_count);
+	for (int i = 0; i < click_count; i++) {
+		NetClick& click = input.clicks[i];
+		click.number = r.get_u32();
+		click.time = r.get_f64();
+		for (int k = 0; k < 3; k++)
+			click.direction[k] = r.get_f32();
+	}
+	return r.ok && r.at_end();
+}
+
+
+SnapshotEncoder::SnapshotEncoder() {
+	sequence = 0;
+	acknowledged = 0;
+	for (int i = 0; i < history_size; i++)
+		history_sequence[i] = 0;
+}
+
+void SnapshotEncoder::acknowledge(unsigned int sequence) {
+	// Acks can arrive out of order, only a newer one that was really sent counts
+	if (sequence > acknowledged && sequence <= this->sequence)
+		acknowledged = sequence;
+}
+
+void SnapshotEncoder::encode(const std::vector<NetEntity>& entities, double server_time, unsigned int last_click,
+	std::vector<std::vector<unsigned char> >& packets) {
+	sequence++;
+
+	current.resize(entities.size());
+	for (size_t i = 0; i < entities.size(); i++)
+		current[i] = quantize(entities[i]);
+
+	// Delta against the latest acknowledged snapshot, while it is still in the history
+	static const std::vector<QuantizedEntity> nothing;
+	unsigned int baseline = 0;
+	const std::vector<QuantizedEntity>* base = &nothing;
+	if (acknowledged && sequence - acknowledged < (unsigned int)history_size && history_sequence[acknowledged % history_size] == acknowledged) {
+		baseline = acknowledged;
+		base = &history[acknowledged % history_size];
+	}
+
+	// Merge by id : what is gone, and what is new or changed
+	std::vector<unsigned int> removed;
+	std::vector<const QuantizedEntity *> changed;
+	std::vector<const QuantizedEntity *> changed_base;
+	size_t b = 0;
+	for (size_t i = 0; i < current.size(); i++) {
+		const QuantizedEntity& e = current[i];
+		while (b < base->size() && (*base)[b].id < e.id)
+			removed.push_back((*base)[b++].id);
+		const QuantizedEntity* old = b < base->size() && (*base)[b].id == e.id ? &(*base)[b++] : NULL;
+		if (old && same_position(*old, e) && old->rotation == e.rotation && old->type == e.type && old->layer == e.layer)
+			continue;
+		changed.push_back(&e);
+		changed_base.push_back(old);
+	}
+	while (b < base->size())
+		removed.push_back((*base)[b++].id);
+
+	// Fragments : removed ids first, then the records, as many as fit
+	packets.clear();
+	size_t r = 0;
+	size_t c = 0;
+	do {
+		packets.push_back(std::vector<unsigned char>());
+		std::vector<unsigned char>& packet = packets.back();
+		ByteWriter w(packet);
+		w.put_u8(PACKET_SNAPSHOT);
+		w.put_u32(sequence);
+		w.put_u32(baseline);
+		w.put_f64(server_time);
+		w.put_u32(last_click);
+		w.put_u16(packets.size() - 1);
+		w.put_u16(0); // fragment count, once known
+
+		size_t removed_count = (net_max_packet - snapshot_header_size - 5 - 2) / 5;
+		if (removed_count > removed.size() - r)
+			removed_count = removed.size() - r;
+		w.put_varint(removed_count);
+		unsigned int previous = 0;
+		for (size_t k = 0; k < removed_count; k++, r++) {
+			w.put_varint(removed[r] - previous);
+			previous = removed[r];
+		}
+
+		size_t count_offset = packet.size();
+		w.put_u16(0);
+		unsigned int record_count = 0;
+		previous = 0;
+		while (c < changed.size() && w.size() + max_record_size <= (size_t)net_max_packet) {
+			const QuantizedEntity& e = *changed[c];
+			const QuantizedEntity* old = changed_base[c];
+			c++;
+			record_count++;
+
+			w.put_varint(e.id - previous);
+			previous = e.id;
+			if (!old) {
+				w.put_u8(RECORD_FULL);
+				w.put_varint(e.type);
+				w.put_zigzag(e.layer);
+				for (int i = 0; i < 3; i++)
+					w.put_zigzag(e.position[i]);
+				w.put_u32(e.rotation);
+				continue;
+			}
+
+			unsigned int flags = 0;
+			if (!same_position(*old, e)) flags |= RECORD_POSITION;
+			if (old->rotation != e.rotation) flags |= RECORD_ROTATION;
+			if (old->type != e.type || old->layer != e.layer) flags |= RECORD_TYPE;
+			w.put_u8(flags);
+			if (flags & RECORD_POSITION) {
+				for (int i = 0; i < 3; i++)
+					w.put_zigzag(e.position[i] - old->position[i]);
+			}
+			if (flags & RECORD_ROTATION)
+				w.put_u32(e.rotation);
+			if (flags & RECORD_TYPE) {
+				w.put_varint(e.type);
+				w.put_zigzag(e.layer);
+			}
+		}
+		memcpy(&packet[count_offset], &record_count, 2);
+	} while (r < removed.size() || c < changed.size());
+
+	unsigned short fragment_count = packets.size();
+	for (size_t i = 0; i < packets.size(); i++)
+		memcpy(&packets[i][snapshot_header_size - 2], &fragment_count, 2);
+
+	history[sequence % history_size] = current;
+	history_sequence[sequence % history_size] = sequence;
+}
+
+
+SnapshotDecoder::SnapshotDecoder() {
+	acknowledged = 0;
+	pending_sequence = 0;
+	pending_received = 0;
+	for (int i = 0; i < history_size; i++)
+		history_sequence[i] = 0;
+}
+
+bool SnapshotDecoder::receive(const unsigned char * packet, size_t size, NetSnapshot& snapshot) {
+	ByteReader r(packet, size);
+	if (r.get_u8() != PACKET_SNAPSHOT)
+		return false;
+	unsigned int sequence = r.get_u32();
+	r.get_u32();
+	r.get_f64();
+	r.get_u32();
+	unsigned int fragment = r.get_u16();
+	unsigned int fragment_count = r.get_u16();
+	if (!r.ok || fragment >= fragment_count || sequence <= acknowledged || sequence < pending_sequence)
+		return false;
+
+	// A newer snapshot drops the one in progress
+	if (sequence != pending_sequence) {
+		pending_sequence = sequence;
+		pending_received = 0;
+		fragments.assign(fragment_count, std::vector<unsigned char>());
+	}
+	if (fragment_count != fragments.size() || !fragments[fragment].empty())
+		return false;
+
+	fragments[fragment].assign(packet, packet + size);
+	if (++pending_received < (int)fragments.size())
+		return false;
+
+	bool ok = decode(snapshot);
+	pending_sequence = 0;
+	fragments.clear();
+	if (ok)
+		acknowledged = snapshot.sequence;
+	return ok;
+}
+
+bool SnapshotDecoder::decode(NetSnapshot& snapshot) {
+	static const std::vector<QuantizedEntity> nothing;
+
+	std::vector<unsigned int> removed;
+	std::vector<QuantizedEntity> changed;
+	const std::vector<QuantizedEntity>* base = &nothing;
+	for (size_t f = 0; f < fragments.size(); f++) {
+		ByteReader r(&fragments[f][0], fragments[f].size());
+		r.get_u8();
+		snapshot.sequence = r.get_u32();
+		unsigned int baseline = r.get_u32();
+		snapshot.server_time = r.get_f64();
+		snapshot.last_click = r.get_u32();
+		r.get_u16();
+		r.get_u16();
+
+		if (baseline != 0) {
+			// The server may delta against a snapshot this client dropped or never completed
+			if (history_sequence[baseline % history_size] != baseline)
+				return false;
+			base = &history[baseline % history_size];
+		}
+
+		unsigned int removed_count = r.get_varint();
+		unsigned int previous = 0;
+		for (unsigned int k = 0; k < removed_count && r.ok; k++) {
+			previous += r.get_varint();
+			removed.push_back(previous);
+		}
+
+		unsigned int record_count = r.get_u16();
+		previous = 0;
+		for (unsigned int k = 0; k < record_count && r.ok; k++) {
+			QuantizedEntity e;
+			previous += r.get_varint();
+			e.id = previous;
+			unsigned int flags = r.get_u8();
+			if (flags & RECORD_FULL) {
+				e.type = r.get_varint();
+				e.layer = r.get_zigzag();
+				for (int i = 0; i < 3; i++)
+					e.position[i] = r.get_zigzag();
+				e.rotation = r.get_u32();
+			} else {
+				const QuantizedEntity* old = find_entity(*base, e.id);
+				if (!old)
+					return false;
+				e = *old;
+				if (flags & RECORD_POSITION) {
+					for (int i = 0; i < 3; i++)
+						e.position[i] += r.get_zigzag();
+				}
+				if (flags & RECORD_ROTATION)
+					e.rotation = r.get_u32();
+				if (flags & RECORD_TYPE) {
+					e.type = r.get_varint();
+					e.layer = r.get_zigzag();
+				}
+			}
+			changed.push_back(e);
+		}
+		if (!r.ok || !r.at_end())
+			return false;
+	}
+
+	// Baseline minus the removed ones, with the changes merged in by id
+	std::vector<QuantizedEntity>& result = history[snapshot.sequence % history_size];
+	history_sequence[snapshot.sequence % history_size] = 0;
+	std::vector<QuantizedEntity> merged;
+	merged.reserve(base->size() + changed.size());
+	size_t b = 0;
+	size_t c = 0;
+	while (b < base->size() || c < changed.size()) {
+		if (c < changed.size() && (b == base->size() || changed[c].id <= (*base)[b].id)) {
+			if (b < base->size() && (*base)[b].id == changed[c].id)
+				b++;
+			merged.push_back(changed[c++]);
+		} else {
+			if (!std::binary_search(removed.begin(), removed.end(), (*base)[b].id))
+				merged.push_back((*base)[b]);
+			b++;
+		}
+	}
+	result.swap(merged);
+	history_sequence[snapshot.sequence % history_size] = snapshot.sequence;
+
+	snapshot.entities.resize(result.size());
+	for (size_t i = 0; i < result.size(); i++)
+		snapshot.entities[i] = dequantize(result[i]);
+	return true;
+}
+
+
+void SnapshotInterpolator::add(const NetSnapshot& snapshot) {
+	if (!snapshots.empty() && snapshot.server_time <= snapshots.back().server_time)
+		return;
+	if (snapshots.size() == (size_t)max_snapshots)
+		snapshots.erase(snapshots.begin());
+	snapshots.push_back(snapshot);
+}
+
+void SnapshotInterpolator::sample(double server_time, std::vector<NetEntity>& entities) const {
+	entities.clear();
+	if (snapshots.empty())
+		return;
+
+	// Before the first or after the last snapshot : hold it, no extrapolation
+	if (server_time <= snapshots.front().server_time || snapshots.size() == 1) {
+		entities = snapshots.front().entities;
+		return;
+	}
+	if (server_time >= snapshots.back().server_time) {
+		entities = snapshots.back().entities;
+		return;
+	}
+
+	size_t next = 1;
+	while (snapshots[next].server_time < server_time)
+		next++;
+	const NetSnapshot& a = snapshots[next - 1];
+	const NetSnapshot& b = snapshots[next];
+	float t = float((server_time - a.server_time) / (b.server_time - a.server_time));
+
+	entities.reserve(b.entities.size());
+	size_t i = 0;
+	for (size_t j = 0; j < b.entities.size(); j++) {
+		const NetEntity& to = b.entities[j];
+		while (i < a.entities.size() && a.entities[i].id < to.id)
+			i++;
+		if (i == a.entities.size() || a.entities[i].id != to.id) {
+			entities.push_back(to);
+			continue;
+		}
+
+		const NetEntity& from = a.entities[i];
+		NetEntity e = to;
+		e.position = from.position + (to.position - from.position) * t;
+		// Shortest way around : q and -q are the same rotation
+		float d = from.rotation.x * to.rotation.x + from.rotation.y * to.rotation.y + from.rotation.z * to.rotation.z + from.rotation.w * to.rotation.w;
+		float s = d < 0 ? -1.0f : 1.0f;
+		glm::quat q(
+			from.rotation.w + (s * to.rotation.w - from.rotation.w) * t,
+			from.rotation.x + (s * to.rotation.x - from.rotation.x) * t,
+			from.rotation.y + (s * to.rotation.y - from.rotation.y) * t,
+			from.rotation.z + (s * to.rotation.z - from.rotation.z) * t
+		);
+		float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+		e.rotation = length > 0 ? glm::quat(q.w / length, q.x / length, q.y / length, q.z / length) : to.rotation;
+		entities.push_back(e);
+	}
+}
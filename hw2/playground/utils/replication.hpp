@@ -0,0 +1,148 @@
+#ifndef REPLICATION_HPP
+#define REPLICATION_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Wire format between the simulation server and the render clients.
+//
+// The server sends the world as snapshots : every entity with its position
+// quantized to 1/128 unit and its rotation to 32 bits (smallest three). A
+// snapshot only holds what changed since the latest one the client has
+// acknowledged, and is split into fragments that fit in a datagram. Clients
+// send their camera and the clicks not acknowledged yet, every frame.
+
+const int net_max_packet = 1200;
+const unsigned short net_default_port = 27015;
+
+enum NetEntityType {
+	NET_ENEMY = 0,
+	NET_FIREBALL = 1,
+};
+
+struct NetEntity {
+	unsigned int id; // not 0
+	int type;
+	int layer;
+	glm::vec3 position;
+	glm::quat rotation;
+};
+
+struct NetClick {
+	unsigned int number; // from 1, one more per click : the server skips the ones it has seen
+	double time;         // client clock
+	glm::vec3 direction;
+};
+
+struct NetInput {
+	unsigned int acknowledged; // latest snapshot the client has in full, 0 for none
+	double time;               // client clock when sent
+	glm::vec3 camera_position;
+	float horizontal_angle;
+	float vertical_angle;
+	std::vector<NetClick> clicks;
+};
+
+// Packet type from its first byte, -1 if unknown
+enum NetPacketType {
+	PACKET_INPUT = 1,
+	PACKET_SNAPSHOT = 2,
+};
+int get_packet_type(const unsigned char * packet, size_t size);
+
+// At most max_input_clicks clicks go in one packet, the oldest ones
+const int max_input_clicks = 32;
+size_t write_input_packet(const NetInput& input, unsigned char * packet);
+bool read_input_packet(const unsigned char * packet, size_t size, NetInput& input);
+
+struct NetSnapshot {
+	unsigned int sequence;
+	double server_time;
+	unsigned int last_click; // latest click of this client the server has handled
+	std::vector<NetEntity> entities; // sorted by id
+};
+
+// Quantized entity, what gets compared and sent
+struct QuantizedEntity {
+	unsigned int id;
+	int type;
+	int layer;
+	int position[3];
+	unsigned int rotation;
+};
+
+// Server side, one per client
+class SnapshotEncoder {
+public:
+	SnapshotEncoder();
+
+	// The client has everything up to this snapshot
+	void acknowledge(unsigned int sequence);
+
+	// Fragments of the next snapshot. entities have to be sorted by id.
+	void encode(const std::vector<NetEntity>& entities, double server_time, unsigned int last_click,
+		std::vector<std::vector<unsigned char> >& packets);
+
+	unsigned int get_sequence() const { return sequence; }
+
+private:
+	static const int history_size = 64;
+
+	unsigned int sequence; // of the last snapshot sent
+	unsigned int acknowledged;
+
+	std::vector<QuantizedEntity> current;
+	std::vector<QuantizedEntity> history[history_size];
+	unsigned int history_sequence[history_size];
+};
+
+// Client side : puts the fragments back together
+class SnapshotDecoder {
+public:
+	SnapshotDecoder();
+
+	// True when this fragment completed a snapshot, which is then in snapshot
+	bool receive(const unsigned char * packet, size_t size, NetSnapshot& snapshot);
+
+	// What to acknowledge to the server
+	unsigned int get_acknowledged() const { return acknowledged; }
+
+private:
+	static const int history_size = 64;
+
+	bool decode(NetSnapshot& snapshot);
+
+	unsigned int acknowledged;
+
+	// Snapshot being received
+	unsigned int pending_sequence;
+	int pending_received;
+	std::vector<std::vector<unsigned char> > fragments;
+
+	std::vector<QuantizedEntity> history[history_size];
+	unsigned int history_sequence[history_size];
+};
+
+// Client side : renders a little in the past, between the two snapshots around
+// the render time, so the entities move smoothly whatever the tick rate
+class SnapshotInterpolator {
+public:
+	void add(const NetSnapshot& snapshot);
+
+	// Positions lerped and rotations nlerped. An entity only in the newer
+	// snapshot is at its new place, one only in the older one is gone.
+	void sample(double server_time, std::vector<NetEntity>& entities) const;
+
+	bool empty() const { return snapshots.empty(); }
+	double get_latest_time() const { return snapshots.empty() ? 0 : snapshots.back().server_time; }
+
+private:
+	static const int max_snapshots = 16;
+
+	std::vector<NetSnapshot> snapshots; // oldest first
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "assetpack.hpp"
+#include "shaders.hpp"
+
+
+GLuint compile_shader(GLenum type, const char * path) {
+	Asset source;
+	if (!source.open(path)) {
+		printf("Impossible to open %s. Are you in the right directory ?\n", path);
+		return 0;
+	}
+
+	// Straight from the asset, which has no terminating zero
+	printf("Compiling shader : %s\n", path);
+	GLuint shader = glCreateShader(type);
+	const char * code = (const char *)source.data();
+	GLint code_length = (GLint)source.size();
+	glShaderSource(shader, 1, &code, &code_length);
+	glCompileShader(shader);
+
+	GLint result = GL_FALSE;
+	GLint log_length = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
+	if (log_length > 1) {
+		std::vector<char> message(log_length + 1);
+		glGetShaderInfoLog(shader, log_length, NULL, &message[0]);
+		printf("%s\n", &message[0]);
+	}
+	if (result != GL_TRUE) {
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+bool link_program(GLuint program) {
+	glLinkProgram(program);
+
+	GLint result = GL_FALSE;
+	GLint log_length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+	if (log_length > 1) {
+		std::vector<char> message(log_length + 1);
+		glGetProgramInfoLog(program, log_length, NULL, &message[0]);
+		printf("%s\n", &message[0]);
+	}
+	if (result != GL_TRUE) {
+		glDeleteProgram(program);
+		return false;
+	}
+	return true;
+}
+
+GLuint load_program(const char * vertex_path, const char * fragment_path) {
+	return load_program(vertex_path, fragment_path, NULL);
+}
+
+GLuint load_program(const char * vertex_path, const char * fragment_path, const char * fragment_library_path) {
+	GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_path);
+	GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_path);
+	GLuint library_shader = fragment_library_path ? compile_shader(GL_FRAGMENT_SHADER, fragment_library_path) : 0;
+	if (!vertex_shader || !fragment_shader || (fragment_library_path && !library_shader)) {
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+		glDeleteShader(library_shader);
+		return 0;
+	}
+
+	printf("Linking program\n");
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+	if (library_shader)
+		glAttachShader(program, library_shader);
+	bool linked = link_program(program);
+	if (linked) {
+		glDetachShader(program, vertex_shader);
+		glDetachShader(program, fragment_shader);
+		if (library_shader)
+			glDetachShader(program, library_shader);
+	}
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+	glDeleteShader(library_shader);
+	return linked ? program : 0;
+}
+
+GLuint load_compute_program(const char * path) {
+	GLuint shader = compile_shader(GL_COMPUTE_SHADER, path);
+	if (!shader)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	bool linked = link_program(program);
+	if (linked)
+		glDetachShader(program, shader);
+	glDeleteShader(shader);
+	return linked ? program : 0;
+}
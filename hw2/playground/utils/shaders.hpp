@@ -0,0 +1,24 @@
+#ifndef SHADERS_HPP
+#define SHADERS_HPP
+
+// Shader sources are read as assets, see Asset : from the asset pack when one
+// is mounted, else from the working directory. Compile and link logs are
+// printed, failures return 0.
+
+GLuint compile_shader(GLenum type, const char * path);
+
+// Links program, which keeps its shaders attached. Deletes it and returns
+// false when the link fails.
+bool link_program(GLuint program);
+
+// Vertex and fragment shader linked together, same as LoadShaders
+GLuint load_program(const char * vertex_path, const char * fragment_path);
+
+// Same with a second fragment shader linked in, for functions the first one
+// declares and calls
+GLuint load_program(const char * vertex_path, const char * fragment_path, const char * fragment_library_path);
+
+// Program made of a single compute shader
+GLuint load_compute_program(const char * path);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// SSE2 is always there on x64 and enabled by /arch:SSE2 or -msse2 on x86.
+// Code using it keeps a scalar path for everything else.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif
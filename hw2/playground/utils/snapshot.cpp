@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+#include "lz.hpp"
+#include "snapshot.hpp"
+
+
+static const char snapshot_magic[4] = { 'P', 'G', 'S', 'N' };
+static const size_t header_size = 48;
+static const size_t section_entry_size = 32;
+static const size_t section_alignment = 16;
+
+enum SnapshotCompression {
+	COMPRESSION_NONE = 0,
+	COMPRESSION_LZ = 1,
+};
+
+// Fields are copied as they are in memory : the format is little-endian like
+// every target of the program
+template <typename T>
+static void put(unsigned char * p, T value) {
+	memcpy(p, &value, sizeof(T));
+}
+
+template <typename T>
+static T get(const unsigned char * p) {
+	T value;
+	memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+static size_t align_up(size_t offset) {
+	return (offset + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+
+bool save_snapshot(const char * path, const SnapshotCamera& camera,
+	const std::vector<SnapshotSection>& sections, bool compress) {
+	size_t count = sections.size();
+
+	// Compressed bytes of the sections that get smaller, empty for the others
+	std::vector<std::vector<unsigned char> > packed(count);
+	std::vector<const unsigned char *> stored_data(count);
+	std::vector<unsigned long long> stored_size(count);
+	std::vector<unsigned long long> offsets(count);
+
+	size_t offset = align_up(header_size + count * section_entry_size);
+	for (size_t i = 0; i < count; i++) {
+		const SnapshotSection& s = sections[i];
+		size_t size = (size_t)s.record_size * s.record_count;
+		stored_data[i] = (const unsigned char *)s.data;
+		stored_size[i] = size;
+		if (compress && size > 0) {
+			lz_compress(stored_data[i], size, packed[i]);
+			if (packed[i].size() < size) {
+				stored_data[i] = &packed[i][0];
+				stored_size[i] = packed[i].size();
+			} else {
+				packed[i].clear();
+			}
+		}
+		offsets[i] = offset;
+		offset = align_up(offset + (size_t)stored_size[i]);
+	}
+
+	std::vector<unsigned char> table(align_up(header_size + count * section_entry_size), 0);
+	unsigned char * h = &table[0];
+	memcpy(h, snapshot_magic, 4);
+	put<unsigned int>(h + 4, snapshot_version);
+	put<unsigned int>(h + 8, (unsigned int)count);
+	put<float>(h + 16, camera.position.x);
+	put<float>(h + 20, camera.position.y);
+	put<float>(h + 24, camera.position.z);
+	put<float>(h + 28, camera.horizontal_angle);
+	put<float>(h + 32, camera.vertical_angle);
+	for (size_t i = 0; i < count; i++) {
+		unsigned char * e = h + header_size + i * section_entry_size;
+		put<unsigned int>(e, sections[i].id);
+		put<unsigned int>(e + 4, sections[i].record_size);
+		put<unsigned int>(e + 8, sections[i].record_count);
+		put<unsigned int>(e + 12, packed[i].empty() ? COMPRESSION_NONE : COMPRESSION_LZ);
+		put<unsigned long long>(e + 16, offsets[i]);
+		put<unsigned long long>(e + 24, stored_size[i]);
+	}
+
+	FILE * file = fopen(path, "wb");
+	if (!file) {
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+	static const unsigned char padding[section_alignment] = { 0 };
+	bool ok = fwrite(&table[0], 1, table.size(), file) == table.size();
+	size_t written = table.size();
+	for (size_t i = 0; i < count && ok; i++) {
+		ok = fwrite(padding, 1, (size_t)offsets[i] - written, file) == (size_t)offsets[i] - written;
+		if (stored_size[i] > 0)
+			ok = ok && fwrite(stored_data[i], 1, (size_t)stored_size[i], file) == (size_t)stored_size[i];
+		written = (size_t)(offsets[i] + stored_size[i]);
+	}
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok) {
+		printf("%s could not be written\n", path);
+		remove(path);
+	}
+	return ok;
+}
+
+
+bool Snapshot::open(const char * path) {
+	close();
+	if (!file.open(path))
+		return false;
+
+	const unsigned char * data = file.data();
+	size_t size = file.size();
+	if (size < header_size || memcmp(data, snapshot_magic, 4) != 0) {
+		printf("%s is not a snapshot\n", path);
+		close();
+		return false;
+	}
+	unsigned int version = get<unsigned int>(data + 4);
+	if (version != snapshot_version) {
+		printf("%s is a version %u snapshot, version %u expected\n", path, version, snapshot_version);
+		close();
+		return false;
+	}
+	unsigned int count = get<unsigned int>(data + 8);
+	if (count > (size - header_size) / section_entry_size) {
+		printf("%s is truncated\n", path);
+		close();
+		return false;
+	}
+
+	camera.position = glm::vec3(get<float>(data + 16), get<float>(data + 20), get<float>(data + 24));
+	camera.horizontal_angle = get<float>(data + 28);
+	camera.vertical_angle = get<float>(data + 32);
+
+	for (unsigned int i = 0; i < count; i++) {
+		const unsigned char * e = data + header_size + i * section_entry_size;
+		Section s;
+		s.id = get<unsigned int>(e);
+		s.record_size = get<unsigned int>(e + 4);
+		s.record_count = get<unsigned int>(e + 8);
+		unsigned int compression = get<unsigned int>(e + 12);
+		unsigned long long offset = get<unsigned long long>(e + 16);
+		unsigned long long stored_size = get<unsigned long long>(e + 24);
+		unsigned long long raw_size = (unsigned long long)s.record_size * s.record_count;
+
+		// A compressed byte never stands for more than 255 bytes, bigger sizes are corrupt
+		bool ok = offset <= size && stored_size <= size - offset && offset % section_alignment == 0;
+		if (ok && compression == COMPRESSION_NONE) {
+			ok = stored_size == raw_size;
+			s.data = data + offset;
+		} else if (ok && compression == COMPRESSION_LZ && raw_size == (size_t)raw_size && raw_size / 255 <= stored_size) {
+			unpacked.push_back(std::vector<unsigned char>((size_t)raw_size));
+			std::vector<unsigned char>& bytes = unpacked.back();
+			ok = raw_size > 0 && lz_decompress(data + offset, (size_t)stored_size, &bytes[0], bytes.size());
+			s.data = ok ? &bytes[0] : NULL;
+		} else {
+			ok = false;
+		}
+		if (!ok) {
+			printf("%s : section %u is corrupt\n", path, s.id);
+			close();
+			return false;
+		}
+		sections.push_back(s);
+	}
+	return true;
+}
+
+void Snapshot::close() {
+	file.close();
+	sections.clear();
+	unpacked.clear();
+}
+
+const void * Snapshot::get_section(unsigned int id, unsigned int record_size, unsigned int& record_count) const {
+	record_count = 0;
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (sections[i].id != id)
+			continue;
+		if (sections[i].record_size != record_size) {
+			printf("snapshot section %u has %u byte records, %u expected\n", id, sections[i].record_size, record_size);
+			return NULL;
+		}
+		record_count = sections[i].record_count;
+		return sections[i].data;
+	}
+	return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+
+// Version of the file layout, not of the records : a record layout change
+// shows up as a different record size and the section is refused
+const unsigned int snapshot_version = 1;
+
+struct SnapshotCamera {
+	glm::vec3 position;
+	float horizontal_angle;
+	float vertical_angle;
+};
+
+// One array of fixed-size records, saved as raw bytes
+struct SnapshotSection {
+	unsigned int id;
+	unsigned int record_size;
+	unsigned int record_count;
+	const void * data;
+};
+
+// Header, table of sections, then the sections one after the other, each
+// 16-byte aligned. Little-endian, the records are written as they are in
+// memory. A section is stored LZ compressed when asked and when it saves space.
+bool save_snapshot(const char * path, const SnapshotCamera& camera,
+	const std::vector<SnapshotSection>& sections, bool compress);
+
+// Snapshot read through a memory mapping : uncompressed sections are used in
+// place, compressed ones are unpacked once by open()
+class Snapshot {
+public:
+	bool open(const char * path);
+	void close();
+
+	const SnapshotCamera& get_camera() const { return camera; }
+
+	// Records of section id, NULL if there is no such section or its records
+	// don't have the expected size. Valid until close().
+	const void * get_section(unsigned int id, unsigned int record_size, unsigned int& record_count) const;
+
+private:
+	struct Section {
+		unsigned int id;
+		unsigned int record_size;
+		unsigned int record_count;
+		const unsigned char * data;
+	};
+
+	MappedFile file;
+	SnapshotCamera camera;
+	std::vector<Section> sections;
+	std::vector<std::vector<unsigned char> > unpacked;
+};
+
+#endif
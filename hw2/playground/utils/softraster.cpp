@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simd.hpp"
+#include "threadpool.hpp"
+#include "bcdecode.hpp"
+#include "texture.hpp"
+#include "softraster.hpp"
+
+
+static unsigned int pack_rgba(float r, float g, float b, float a) {
+	r = clamp(r, 0.0f, 1.0f);
+	g = clamp(g, 0.0f, 1.0f);
+	b = clamp(b, 0.0f, 1.0f);
+	a = clamp(a, 0.0f, 1.0f);
+	return (unsigned int)(r * 255.0f + 0.5f)
+		| ((unsigned int)(g * 255.0f + 0.5f) << 8)
+		| ((unsigned int)(b * 255.0f + 0.5f) << 16)
+		| ((unsigned int)(a * 255.0f + 0.5f) << 24);
+}
+
+
+SoftRenderer::SoftRenderer(int width, int height) {
+	this->width = width;
+	this->height = height;
+	tiles_x = (width + tile_size - 1) / tile_size;
+	tiles_y = (height + tile_size - 1) / tile_size;
+	color.assign(width * height, 0);
+	depth.assign(width * height, 1.0f);
+	bins.resize(tiles_x * tiles_y);
+	tile_fragments.assign(tiles_x * tiles_y, 0);
+	clear_pending = false;
+	clear_value = 0;
+	last_triangle_count = 0;
+	last_fragment_count = 0;
+}
+
+void SoftRenderer::clear(vec4 clear_color) {
+	// Tiles are cleared by the workers at the start of finish()
+	clear_pending = true;
+	clear_value = pack_rgba(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
+	triangles.clear();
+	for (size_t i = 0; i < bins.size(); i++) {
+		bins[i].clear();
+	}
+}
+
+
+// Keep the part of the polygon with z >= -w, i.e. in front of the near plane
+static int clip_near(const SoftRenderer::Vertex* in, int in_count, SoftRenderer::Vertex* out, int attrib_size) {
+	int out_count = 0;
+	for (int i = 0; i < in_count; i++) {
+		const SoftRenderer::Vertex& a = in[i];
+		const SoftRenderer::Vertex& b = in[(i + 1) % in_count];
+		float da = a.clip.z + a.clip.w;
+		float db = b.clip.z + b.clip.w;
+
+		if (da >= 0)
+			out[out_count++] = a;
+		if ((da >= 0) != (db >= 0)) {
+			float t = da / (da - db);
+			SoftRenderer::Vertex& v = out[out_count++];
+			v.clip = a.clip + (b.clip - a.clip) * t;
+			for (int c = 0; c < attrib_size; c++) {
+				v.attr[c] = a.attr[c] + (b.attr[c] - a.attr[c]) * t;
+			}
+		}
+	}
+	return out_count;
+}
+
+void SoftRenderer::draw_arrays(
+	const float* vertices, const float* attribs, int attrib_size, int polygon_count,
+	const mat4& MVP, const SoftTexture* texture
+) {
+	for (int p = 0; p < polygon_count; p++) {
+		Vertex v[3];
+		int inside = 0;
+		for (int k = 0; k < 3; k++) {
+			const float* pos = vertices + (p * 3 + k) * 3;
+			v[k].clip = MVP * vec4(pos[0], pos[1], pos[2], 1.0f);
+			for (int c = 0; c < attrib_size; c++) {
+				v[k].attr[c] = attribs[(p * 3 + k) * attrib_size + c];
+			}
+			if (v[k].clip.z + v[k].clip.w >= 0)
+				inside++;
+		}
+
+		if (inside == 0)
+			continue;
+		if (inside == 3) {
+			setup_triangle(v[0], v[1], v[2], attrib_size, texture);
+			continue;
+		}
+
+		// Crosses the near plane : clip and draw the result as a fan
+		Vertex clipped[4];
+		int count = clip_near(v, 3, clipped, attrib_size);
+		for (int k = 1; k + 1 < count; k++) {
+			setup_triangle(clipped[0], clipped[k], clipped[k + 1], attrib_size, texture);
+		}
+	}
+}
+
+void SoftRenderer::setup_triangle(
+	const Vertex& v0, const Vertex& v1, const Vertex& v2, int attrib_size, const SoftTexture* texture
+) {
+	const Vertex* v[3] = { &v0, &v1, &v2 };
+	float x[3], y[3], z[3], inv_w[3];
+
+	// Clip space -> window space, origin in the bottom left corner like in GL
+	for (int k = 0; k < 3; k++) {
+		inv_w[k] = 1.0f / v[k]->clip.w;
+		x[k] = (v[k]->clip.x * inv_w[k] * 0.5f + 0.5f) * width;
+		y[k] = (v[k]->clip.y * inv_w[k] * 0.5f + 0.5f) * height;
+		z[k] = v[k]->clip.z * inv_w[k] * 0.5f + 0.5f;
+	}
+
+	// Counter-clockwise triangles have positive area, everything else is culled
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(area > 0))
+		return;
+
+	// Pixels whose centers can be covered
+	float fmin_x = std::min(x[0], std::min(x[1], x[2]));
+	float fmax_x = std::max(x[0], std::max(x[1], x[2]));
+	float fmin_y = std::min(y[0], std::min(y[1], y[2]));
+	float fmax_y = std::max(y[0], std::max(y[1], y[2]));
+	if (fmax_x < 0 || fmax_y < 0 || fmin_x > width || fmin_y > height)
+		return;
+
+	Triangle tri;
+	tri.min_x = std::max(0, (int)ceilf(fmin_x - 0.5f));
+	tri.min_y = std::max(0, (int)ceilf(fmin_y - 0.5f));
+	tri.max_x = std::min(width - 1, (int)floorf(fmax_x - 0.5f));
+	tri.max_y = std::min(height - 1, (int)floorf(fmax_y - 0.5f));
+	if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+		return;
+
+	// Edge i is the one opposite to vertex i
+	for (int i = 0; i < 3; i++) {
+		int a = (i + 1) % 3;
+		int b = (i + 2) % 3;
+		tri.A[i] = y[a] - y[b];
+		tri.B[i] = x[b] - x[a];
+		tri.C[i] = -(tri.A[i] * x[a] + tri.B[i] * y[a]);
+		// Top-left fill rule, so shared edges are drawn exactly once
+		tri.top_left[i] = tri.A[i] > 0 || (tri.A[i] == 0 && tri.B[i] < 0);
+	}
+
+	tri.inv_area = 1.0f / area;
+	tri.z0 = (tri.C[0] * z[0] + tri.C[1] * z[1] + tri.C[2] * z[2]) * tri.inv_area;
+	tri.dzdx = (tri.A[0] * z[0] + tri.A[1] * z[1] + tri.A[2] * z[2]) * tri.inv_area;
+	tri.dzdy = (tri.B[0] * z[0] + tri.B[1] * z[1] + tri.B[2] * z[2]) * tri.inv_area;
+
+	for (int k = 0; k < 3; k++) {
+		tri.inv_w[k] = inv_w[k];
+		for (int c = 0; c < 4; c++) {
+			tri.attr[k][c] = c < attrib_size ? v[k]->attr[c] : 1.0f;
+		}
+	}
+	tri.attrib_size = attrib_size;
+	tri.texture = texture;
+
+	unsigned int index = (unsigned int)triangles.size();
+	triangles.push_back(tri);
+
+	// Bin into every tile the bounding box touches
+	for (int ty = tri.min_y / tile_size; ty <= tri.max_y / tile_size; ty++) {
+		for (int tx = tri.min_x / tile_size; tx <= tri.max_x / tile_size; tx++) {
+			bins[ty * tiles_x + tx].push_back(index);
+		}
+	}
+}
+
+
+static void sample_texture(const SoftTexture& texture, float u, float v, float* out) {
+	// GL_REPEAT wrapping with bilinear filtering
+	float fx = (u - floorf(u)) * texture.width - 0.5f;
+	float fy = (v - floorf(v)) * texture.height - 0.5f;
+	int x0 = (int)floorf(fx);
+	int y0 = (int)floorf(fy);
+	float tx = fx - x0;
+	float ty = fy - y0;
+
+	int xs[2] = { (x0 + texture.width) % texture.width, (x0 + 1) % texture.width };
+	int ys[2] = { (y0 + texture.height) % texture.height, (y0 + 1) % texture.height };
+	float wx[2] = { 1.0f - tx, tx };
+	float wy[2] = { 1.0f - ty, ty };
+
+	out[0] = out[1] = out[2] = out[3] = 0;
+	for (int j = 0; j < 2; j++) {
+		for (int i = 0; i < 2; i++) {
+			const unsigned char* texel = &texture.rgba[(ys[j] * texture.width + xs[i]) * 4];
+			float w = wx[i] * wy[j] * (1.0f / 255.0f);
+			out[0] += texel[0] * w;
+			out[1] += texel[1] * w;
+			out[2] += texel[2] * w;
+			out[3] += texel[3] * w;
+		}
+	}
+}
+
+bool SoftRenderer::shade_pixel(const Triangle& tri, int x, int y, float z, float e1, float e2) {
+	int index = y * width + x;
+	if (!(z < depth[index]) || z < 0.0f || z > 1.0f)
+		return false;
+
+	// Perspective-correct barycentrics
+	float b1 = e1 * tri.inv_area;
+	float b2 = e2 * tri.inv_area;
+	float b0 = 1.0f - b1 - b2;
+	float p0 = b0 * tri.inv_w[0];
+	float p1 = b1 * tri.inv_w[1];
+	float p2 = b2 * tri.inv_w[2];
+	float norm = 1.0f / (p0 + p1 + p2);
+	p0 *= norm;
+	p1 *= norm;
+	p2 *= norm;
+
+	float attr[4];
+	for (int c = 0; c < 4; c++) {
+		attr[c] = tri.attr[0][c] * p0 + tri.attr[1][c] * p1 + tri.attr[2][c] * p2;
+	}
+
+	float src[4];
+	if (tri.texture) {
+		// TextureFragmentShader_obj only outputs rgb, so alpha stays 1
+		sample_texture(*tri.texture, attr[0], attr[1], src);
+		src[3] = 1.0f;
+	} else {
+		src[0] = attr[0];
+		src[1] = attr[1];
+		src[2] = attr[2];
+		src[3] = tri.attrib_size >= 4 ? attr[3] : 1.0f;
+	}
+
+	// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+	unsigned int dst = color[index];
+	float a = clamp(src[3], 0.0f, 1.0f);
+	float inv_a = (1.0f - a) * (1.0f / 255.0f);
+	color[index] = pack_rgba(
+		src[0] * a + (dst & 0xff) * inv_a,
+		src[1] * a + ((dst >> 8) & 0xff) * inv_a,
+		src[2] * a + ((dst >> 16) & 0xff) * inv_a,
+		src[3] * a + ((dst >> 24) & 0xff) * inv_a
+	);
+	depth[index] = z;
+	return true;
+}
+
+void SoftRenderer::raster_tile(int tile_index) {
+	int tile_min_x = (tile_index % tiles_x) * tile_size;
+	int tile_min_y = (tile_index / tiles_x) * tile_size;
+	int tile_max_x = std::min(tile_min_x + tile_size, width) - 1;
+	int tile_max_y = std::min(tile_min_y + tile_size, height) - 1;
+
+	if (clear_pending) {
+		for (int y = tile_min_y; y <= tile_max_y; y++) {
+			std::fill(&color[y * width + tile_min_x], &color[y * width + tile_max_x] + 1, clear_value);
+			std::fill(&depth[y * width + tile_min_x], &depth[y * width + tile_max_x] + 1, 1.0f);
+		}
+	}
+
+	int fragments = 0;
+	const std::vector<unsigned int>& bin = bins[tile_index];
+	for (size_t t = 0; t < bin.size(); t++) {
+		const Triangle& tri = triangles[bin[t]];
+		int min_x = std::max(tri.min_x, tile_min_x);
+		int max_x = std::min(tri.max_x, tile_max_x);
+		int min_y = std::max(tri.min_y, tile_min_y);
+		int max_y = std::min(tri.max_y, tile_max_y);
+
+		// Edge functions are evaluated for 4 pixels of a row at once
+#ifdef SIMD_SSE2
+		const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 A[3], top_left[3];
+		for (int i = 0; i < 3; i++) {
+			A[i] = _mm_set1_ps(tri.A[i]);
+			top_left[i] = _mm_castsi128_ps(_mm_set1_epi32(tri.top_left[i] ? -1 : 0));
+		}
+
+		for (int y = min_y; y <= max_y; y++) {
+			float py = y + 0.5f;
+			__m128 row[3];
+			for (int i = 0; i < 3; i++) {
+				row[i] = _mm_set1_ps(tri.B[i] * py + tri.C[i]);
+			}
+
+			for (int x = min_x; x <= max_x; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane_offsets);
+				__m128 e[3];
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int i = 0; i < 3; i++) {
+					e[i] = _mm_add_ps(_mm_mul_ps(A[i], px), row[i]);
+					__m128 edge_in = _mm_or_ps(
+						_mm_cmpgt_ps(e[i], zero),
+						_mm_and_ps(_mm_cmpeq_ps(e[i], zero), top_left[i])
+					);
+					inside = _mm_and_ps(inside, edge_in);
+				}
+
+				int mask = _mm_movemask_ps(inside);
+				if (mask == 0)
+					continue;
+
+				float e1[4], e2[4];
+				_mm_storeu_ps(e1, e[1]);
+				_mm_storeu_ps(e2, e[2]);
+				for (int k = 0; k < 4 && x + k <= max_x; k++) {
+					if (mask & (1 << k)) {
+						float z = tri.z0 + tri.dzdx * (x + k + 0.5f) + tri.dzdy * py;
+						fragments += shade_pixel(tri, x + k, y, z, e1[k], e2[k]);
+					}
+				}
+			}
+		}
+#else
+		for (int y = min_y; y <= max_y; y++) {
+			float py = y + 0.5f;
+			for (int x = min_x; x <= max_x; x++) {
+				float px = x + 0.5f;
+				float e[3];
+				bool inside = true;
+				for (int i = 0; i < 3 && inside; i++) {
+					e[i] = tri.A[i] * px + tri.B[i] * py + tri.C[i];
+					inside = e[i] > 0 || (e[i] == 0 && tri.top_left[i]);
+				}
+				if (inside) {
+					fragments += shade_pixel(tri, x, y, tri.z0 + tri.dzdx * px + tri.dzdy * py, e[1], e[2]);
+				}
+			}
+		}
+#endif
+	}
+	tile_fragments[tile_index] = fragments;
+}
+
+void SoftRenderer::finish() {
+	get_thread_pool().parallel_for(tiles_x * tiles_y, [this](int tile) {
+		raster_tile(tile);
+	});
+
+	last_triangle_count = (int)triangles.size();
+	last_fragment_count = 0;
+	for (size_t i = 0; i < tile_fragments.size(); i++)
+		last_fragment_count += tile_fragments[i];
+	triangles.clear();
+	for (size_t i = 0; i < bins.size(); i++) {
+		bins[i].clear();
+	}
+	clear_pending = false;
+}
+
+
+bool SoftRenderer::write_bmp(const char * imagepath) const {
+	return saveBMP(imagepath, width, height, (const unsigned char*)&color[0]);
+}
+
+
+bool soft_load_dds(const char * imagepath, SoftTexture & texture) {
+	DecodedImage image;
+	if (!loadDDS_decoded(imagepath, image) || image.levels.empty())
+		return false;
+
+	// Only the top level is needed, the renderer does not sample mipmaps
+	texture.width = image.width;
+	texture.height = image.height;
+	texture.rgba.swap(image.levels[0]);
+	return true;
+}
@@ -0,0 +1,98 @@
+#ifndef SOFTRASTER_HPP
+#define SOFTRASTER_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// RGBA8 image the software renderer can sample from
+struct SoftTexture {
+	int width;
+	int height;
+	std::vector<unsigned char> rgba; // width * height * 4, first row is t = 0 like in OpenGL
+
+	SoftTexture() : width(0), height(0) {}
+};
+
+// Load the top mip level of a DXT1/3/5 .DDS file into a SoftTexture
+bool soft_load_dds(const char * imagepath, SoftTexture & texture);
+
+
+// CPU replacement for the GL path of the playground.
+//
+// Draws are only set up and binned into screen tiles when they are submitted,
+// finish() then rasterizes all tiles in parallel. Inside a tile triangles keep
+// their submission order, so depth test and blending give the same result as GL.
+// The state mirrors init_all : GL_LESS depth test and back-face culling of
+// clockwise triangles. SRC_ALPHA blending is always on, which gives the same
+// result as the opaque pass of the GL path for the opaque draws it gets.
+class SoftRenderer {
+public:
+	static const int tile_size = 64;
+
+	SoftRenderer(int width, int height);
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+
+	void clear(glm::vec4 clear_color);
+
+	// Same data as draw_object gets : 3 floats per vertex and attrib_size floats
+	// of per-vertex attributes. Without a texture the attributes are an RGBA color
+	// (ColorFragmentShader_forHardcoded), with one they are UVs (TextureFragmentShader_obj).
+	void draw_arrays(
+		const float* vertices, const float* attribs, int attrib_size, int polygon_count,
+		const glm::mat4& MVP, const SoftTexture* texture
+	);
+
+	// Rasterize everything submitted since the last finish()
+	void finish();
+
+	// RGBA8 pixels, bottom row first (the way glReadPixels returns them)
+	const unsigned int* get_pixels() const { return &color[0]; }
+
+	bool write_bmp(const char * imagepath) const;
+
+	// Triangles that reached the binning stage during the last frame
+	int get_triangle_count() const { return last_triangle_count; }
+	// Fragments that passed the depth test and were shaded during the last frame
+	long long get_fragment_count() const { return last_fragment_count; }
+
+	struct Vertex {
+		glm::vec4 clip;
+		float attr[4];
+	};
+
+	struct Triangle {
+		// Edge functions E(x, y) = A*x + B*y + C, positive inside
+		float A[3], B[3], C[3];
+		bool top_left[3];
+		// Depth plane in window space
+		float z0, dzdx, dzdy;
+		float inv_w[3];
+		float attr[3][4];
+		int attrib_size;
+		int min_x, min_y, max_x, max_y;
+		float inv_area;
+		const SoftTexture* texture;
+	};
+
+private:
+	void setup_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, int attrib_size, const SoftTexture* texture);
+	void raster_tile(int tile_index);
+	bool shade_pixel(const Triangle& tri, int x, int y, float z, float e1, float e2);
+
+	int width, height;
+	int tiles_x, tiles_y;
+	std::vector<unsigned int> color;
+	std::vector<float> depth;
+	std::vector<Triangle> triangles;
+	std::vector< std::vector<unsigned int> > bins;
+	std::vector<int> tile_fragments;
+	bool clear_pending;
+	unsigned int clear_value;
+	int last_triangle_count;
+	long long last_fragment_count;
+};
+
+#endif
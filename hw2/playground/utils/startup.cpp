@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "startup.hpp"
+
+
+// Dependencies done and all of them successful, waits for them
+static bool wait_dependencies(const std::vector<LoadFuture>& dependencies) {
+	bool ok = true;
+	for (size_t i = 0; i < dependencies.size(); i++)
+		ok = dependencies[i].get() && ok;
+	return ok;
+}
+
+static bool is_ready(const LoadFuture& future) {
+	return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+StartupLoader::StartupLoader() {
+	origin = std::chrono::high_resolution_clock::now();
+}
+
+StartupLoader::~StartupLoader() {
+	// GL tasks left unrun break their promises, which frees the CPU tasks waiting on them
+	gl_tasks.clear();
+	for (size_t i = 0; i < worker_tasks.size(); i++)
+		worker_tasks[i].wait();
+}
+
+double StartupLoader::now_ms() const {
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - origin).count();
+}
+
+void StartupLoader::record(const std::string& name, const char * lane, double start_ms, double end_ms, bool ok) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Span span;
+	span.name = name;
+	span.lane = lane;
+	span.start_ms = start_ms;
+	span.end_ms = end_ms;
+	span.ok = ok;
+	timeline.push_back(span);
+}
+
+LoadFuture StartupLoader::run(
+	const char * name, const std::vector<LoadFuture>& dependencies, const std::function<bool()>& task
+) {
+	std::string task_name = name;
+	LoadFuture future = std::async(std::launch::async, [this, task_name, dependencies, task]() {
+		bool ok = wait_dependencies(dependencies);
+		double start_ms = now_ms();
+		if (ok)
+			ok = task();
+		record(task_name, "worker", start_ms, now_ms(), ok);
+		progress.notify_all();
+		return ok;
+	}).share();
+	tasks.push_back(future);
+	worker_tasks.push_back(future);
+	return future;
+}
+
+LoadFuture StartupLoader::run_gl(
+	const char * name, const std::vector<LoadFuture>& dependencies, const std::function<bool()>& task
+) {
+	GLTask gl_task;
+	gl_task.name = name;
+	gl_task.dependencies = dependencies;
+	gl_task.task = task;
+	gl_task.done = std::make_shared<std::promise<bool> >();
+	LoadFuture future = gl_task.done->get_future().share();
+	gl_tasks.push_back(gl_task);
+	tasks.push_back(future);
+	return future;
+}
+
+bool StartupLoader::run_here(const char * name, const std::function<bool()>& task) {
+	double start_ms = now_ms();
+	bool ok = task();
+	record(name, "main", start_ms, now_ms(), ok);
+	return ok;
+}
+
+bool StartupLoader::finish() {
+	while (true) {
+		// Every GL task whose dependencies are done, in the order they were queued
+		bool ran = false;
+		for (size_t i = 0; i < gl_tasks.size(); ) {
+			bool ready = true;
+			for (size_t d = 0; d < gl_tasks[i].dependencies.size() && ready; d++)
+				ready = is_ready(gl_tasks[i].dependencies[d]);
+			if (!ready) {
+				i++;
+				continue;
+			}
+
+			// Out of the queue first, the task may queue others
+			GLTask gl_task = gl_tasks[i];
+			gl_tasks.erase(gl_tasks.begin() + i);
+			double start_ms = now_ms();
+			bool ok = wait_dependencies(gl_task.dependencies) && gl_task.task();
+			record(gl_task.name, "gl", start_ms, now_ms(), ok);
+			gl_task.done->set_value(ok);
+			ran = true;
+		}
+
+		bool all_done = gl_tasks.empty();
+		for (size_t i = 0; i < tasks.size() && all_done; i++)
+			all_done = is_ready(tasks[i]);
+		if (all_done)
+			break;
+
+		// A CPU task may finish between the check and the wait : the timeout covers it
+		if (!ran) {
+			std::unique_lock<std::mutex> lock(mutex);
+			progress.wait_for(lock, std::chrono::milliseconds(1));
+		}
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < tasks.size(); i++)
+		ok = tasks[i].get() && ok;
+	return ok;
+}
+
+void StartupLoader::print_timeline() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<Span> spans = timeline;
+	std::stable_sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.start_ms < b.start_ms; });
+
+	double end_ms = 0;
+	double main_ms = 0, gl_ms = 0, worker_ms = 0;
+	printf("startup timeline :\n");
+	for (size_t i = 0; i < spans.size(); i++) {
+		const Span& s = spans[i];
+		double duration = s.end_ms - s.start_ms;
+		printf("  %-6s %8.2f -> %8.2f ms  %s%s\n", s.lane, s.start_ms, s.end_ms, s.name.c_str(), s.ok ? "" : " (failed)");
+		end_ms = std::max(end_ms, s.end_ms);
+		if (s.lane[0] == 'm')
+			main_ms += duration;
+		else if (s.lane[0] == 'g')
+			gl_ms += duration;
+		else
+			worker_ms += duration;
+	}
+	printf("startup : %.2f ms, %.2f ms of main thread work, %.2f ms of GL tasks, %.2f ms on the workers\n",
+		end_ms, main_ms, gl_ms, worker_ms);
+}
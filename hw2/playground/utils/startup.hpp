@@ -0,0 +1,69 @@
+#ifndef STARTUP_HPP
+#define STARTUP_HPP
+
+#include <string>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <chrono>
+
+// Done once the task is, true when it succeeded
+typedef std::shared_future<bool> LoadFuture;
+
+// Start-up work as a graph of tasks. CPU tasks run on threads of their own as
+// soon as their dependencies are done; GL tasks are queued for the thread that
+// owns the context, which runs them in finish(). A task whose dependency
+// failed is skipped and fails too. Every task goes to a timeline, measured
+// from the loader's creation.
+class StartupLoader {
+public:
+	StartupLoader();
+	~StartupLoader(); // waits for the CPU tasks still running
+
+	LoadFuture run(const char * name, const std::vector<LoadFuture>& dependencies, const std::function<bool()>& task);
+
+	// Main thread only, like finish()
+	LoadFuture run_gl(const char * name, const std::vector<LoadFuture>& dependencies, const std::function<bool()>& task);
+
+	// Main thread work that is no task, run right away and put in the timeline
+	bool run_here(const char * name, const std::function<bool()>& task);
+
+	// Runs the GL tasks as their dependencies complete, until every task is
+	// done. false when one of them failed.
+	bool finish();
+
+	void print_timeline();
+
+private:
+	struct GLTask {
+		std::string name;
+		std::vector<LoadFuture> dependencies;
+		std::function<bool()> task;
+		std::shared_ptr<std::promise<bool> > done;
+	};
+
+	struct Span {
+		std::string name;
+		const char * lane; // "main", "gl" or "worker"
+		double start_ms, end_ms;
+		bool ok;
+	};
+
+	double now_ms() const;
+	void record(const std::string& name, const char * lane, double start_ms, double end_ms, bool ok);
+
+	std::chrono::high_resolution_clock::time_point origin;
+
+	std::mutex mutex; // timeline
+	std::condition_variable progress; // a CPU task is done
+
+	std::vector<GLTask> gl_tasks; // not run yet
+	std::vector<LoadFuture> tasks; // CPU and GL
+	std::vector<LoadFuture> worker_tasks;
+	std::vector<Span> timeline;
+};
+
+#endif
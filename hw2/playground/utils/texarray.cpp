@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "bcdecode.hpp"
+#include "assetpack.hpp"
+#include "dds.hpp"
+#include "memtrack.hpp"
+#include "texture.hpp"
+#include "texarray.hpp"
+
+
+// Pixels between two atlas rectangles. The borders are filled with the edge
+// texels, which keeps the first few mip levels from bleeding into each other.
+static const int atlas_padding = 8;
+static const int atlas_max_level = 3;
+
+static bool is_dds(const char * path) {
+	size_t length = strlen(path);
+	if (length < 4)
+		return false;
+	const char * ext = path + length - 4;
+	return ext[0] == '.' && tolower(ext[1]) == 'd' && tolower(ext[2]) == 'd' && tolower(ext[3]) == 's';
+}
+
+static int next_power_of_two(int value) {
+	int result = 1;
+	while (result < value)
+		result *= 2;
+	return result;
+}
+
+static void set_filtering(GLenum target, GLenum wrap, int max_level) {
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, max_level);
+}
+
+// Every input is a .DDS of the same size and mip count, in a compressed format
+// the driver takes : the layers go from the mapped files to the array as they are
+static bool load_compressed_array(const std::vector<const char *> & paths, TextureSet & set) {
+	int count = paths.size();
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	if (count > max_layers)
+		return false;
+
+	std::vector<Asset> files(count);
+	std::vector<DDSImage> images(count);
+	for (int i = 0; i < count; i++) {
+		if (!is_dds(paths[i]) || !files[i].open(paths[i]))
+			return false;
+		if (!parse_dds(files[i].data(), files[i].size(), images[i]))
+			return false;
+
+		const DDSImage & image = images[i];
+		if (!image.compressed || !dds_format_supported(image))
+			return false;
+		if (image.gl_format != images[0].gl_format || image.width != images[0].width ||
+			image.height != images[0].height || image.mip_count != images[0].mip_count)
+			return false;
+	}
+
+	glGenTextures(1, &set.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, set.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	size_t bytes = 0;
+	for (int level = 0; level < images[0].mip_count; level++) {
+		const DDSLevel & l = images[0].level(0, level);
+		glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, images[0].gl_format, l.width, l.height, count,
+			0, l.size * count, NULL);
+		bytes += l.size * count;
+	}
+	track_gpu_resource(GPU_TEXTURE, set.texture, "texture set array", bytes, images[0].gl_format,
+		images[0].width, images[0].height, count, images[0].mip_count);
+	for (int i = 0; i < count; i++) {
+		for (int level = 0; level < images[i].mip_count; level++) {
+			const DDSLevel & l = images[i].level(0, level);
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, i, l.width, l.height, 1,
+				images[i].gl_format, l.size, l.data);
+		}
+	}
+	set_filtering(GL_TEXTURE_2D_ARRAY, GL_REPEAT, images[0].mip_count - 1);
+
+	set.target = GL_TEXTURE_2D_ARRAY;
+	return true;
+}
+
+// Same sized RGBA8 images, mipmaps are generated by the GL
+static void upload_array(const std::vector<DecodedImage> & images, TextureSet & set) {
+	int width = images[0].width;
+	int height = images[0].height;
+
+	glGenTextures(1, &set.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, set.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, images.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	for (size_t i = 0; i < images.size(); i++) {
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+			&images[i].levels[0][0]);
+	}
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	int max_level = (int)log2((float)std::max(width, height));
+	track_gpu_resource(GPU_TEXTURE, set.texture, "texture set array", texture_bytes(GL_RGBA8, width, height, images.size(), 0),
+		GL_RGBA8, width, height, images.size(), max_level + 1);
+	set_filtering(GL_TEXTURE_2D_ARRAY, GL_REPEAT, max_level);
+
+	set.target = GL_TEXTURE_2D_ARRAY;
+}
+
+// Shelf packing, tallest images first
+static bool upload_atlas(const std::vector<DecodedImage> & images, TextureSet & set) {
+	int count = images.size();
+
+	std::vector<int> order(count);
+	int area = 0;
+	int max_width = 0;
+	for (int i = 0; i < count; i++) {
+		order[i] = i;
+		area += (images[i].width + atlas_padding) * (images[i].height + atlas_padding);
+		max_width = std::max(max_width, images[i].width);
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return images[a].height > images[b].height; });
+
+	int atlas_width = next_power_of_two(std::max(max_width + 2 * atlas_padding, (int)sqrt((float)area)));
+	std::vector<int> x(count), y(count);
+	int cursor_x = atlas_padding;
+	int cursor_y = atlas_padding;
+	int shelf_height = 0;
+	for (int k = 0; k < count; k++) {
+		int i = order[k];
+		if (cursor_x + images[i].width + atlas_padding > atlas_width) {
+			cursor_y += shelf_height + atlas_padding;
+			cursor_x = atlas_padding;
+			shelf_height = 0;
+		}
+		x[i] = cursor_x;
+		y[i] = cursor_y;
+		cursor_x += images[i].width + atlas_padding;
+		shelf_height = std::max(shelf_height, images[i].height);
+	}
+	int atlas_height = next_power_of_two(cursor_y + shelf_height + atlas_padding);
+
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (atlas_width > max_size || atlas_height > max_size) {
+		printf("The atlas would be %dx%d, more than the %d the driver allows\n", atlas_width, atlas_height, max_size);
+		return false;
+	}
+
+	// Each image plus half of the padding around it, clamped to its edges
+	int border = atlas_padding / 2;
+	std::vector<unsigned char> pixels(atlas_width * atlas_height * 4, 0);
+	set.rects.resize(count);
+	for (int i = 0; i < count; i++) {
+		const DecodedImage & image = images[i];
+		const unsigned char * src = &image.levels[0][0];
+		for (int dy = -border; dy < image.height + border; dy++) {
+			int sy = std::min(std::max(dy, 0), image.height - 1);
+			for (int dx = -border; dx < image.width + border; dx++) {
+				int sx = std::min(std::max(dx, 0), image.width - 1);
+				memcpy(&pixels[((y[i] + dy) * atlas_width + x[i] + dx) * 4], src + (sy * image.width + sx) * 4, 4);
+			}
+		}
+
+		set.rects[i] = glm::vec4(
+			(float)image.width / atlas_width, (float)image.height / atlas_height,
+			(float)x[i] / atlas_width, (float)y[i] / atlas_height
+		);
+	}
+
+	glGenTextures(1, &set.texture);
+	glBindTexture(GL_TEXTURE_2D, set.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_width, atlas_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	track_gpu_resource(GPU_TEXTURE, set.texture, "texture set atlas", texture_bytes(GL_RGBA8, atlas_width, atlas_height, 1, 0),
+		GL_RGBA8, atlas_width, atlas_height, 1, (int)log2((float)std::max(atlas_width, atlas_height)) + 1);
+
+	// The shader wraps the UVs itself, inside the rectangle
+	set_filtering(GL_TEXTURE_2D, GL_CLAMP_TO_EDGE, atlas_max_level);
+
+	set.target = GL_TEXTURE_2D;
+	return true;
+}
+
+bool load_texture_set(const std::vector<const char *> & paths, TextureSet & set) {
+	if (paths.empty())
+		return false;
+
+	set.layer_count = paths.size();
+	set.rects.clear();
+
+	// .BMP files go through their compressed cache
+	std::vector<std::string> cached(paths.size());
+	std::vector<const char *> resolved(paths);
+	for (size_t i = 0; i < paths.size(); i++) {
+		if (!is_dds(paths[i]) && cacheBMP_DDS(paths[i], cached[i]))
+			resolved[i] = cached[i].c_str();
+	}
+	if (load_compressed_array(resolved, set))
+		return true;
+
+	// Mixed inputs : everything is decoded to RGBA8 first
+	std::vector<DecodedImage> images(resolved.size());
+	bool same_size = true;
+	for (size_t i = 0; i < resolved.size(); i++) {
+		bool loaded = is_dds(resolved[i]) ? loadDDS_decoded(resolved[i], images[i]) : loadBMP_decoded(resolved[i], images[i]);
+		if (!loaded)
+			return false;
+		same_size = same_size && images[i].width == images[0].width && images[i].height == images[0].height;
+	}
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	if (same_size && set.layer_count <= max_layers) {
+		upload_array(images, set);
+		return true;
+	}
+
+	if (set.layer_count > max_atlas_layers) {
+		printf("%d images can't go into one atlas, the limit is %d\n", set.layer_count, max_atlas_layers);
+		return false;
+	}
+	return upload_atlas(images, set);
+}
+
+void free_texture_set(TextureSet & set) {
+	delete_tracked_textures(1, &set.texture);
+	set.texture = 0;
+	set.layer_count = 0;
+	set.rects.clear();
+}
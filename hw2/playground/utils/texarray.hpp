@@ -0,0 +1,32 @@
+#ifndef TEXARRAY_HPP
+#define TEXARRAY_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Several images for objects of the same mesh in one texture, so they can be
+// drawn in one batch with a per-instance layer index.
+// Images of the same size go into a GL_TEXTURE_2D_ARRAY; when the sizes differ
+// (or there are more than the driver allows in an array) they are packed into
+// an atlas and each layer gets a rectangle instead.
+struct TextureSet {
+	GLenum target;            // GL_TEXTURE_2D_ARRAY, or GL_TEXTURE_2D for an atlas
+	GLuint texture;
+	int layer_count;
+
+	// Atlas only : per layer, uv scale in xy and uv offset in zw
+	std::vector<glm::vec4> rects;
+
+	TextureSet() : target(0), texture(0), layer_count(0) {}
+};
+
+// Rectangles the atlas shader can take
+const int max_atlas_layers = 32;
+
+// One layer per file, .DDS (first layer of the file) or .BMP (through its .dds cache).
+// DDS files with the same compressed format and size stay compressed.
+bool load_texture_set(const std::vector<const char *> & paths, TextureSet & set);
+void free_texture_set(TextureSet & set);
+
+#endif
@@ -6,6 +6,20 @@
 
 #include <GLFW/glfw3.h>
 
+#include <sys/stat.h>
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include "bcdecode.hpp"
+#include "bcencode.hpp"
+#include "mapped_file.hpp"
+#include "assetpack.hpp"
+#include "dds.hpp"
+#include "memtrack.hpp"
+#include "texture.hpp"
+
 
 GLuint loadBMP_custom(const char * imagepath){
 
@@ -88,11 +102,190 @@ GLuint loadBMP_custom(const char * imagepath){
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	// ... which requires mipmaps. Generate them automatically.
 	glGenerateMipmap(GL_TEXTURE_2D);
+	track_gpu_resource(GPU_TEXTURE, textureID, imagepath, texture_bytes(GL_RGB, width, height, 1, 0), GL_RGB, width, height);
 
 	// Return the ID of the texture we just created
 	return textureID;
 }
 
+// Same header checks as loadBMP_custom, 24 and 32bpp, into RGBA8
+bool loadBMP_decoded(const char * imagepath, DecodedImage & image){
+
+	FILE * file = fopen(imagepath,"rb");
+	if (!file){
+		printf("%s could not be opened.\n", imagepath);
+		return false;
+	}
+
+	unsigned char header[54];
+	if ( fread(header, 1, 54, file)!=54 || header[0]!='B' || header[1]!='M' ){ 
+		printf("Not a correct BMP file\n");
+		fclose(file);
+		return false;
+	}
+	int bpp = *(short*)&(header[0x1C]);
+	if ( *(int*)&(header[0x1E])!=0 || (bpp!=24 && bpp!=32) ){
+		printf("%s : only uncompressed 24 and 32bpp BMP files are supported\n", imagepath);
+		fclose(file);
+		return false;
+	}
+
+	unsigned int dataPos = *(int*)&(header[0x0A]);
+	int width  = *(int*)&(header[0x12]);
+	int height = *(int*)&(header[0x16]);
+	if (dataPos==0)      dataPos=54;
+
+	// Negative height : rows are already stored top first
+	bool top_down = height < 0;
+	if (top_down) height = -height;
+	if (width <= 0 || height <= 0) {
+		printf("Not a correct BMP file\n");
+		fclose(file);
+		return false;
+	}
+
+	int pixel_size = bpp / 8;
+	int row_size = (width * pixel_size + 3) & ~3;
+	std::vector<unsigned char> data(row_size * height);
+	fseek(file, dataPos, SEEK_SET);
+	size_t read = fread(&data[0], 1, data.size(), file);
+	fclose(file);
+	if (read != data.size()) {
+		printf("%s is truncated\n", imagepath);
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.levels.assign(1, std::vector<unsigned char>(width * height * 4));
+	unsigned char * out = &image.levels[0][0];
+	for (int y = 0; y < height; y++) {
+		const unsigned char * row = &data[(top_down ? y : height - 1 - y) * row_size];
+		for (int x = 0; x < width; x++) {
+			const unsigned char * in = row + x * pixel_size;
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = pixel_size == 4 ? in[3] : 255;
+			out += 4;
+		}
+	}
+	return true;
+}
+
+// foo.bmp -> foo.dds
+static std::string dds_cache_path(const char * imagepath){
+	std::string path = imagepath;
+	size_t dot = path.find_last_of('.');
+	size_t slash = path.find_last_of("/\\");
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+		path.erase(dot);
+	return path + ".dds";
+}
+
+// The cache is used when it is at least as recent as its source and not truncated
+static bool dds_cache_valid(const char * imagepath, const std::string & dds_path){
+	struct stat source_stat, cache_stat;
+	if (stat(imagepath, &source_stat) != 0 || stat(dds_path.c_str(), &cache_stat) != 0)
+		return false;
+	if (cache_stat.st_mtime < source_stat.st_mtime)
+		return false;
+
+	MappedFile file;
+	DDSImage image;
+	return file.open(dds_path.c_str()) && parse_dds(file.data(), file.size(), image);
+}
+
+bool cacheBMP_DDS(const char * imagepath, std::string & dds_path){
+	dds_path = dds_cache_path(imagepath);
+	if (dds_cache_valid(imagepath, dds_path))
+		return true;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	DecodedImage image;
+	if (!loadBMP_decoded(imagepath, image))
+		return false;
+	generate_mipmaps(image);
+
+	BCFormat format = choose_bc_format(image);
+	std::vector<unsigned char> data;
+	encode_bc_levels(image, format, data);
+	if (!save_dds(dds_path.c_str(), image.width, image.height, image.levels.size(), format, &data[0], data.size()))
+		return false;
+
+	auto end = std::chrono::high_resolution_clock::now();
+	printf("%s compressed to %s (%s, %d levels) in %.1f ms\n", imagepath, dds_path.c_str(),
+		format == BC_FORMAT_BC1 ? "BC1" : "BC3", (int)image.levels.size(),
+		std::chrono::duration<double, std::milli>(end - start).count());
+	return true;
+}
+
+GLuint loadBMP_compressed(const char * imagepath){
+	std::string dds_path;
+	if (cacheBMP_DDS(imagepath, dds_path)) {
+		GLuint textureID = loadDDS(dds_path.c_str());
+		if (textureID)
+			return textureID;
+	}
+
+	// No cache (read-only directory, ...) : the uncompressed path
+	return loadBMP_custom(imagepath);
+}
+
+static void put_u16(unsigned char* p, unsigned int v) {
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_u32(unsigned char* p, unsigned int v) {
+	put_u16(p, v & 0xffff);
+	put_u16(p + 2, v >> 16);
+}
+
+// Write RGBA8 pixels (bottom row first) as a 24bpp .BMP
+bool saveBMP(const char * imagepath, int width, int height, const unsigned char * rgba) {
+	FILE * file = fopen(imagepath, "wb");
+	if (!file) {
+		printf("%s could not be opened for writing\n", imagepath);
+		return false;
+	}
+
+	// 24bpp, rows bottom-up and padded to 4 bytes, the same layout loadBMP_custom reads
+	int row_size = (width * 3 + 3) & ~3;
+	unsigned int imageSize = row_size * height;
+
+	unsigned char header[54];
+	memset(header, 0, sizeof(header));
+	header[0] = 'B';
+	header[1] = 'M';
+	put_u32(header + 0x02, 54 + imageSize);
+	put_u32(header + 0x0A, 54);
+	put_u32(header + 0x0E, 40);
+	put_u32(header + 0x12, width);
+	put_u32(header + 0x16, height);
+	put_u16(header + 0x1A, 1);
+	put_u16(header + 0x1C, 24);
+	put_u32(header + 0x22, imageSize);
+	put_u32(header + 0x26, 2835);
+	put_u32(header + 0x2A, 2835);
+
+	std::vector<unsigned char> data(imageSize, 0);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const unsigned char* in = &rgba[(y * width + x) * 4];
+			unsigned char* out = &data[y * row_size + x * 3];
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+		}
+	}
+
+	bool ok = fwrite(header, 1, 54, file) == 54 && fwrite(&data[0], 1, imageSize, file) == imageSize;
+	fclose(file);
+	return ok;
+}
+
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 // or do it yourself (just like loadBMP_custom and loadDDS)
 //GLuint loadTGA_glfw(const char * imagepath){
@@ -120,99 +313,173 @@ GLuint loadBMP_custom(const char * imagepath){
 
 
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+// Can the driver take this format as it is ?
+bool dds_format_supported(const DDSImage & image){
+	switch(image.gl_format)
+	{
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc;
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+	case GL_COMPRESSED_RGBA_BPTC_UNORM:
+	case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+	case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+	case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+		return GLEW_ARB_texture_compression_bptc;
+	default:
+		// RGTC and the 8 bit formats are core in 3.3
+		return true;
+	}
+}
 
-GLuint loadDDS(const char * imagepath){
+static void upload_dds_level(
+	GLenum target, int layer, int level, GLenum internal_format, bool compressed,
+	GLenum pixel_format, int width, int height, const void * data, unsigned int size
+){
+	if (target == GL_TEXTURE_2D_ARRAY) {
+		// Storage for all layers was allocated up front
+		if (compressed)
+			glCompressedTexSubImage3D(target, level, 0, 0, layer, width, height, 1, internal_format, size, data);
+		else
+			glTexSubImage3D(target, level, 0, 0, layer, width, height, 1, pixel_format, GL_UNSIGNED_BYTE, data);
+		return;
+	}
 
-	unsigned char header[124];
+	GLenum image_target = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer : target;
+	if (compressed)
+		glCompressedTexImage2D(image_target, level, internal_format, width, height, 0, size, data);
+	else
+		glTexImage2D(image_target, level, internal_format, width, height, 0, pixel_format, GL_UNSIGNED_BYTE, data);
+}
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+GLuint loadDDS(const char * imagepath, GLenum & target){
+
+	// The levels are uploaded straight from the mapping of the file or of the
+	// asset pack, nothing is read into memory first
+	Asset file;
+	if (!file.open(imagepath))
+		return 0;
+
+	DDSImage image;
+	if (!parse_dds(file.data(), file.size(), image)) {
+		printf("%s can't be loaded\n", imagepath);
 		return 0;
 	}
-   
-	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
-	}
-	
-	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
-
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC      = *(unsigned int*)&(header[80]);
-
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	unsigned int format;
-	switch(fourCC) 
-	{ 
-	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
-		break; 
-	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
-		break; 
-	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
-		break; 
-	default: 
-		free(buffer); 
-		return 0; 
+
+	// Formats the driver lacks are decoded on the CPU when we know how
+	bool decode = image.compressed && !dds_format_supported(image);
+	if (decode && image.bc_format < 0) {
+		printf("%s : the driver does not support its compressed format\n", imagepath);
+		return 0;
 	}
+	GLenum internal_format = decode ? GL_RGBA8 : image.gl_format;
+	GLenum pixel_format = decode ? GL_RGBA : image.gl_pixel_format;
+	bool compressed = image.compressed && !decode;
+
+	if (image.cubemap)
+		target = GL_TEXTURE_CUBE_MAP;
+	else if (image.layer_count > 1)
+		target = GL_TEXTURE_2D_ARRAY;
+	else
+		target = GL_TEXTURE_2D;
 
 	// Create one OpenGL texture
 	GLuint textureID;
 	glGenTextures(1, &textureID);
 
 	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	glBindTexture(target, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
-	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
-
-	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
-	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
-		width  /= 2; 
-		height /= 2; 
 
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if(width < 1) width = 1;
-		if(height < 1) height = 1;
+	if (target == GL_TEXTURE_2D_ARRAY) {
+		for (int level = 0; level < image.mip_count; ++level) {
+			const DDSLevel & l = image.level(0, level);
+			if (compressed)
+				glCompressedTexImage3D(target, level, internal_format, l.width, l.height, image.layer_count,
+					0, l.size * image.layer_count, NULL);
+			else
+				glTexImage3D(target, level, internal_format, l.width, l.height, image.layer_count,
+					0, pixel_format, GL_UNSIGNED_BYTE, NULL);
+		}
+	}
 
-	} 
+	/* load the mipmaps of every layer */ 
+	for (int layer = 0; layer < image.layer_count; ++layer) {
+		if (decode) {
+			DecodedImage decoded;
+			decode_bc_levels(image.level(layer, 0).data, image.width, image.height, image.mip_count,
+				(BCFormat)image.bc_format, decoded);
+			for (int level = 0; level < image.mip_count; ++level) {
+				const DDSLevel & l = image.level(layer, level);
+				upload_dds_level(target, layer, level, internal_format, false, pixel_format,
+					l.width, l.height, &decoded.levels[level][0], l.width * l.height * 4);
+			}
+			continue;
+		}
+
+		for (int level = 0; level < image.mip_count; ++level) {
+			const DDSLevel & l = image.level(layer, level);
+			upload_dds_level(target, layer, level, internal_format, compressed, pixel_format,
+				l.width, l.height, l.data, l.size);
+		}
+	}
 
-	free(buffer); 
+	// Files with a partial mip chain are still complete textures
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, image.mip_count - 1);
+	track_gpu_resource(GPU_TEXTURE, textureID, imagepath,
+		texture_bytes(internal_format, image.width, image.height, image.layer_count, image.mip_count), internal_format,
+		image.width, image.height, image.layer_count, image.mip_count);
 
 	return textureID;
 
+}
+
+GLuint loadDDS(const char * imagepath){
+	GLenum target;
+	return loadDDS(imagepath, target);
+}
+
+bool loadDDS_decoded(const char * imagepath, DecodedImage & image){
+
+	Asset file;
+	if (!file.open(imagepath))
+		return false;
+
+	DDSImage dds;
+	if (!parse_dds(file.data(), file.size(), dds)) {
+		printf("%s can't be loaded\n", imagepath);
+		return false;
+	}
+
+	// First layer only
+	if (dds.bc_format >= 0) {
+		decode_bc_levels(dds.level(0, 0).data, dds.width, dds.height, dds.mip_count, (BCFormat)dds.bc_format, image);
+		return true;
+	}
+
+	if (!dds.compressed) {
+		image.width = dds.width;
+		image.height = dds.height;
+		image.levels.resize(dds.mip_count);
+		for (int level = 0; level < dds.mip_count; ++level) {
+			const DDSLevel & l = dds.level(0, level);
+			image.levels[level].assign(l.data, l.data + l.size);
+			if (dds.gl_pixel_format == GL_BGRA) {
+				for (unsigned int i = 0; i < l.size; i += 4) {
+					unsigned char b = image.levels[level][i];
+					image.levels[level][i] = image.levels[level][i + 2];
+					image.levels[level][i + 2] = b;
+				}
+			}
+		}
+		return true;
+	}
 
+	printf("%s : no CPU decoder for its compressed format\n", imagepath);
+	return false;
 }
\ No newline at end of file
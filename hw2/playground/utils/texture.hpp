@@ -1,16 +1,51 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
+#include <string>
+
+// The textures of these loaders are in the memory registry, see memtrack.hpp :
+// delete them with delete_tracked_textures
+
 // Load a .BMP file using our custom loader
 GLuint loadBMP_custom(const char * imagepath);
 
+// Decode a 24 or 32bpp .BMP file into one RGBA8 level.
+// Rows are flipped to be top first, the order of .DDS files, so both kinds
+// of images can share a texture and the DDS-inverted V of our .obj loader.
+struct DecodedImage;
+bool loadBMP_decoded(const char * imagepath, DecodedImage & image);
+
+// Compress a .BMP file into a .DDS file next to it (foo.bmp -> foo.dds) : BC1, or BC3
+// when it has alpha, with the mip chain built on the CPU and the blocks encoded on
+// the thread pool. An existing .dds newer than the .bmp is reused as it is.
+bool cacheBMP_DDS(const char * imagepath, std::string & dds_path);
+
+// Load a .BMP file through its compressed .DDS cache : 4-8 times less memory
+// than loadBMP_custom, whose RGB8 levels are generated by the driver
+GLuint loadBMP_compressed(const char * imagepath);
+
+// Write RGBA8 pixels (bottom row first, like glReadPixels returns them) as a 24bpp .BMP
+bool saveBMP(const char * imagepath, int width, int height, const unsigned char * rgba);
+
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 //// or do it yourself (just like loadBMP_custom and loadDDS)
 //// Load a .TGA file using GLFW's own loader
 //GLuint loadTGA_glfw(const char * imagepath);
 
 // Load a .DDS file using GLFW's own loader
+// (BC1-3 are decoded on the CPU when the driver has no S3TC support)
 GLuint loadDDS(const char * imagepath);
 
+// Same, for files that may hold texture arrays or cubemaps : target is set to
+// GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP
+GLuint loadDDS(const char * imagepath, GLenum & target);
+
+// Decode the first layer of a .DDS file into RGBA8 mip levels, for CPU-side consumers
+bool loadDDS_decoded(const char * imagepath, DecodedImage & image);
+
+// Can the driver upload the compressed format of a parsed .DDS file as it is ?
+struct DDSImage;
+bool dds_format_supported(const DDSImage & image);
+
 
 #endif
\ No newline at end of file
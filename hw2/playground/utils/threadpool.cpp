@@ -0,0 +1,106 @@
+#include <stddef.h>
+
+#include "threadpool.hpp"
+
+// Set on pool threads (and on the caller while it helps out), so that a nested
+// parallel_for simply runs inline instead of waiting on itself
+static thread_local bool inside_pool = false;
+
+
+ThreadPool::ThreadPool(int thread_count)
+	: job(NULL), job_count(0), generation(0), stopping(false), next_index(0), busy_workers(0) {
+	if (thread_count <= 0)
+		thread_count = (int)std::thread::hardware_concurrency();
+	if (thread_count <= 0)
+		thread_count = 1;
+
+	// The thread calling parallel_for works too, so it is not counted here
+	for (int i = 1; i < thread_count; i++) {
+		workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+int ThreadPool::size() const {
+	return (int)workers.size() + 1;
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)>& fn) {
+	if (count <= 0)
+		return;
+
+	if (inside_pool || workers.empty() || count == 1) {
+		for (int i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	// Only one job at a time, other submitters wait here
+	std::lock_guard<std::mutex> submit(submit_mutex);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		job_count = count;
+		next_index = 0;
+		busy_workers = (int)workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	inside_pool = true;
+	run_indices();
+	inside_pool = false;
+
+	// fn must stay alive until every worker has left run_indices
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy_workers == 0; });
+	job = NULL;
+}
+
+void ThreadPool::run_indices() {
+	for (;;) {
+		int i = next_index.fetch_add(1);
+		if (i >= job_count)
+			break;
+		(*job)(i);
+	}
+}
+
+void ThreadPool::worker_loop() {
+	inside_pool = true;
+	unsigned int seen_generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping)
+				return;
+			seen_generation = generation;
+		}
+
+		run_indices();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		busy_workers--;
+		if (busy_workers == 0)
+			done.notify_one();
+	}
+}
+
+
+ThreadPool& get_thread_pool() {
+	static ThreadPool pool;
+	return pool;
+}
@@ -0,0 +1,46 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Fixed set of worker threads used by the CPU-heavy parts of the program.
+// parallel_for() splits [0, count) between the workers and the calling thread
+// and returns when every index has been processed.
+class ThreadPool {
+public:
+	// 0 threads means "one per hardware thread"
+	explicit ThreadPool(int thread_count = 0);
+	~ThreadPool();
+
+	// Number of threads taking part in parallel_for (workers + caller)
+	int size() const;
+
+	void parallel_for(int count, const std::function<void(int)>& fn);
+
+private:
+	void worker_loop();
+	void run_indices();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::mutex submit_mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(int)>* job;
+	int job_count;
+	unsigned int generation;
+	bool stopping;
+	std::atomic<int> next_index;
+	int busy_workers;
+};
+
+// Process-wide pool, created on first use
+ThreadPool& get_thread_pool();
+
+#endif
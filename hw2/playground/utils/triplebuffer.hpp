@@ -0,0 +1,45 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+// Latest value from one producer thread to one consumer thread, lock-free and
+// wait-free. Three slots : the producer fills one, the consumer reads another
+// and the third holds the last value published. Neither side ever waits for
+// the other. A producer that is faster than the consumer overwrites values
+// that were never read, a slower one leaves the consumer on the same value.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : middle(1), back(2), front(0) {}
+
+	// Producer : the slot to fill, which still holds an older value
+	T & write_slot() { return slots[back]; }
+
+	// Producer : hands the filled slot over and takes the middle one back
+	void publish() {
+		back = middle.exchange(back | fresh_bit, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Consumer : true when a value was published since the last call, then
+	// read_slot() returns it. Else read_slot() keeps the one it had.
+	bool acquire() {
+		if (!(middle.load(std::memory_order_relaxed) & fresh_bit))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+	const T & read_slot() const { return slots[front]; }
+
+private:
+	static const int index_mask = 3;
+	static const int fresh_bit = 4;
+
+	T slots[3];
+	std::atomic<int> middle; // slot index, with fresh_bit until the consumer takes it
+	int back;  // producer only
+	int front; // consumer only
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "vertexformat.hpp"
+
+
+VertexFormat get_full_vertex_format() {
+	VertexFormat format;
+	format.quantize_positions = false;
+	format.uv_type = GL_FLOAT;
+	format.pack_normals = false;
+	format.pack_colors = false;
+	return format;
+}
+
+VertexFormat get_compact_vertex_format() {
+	VertexFormat format;
+	format.quantize_positions = true;
+	format.uv_type = GL_HALF_FLOAT;
+	format.pack_normals = true;
+	format.pack_colors = true;
+	return format;
+}
+
+static VertexAttribute make_attribute(int size, GLenum type, GLboolean normalized, int stride) {
+	VertexAttribute attribute;
+	attribute.size = size;
+	attribute.type = type;
+	attribute.normalized = normalized;
+	attribute.stride = stride;
+	return attribute;
+}
+
+void get_position_bounds(const std::vector<glm::vec3>& positions, glm::vec3& min, glm::vec3& max) {
+	min = max = positions.empty() ? glm::vec3(0.0f) : positions[0];
+	for (size_t i = 1; i < positions.size(); i++) {
+		min = glm::min(min, positions[i]);
+		max = glm::max(max, positions[i]);
+	}
+}
+
+MeshLayout get_mesh_layout(const VertexFormat& format, const glm::vec3& min, const glm::vec3& max) {
+	MeshLayout layout;
+	if (format.quantize_positions) {
+		// 3 unorm16 and one unused, the GPUs fetch 4 byte aligned attributes faster
+		layout.position = make_attribute(3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(unsigned short));
+		layout.position_offset = min;
+		layout.position_scale = max - min;
+	} else {
+		layout.position = make_attribute(3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+		layout.position_offset = glm::vec3(0.0f);
+		layout.position_scale = glm::vec3(1.0f);
+	}
+
+	if (format.uv_type == GL_FLOAT)
+		layout.uv = make_attribute(2, GL_FLOAT, GL_FALSE, 2 * sizeof(float));
+	else if (format.uv_type == GL_UNSIGNED_SHORT)
+		layout.uv = make_attribute(2, GL_UNSIGNED_SHORT, GL_TRUE, 2 * sizeof(unsigned short));
+	else
+		layout.uv = make_attribute(2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(unsigned short));
+
+	if (format.pack_normals)
+		layout.normal = make_attribute(2, GL_BYTE, GL_TRUE, 4); // 2 bytes of padding
+	else
+		layout.normal = make_attribute(3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+
+	if (format.pack_colors)
+		layout.color = make_attribute(4, GL_UNSIGNED_BYTE, GL_TRUE, 4);
+	else
+		layout.color = make_attribute(4, GL_FLOAT, GL_FALSE, 4 * sizeof(float));
+	return layout;
+}
+
+template <typename T>
+static void append(std::vector<unsigned char>& data, const T* values, size_t count) {
+	size_t offset = data.size();
+	data.resize(offset + count * sizeof(T));
+	memcpy(&data[offset], values, count * sizeof(T));
+}
+
+static unsigned short to_unorm16(float value) {
+	value = value < 0 ? 0 : (value > 1 ? 1 : value);
+	return (unsigned short)(value * 65535.0f + 0.5f);
+}
+
+static unsigned char to_unorm8(float value) {
+	value = value < 0 ? 0 : (value > 1 ? 1 : value);
+	return (unsigned char)(value * 255.0f + 0.5f);
+}
+
+static signed char to_snorm8(float value) {
+	value = value < -1 ? -1 : (value > 1 ? 1 : value);
+	return (signed char)floorf(value * 127.0f + 0.5f);
+}
+
+// Rounded to nearest, too small values flush to zero and too big ones go infinite
+static unsigned short to_half(float value) {
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned short sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+	if (exponent <= 0)
+		return sign;
+	if (exponent >= 31)
+		return sign | 0x7c00;
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++; // a carry out of the mantissa rightly bumps the exponent
+	return (unsigned short)half;
+}
+
+void pack_positions(
+	const std::vector<glm::vec3>& positions, const VertexFormat& format, const glm::vec3& min, const glm::vec3& max,
+	std::vector<unsigned char>& data
+) {
+	if (!format.quantize_positions) {
+		append(data, positions.empty() ? NULL : &positions[0], positions.size());
+		return;
+	}
+	glm::vec3 extent = max - min;
+	std::vector<unsigned short> values(positions.size() * 4, 0);
+	for (size_t i = 0; i < positions.size(); i++) {
+		for (int k = 0; k < 3; k++)
+			values[i * 4 + k] = extent[k] > 0 ? to_unorm16((positions[i][k] - min[k]) / extent[k]) : 0;
+	}
+	append(data, values.empty() ? NULL : &values[0], values.size());
+}
+
+void pack_uvs(const std::vector<glm::vec2>& uvs, const VertexFormat& format, std::vector<unsigned char>& data) {
+	if (format.uv_type == GL_FLOAT) {
+		append(data, uvs.empty() ? NULL : &uvs[0], uvs.size());
+		return;
+	}
+	std::vector<unsigned short> values(uvs.size() * 2);
+	for (size_t i = 0; i < uvs.size(); i++) {
+		for (int k = 0; k < 2; k++)
+			values[i * 2 + k] = format.uv_type == GL_UNSIGNED_SHORT ? to_unorm16(uvs[i][k]) : to_half(uvs[i][k]);
+	}
+	append(data, values.empty() ? NULL : &values[0], values.size());
+}
+
+void pack_normals(const std::vector<glm::vec3>& normals, const VertexFormat& format, std::vector<unsigned char>& data) {
+	if (!format.pack_normals) {
+		append(data, normals.empty() ? NULL : &normals[0], normals.size());
+		return;
+	}
+	std::vector<signed char> values(normals.size() * 4, 0);
+	for (size_t i = 0; i < normals.size(); i++) {
+		// Onto the octahedron |x| + |y| + |z| = 1, the lower half folded over the upper one
+		glm::vec3 n = normals[i];
+		float length = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		glm::vec2 e = length > 0 ? glm::vec2(n.x, n.y) / length : glm::vec2(0.0f);
+		if (n.z < 0) {
+			glm::vec2 folded(1 - fabsf(e.y), 1 - fabsf(e.x));
+			e = glm::vec2(e.x >= 0 ? folded.x : -folded.x, e.y >= 0 ? folded.y : -folded.y);
+		}
+		values[i * 4] = to_snorm8(e.x);
+		values[i * 4 + 1] = to_snorm8(e.y);
+	}
+	append(data, values.empty() ? NULL : &values[0], values.size());
+}
+
+void pack_colors(const std::vector<glm::vec4>& colors, const VertexFormat& format, std::vector<unsigned char>& data) {
+	if (!format.pack_colors) {
+		append(data, colors.empty() ? NULL : &colors[0], colors.size());
+		return;
+	}
+	std::vector<unsigned char> values(colors.size() * 4);
+	for (size_t i = 0; i < colors.size(); i++) {
+		for (int k = 0; k < 4; k++)
+			values[i * 4 + k] = to_unorm8(colors[i][k]);
+	}
+	append(data, values.empty() ? NULL : &values[0], values.size());
+}
+
+VertexFormat fit_vertex_format(const VertexFormat& format, const std::vector<glm::vec2>& uvs) {
+	VertexFormat fitted = format;
+	if (format.uv_type != GL_UNSIGNED_SHORT)
+		return fitted;
+	for (size_t i = 0; i < uvs.size(); i++) {
+		if (uvs[i].x < 0 || uvs[i].x > 1 || uvs[i].y < 0 || uvs[i].y > 1) {
+			fitted.uv_type = GL_HALF_FLOAT;
+			break;
+		}
+	}
+	return fitted;
+}
+
+void pack_mesh(const IndexedMesh& mesh, const VertexFormat& format, PackedMesh& packed, const char* name) {
+	VertexFormat fitted = fit_vertex_format(format, mesh.uvs);
+	if (fitted.uv_type != format.uv_type)
+		printf("mesh %s : uvs out of [0, 1], stored as half floats\n", name);
+
+	glm::vec3 min, max;
+	get_position_bounds(mesh.positions, min, max);
+	packed.layout = get_mesh_layout(fitted, min, max);
+	packed.positions.clear();
+	packed.uvs.clear();
+	packed.normals.clear();
+	packed.colors.clear();
+	pack_positions(mesh.positions, fitted, min, max, packed.positions);
+	pack_uvs(mesh.uvs, fitted, packed.uvs);
+	pack_normals(mesh.normals, fitted, packed.normals);
+	pack_colors(mesh.colors, fitted, packed.colors);
+
+	size_t full_size = mesh.positions.size() * sizeof(glm::vec3) + mesh.uvs.size() * sizeof(glm::vec2) +
+		mesh.normals.size() * sizeof(glm::vec3) + mesh.colors.size() * sizeof(glm::vec4);
+	size_t packed_size = packed.positions.size() + packed.uvs.size() + packed.normals.size() + packed.colors.size();
+	printf("mesh %s : %d bytes of vertices, %d as floats\n", name, (int)packed_size, (int)full_size);
+}
+
+void set_vertex_attribute(GLuint index, const VertexAttribute& attribute, size_t offset) {
+	glVertexAttribPointer(index, attribute.size, attribute.type, attribute.normalized, attribute.stride, (void*)offset);
+}
@@ -0,0 +1,73 @@
+#ifndef VERTEXFORMAT_HPP
+#define VERTEXFORMAT_HPP
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "meshopt.hpp"
+
+// How the attributes of the meshes go to the GPU. The compact formats take
+// 8 bytes per position instead of 12, 4 per uv instead of 8, 4 per normal
+// instead of 12 and 4 per color instead of 16.
+struct VertexFormat {
+	bool quantize_positions; // unorm16 within the bounds of the mesh, else float
+	GLenum uv_type;          // GL_FLOAT, GL_HALF_FLOAT or GL_UNSIGNED_SHORT (unorm16, uvs in [0, 1] only)
+	bool pack_normals;       // octahedral map in 2 snorm8, else 3 floats
+	bool pack_colors;        // RGBA8, else 4 floats
+};
+
+VertexFormat get_full_vertex_format();
+VertexFormat get_compact_vertex_format();
+
+// One attribute array as glVertexAttribPointer takes it
+struct VertexAttribute {
+	int size; // components the shader reads
+	GLenum type;
+	GLboolean normalized;
+	int stride; // bytes per vertex, always a multiple of 4
+};
+
+// Where the attributes of a packed mesh are and how the shaders read them.
+// Positions are in model space once the vertex shader did
+// offset + scale * position. Packed normals come as the 2 coordinates of the
+// octahedral map, to decode with
+//   vec3 n = vec3(e, 1 - abs(e.x) - abs(e.y));
+//   if (n.z < 0) n.xy = (1 - abs(n.yx)) * sign(n.xy);
+//   n = normalize(n);
+struct MeshLayout {
+	VertexAttribute position, uv, normal, color;
+	glm::vec3 position_offset, position_scale;
+};
+
+// Attribute arrays in the GPU format, ready for load_buffer. The ones the
+// mesh doesn't have stay empty.
+struct PackedMesh {
+	std::vector<unsigned char> positions, uvs, normals, colors;
+	MeshLayout layout;
+};
+
+void get_position_bounds(const std::vector<glm::vec3>& positions, glm::vec3& min, glm::vec3& max);
+
+// The layout of format, with positions quantized within min and max
+MeshLayout get_mesh_layout(const VertexFormat& format, const glm::vec3& min, const glm::vec3& max);
+
+// Values appended to data in the layout of format
+void pack_positions(
+	const std::vector<glm::vec3>& positions, const VertexFormat& format, const glm::vec3& min, const glm::vec3& max,
+	std::vector<unsigned char>& data
+);
+void pack_uvs(const std::vector<glm::vec2>& uvs, const VertexFormat& format, std::vector<unsigned char>& data);
+void pack_normals(const std::vector<glm::vec3>& normals, const VertexFormat& format, std::vector<unsigned char>& data);
+void pack_colors(const std::vector<glm::vec4>& colors, const VertexFormat& format, std::vector<unsigned char>& data);
+
+// uv_type falls back to GL_HALF_FLOAT when some uv is out of [0, 1]
+VertexFormat fit_vertex_format(const VertexFormat& format, const std::vector<glm::vec2>& uvs);
+
+// Whole mesh, positions within its own bounds, with a line about the size
+void pack_mesh(const IndexedMesh& mesh, const VertexFormat& format, PackedMesh& packed, const char* name);
+
+// glVertexAttribPointer on the buffer bound to GL_ARRAY_BUFFER
+void set_vertex_attribute(GLuint index, const VertexAttribute& attribute, size_t offset);
+
+#endif